@@ -0,0 +1,149 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <format>
+#include <memory>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "threading/thread.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Pieces the timer benchmarks share
+
+namespace Sage::Bench
+{
+
+struct ProcessUsage
+{
+    long m_contextSwitches;
+    TimeUS m_cpuTime;
+};
+
+// cpu includes every thread of the process, SQ pollers too
+inline ProcessUsage GetProcessUsage()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    auto toTime = [](const timeval& tv) { return TimeS{ tv.tv_sec } + TimeUS{ tv.tv_usec }; };
+    return ProcessUsage{ .m_contextSwitches = usage.ru_nvcsw + usage.ru_nivcsw,
+                         .m_cpuTime = toTime(usage.ru_utime) + toTime(usage.ru_stime) };
+}
+
+// Arms its share of the timers once running. The callbacks do nothing, only lateness is of interest
+class LatenessThread final : public Thread
+{
+public:
+    LatenessThread(
+        const std::string& name, TimerService& timerService, std::vector<TimeMS>&& periods, const TimeNS& slack,
+        LatencyHistogram& lateness
+    ) :
+        Thread{ name, timerService },
+        m_periods{ std::move(periods) },
+        m_slack{ slack }
+    {
+        RecordTimerLateness(&lateness);
+    }
+
+protected:
+    void Starting() override
+    {
+        for (const auto& period : m_periods)
+        {
+            StartTimer("Lateness", period, [] {}, m_slack);
+        }
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    const std::vector<TimeMS> m_periods;
+    const TimeNS m_slack;
+};
+
+// A population of periodic timers with periods picked from [minPeriod, maxPeriod], spread over threads.
+// The same seed every time, so runs being compared get the same periods
+class LatenessThreads
+{
+public:
+    LatenessThreads(
+        TimerService& timerService, size_t nTimers, size_t nThreads, const TimeMS& minPeriod, const TimeMS& maxPeriod,
+        const TimeNS& slack = 0ns
+    ) :
+        m_threadLateness(nThreads)
+    {
+        std::mt19937_64 rng{ 42 };
+        std::uniform_int_distribution<TimeMS::rep> pickPeriod{ minPeriod.count(), maxPeriod.count() };
+
+        m_threads.reserve(nThreads);
+        for (size_t i{ 0 }; i < nThreads; i++)
+        {
+            // spread the remainder over the first few threads
+            const size_t nThreadTimers{ (nTimers / nThreads) + (i < nTimers % nThreads ? 1 : 0) };
+            std::vector<TimeMS> periods(nThreadTimers);
+            for (auto& period : periods)
+            {
+                period = TimeMS{ pickPeriod(rng) };
+            }
+
+            m_threads.emplace_back(std::make_unique<LatenessThread>(
+                std::format("Lateness-{}", i), timerService, std::move(periods), slack, m_threadLateness[i]
+            ));
+        }
+    }
+
+    // Runs the threads for duration, then stops them and merges what they recorded
+    LatencyHistogram Run(const TimeNS& duration)
+    {
+        for (auto& thread : m_threads)
+        {
+            thread->Start();
+        }
+
+        std::this_thread::sleep_for(duration);
+
+        for (auto& thread : m_threads)
+        {
+            thread->Stop();
+        }
+
+        // joins, after which the histograms are ours to read
+        m_threads.clear();
+
+        LatencyHistogram lateness;
+        for (const auto& histogram : m_threadLateness)
+        {
+            lateness.Merge(histogram);
+        }
+
+        return lateness;
+    }
+
+private:
+    // one per thread, so recording needs no synchronisation. outlives the threads
+    std::vector<LatencyHistogram> m_threadLateness;
+    std::vector<std::unique_ptr<LatenessThread>> m_threads;
+};
+
+inline void PrintLateness(const LatencyHistogram& lateness, std::string_view prefix = "")
+{
+    std::println(
+        "{}lateness p50:{} p99:{} p99.9:{} max:{}",
+        prefix,
+        std::chrono::duration_cast<TimeUS>(lateness.Percentile(50)),
+        std::chrono::duration_cast<TimeUS>(lateness.Percentile(99)),
+        std::chrono::duration_cast<TimeUS>(lateness.Percentile(99.9)),
+        std::chrono::duration_cast<TimeUS>(lateness.Max())
+    );
+}
+
+} // namespace Sage::Bench
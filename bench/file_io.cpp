@@ -0,0 +1,363 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "io/io_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+#include "uring/uring_registry.hpp"
+
+// Compares file throughput of blocking pread/pwrite, one op at a time, against IOThread's
+// fixed buffer ops kept queueDepth deep, over sequential writes, sequential reads and random reads.
+// Without --direct reads are mostly served from the page cache, which measures per op overhead
+// rather than the device
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    std::string m_path{ "/tmp/bench-file-io.dat" };
+    size_t m_fileSize{ 256 << 20 };
+    size_t m_blockSize{ 128 << 10 };
+    size_t m_queueDepth{ 32 };
+    bool m_direct{ false };
+    // 0 leaves the kernel's default
+    unsigned m_maxWorkers{ 0 };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "file",        required_argument, nullptr, 'f' },
+        { "size",        required_argument, nullptr, 's' },
+        { "block",       required_argument, nullptr, 'b' },
+        { "queue-depth", required_argument, nullptr, 'q' },
+        { "direct",      no_argument,       nullptr, 'D' },
+        { "max-workers", required_argument, nullptr, 'w' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --file|-f <path, created and removed>"
+                     "\n\t[optional] --size|-s <file MiB>"
+                     "\n\t[optional] --block|-b <block KiB>"
+                     "\n\t[optional] --queue-depth|-q <io_uring ops in flight>"
+                     "\n\t[optional] --direct|-D "
+                     "\n\t[optional] --max-workers|-w <io_uring kernel workers for file io>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hf:s:b:q:Dw:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'f':
+                options.m_path = optarg;
+                break;
+
+            case 's':
+                options.m_fileSize = std::stoul(optarg) << 20;
+                break;
+
+            case 'b':
+                options.m_blockSize = std::max<size_t>(std::stoul(optarg), 4) << 10;
+                break;
+
+            case 'q':
+                options.m_queueDepth = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'D':
+                options.m_direct = true;
+                break;
+
+            case 'w':
+                options.m_maxWorkers = static_cast<unsigned>(std::stoul(optarg));
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    // whole blocks only
+    options.m_fileSize = std::max(options.m_fileSize / options.m_blockSize, size_t{ 1 }) * options.m_blockSize;
+
+    return options;
+}
+
+struct PhaseResult
+{
+    TimeNS m_elapsed;
+    size_t m_ops;
+    size_t m_errors;
+};
+
+void Report(const char* phase, const char* mode, const PhaseResult& result, size_t blockSize)
+{
+    const double seconds{ std::chrono::duration<double>(result.m_elapsed).count() };
+    const double bytes{ static_cast<double>(result.m_ops * blockSize) };
+    std::println(
+        "{:<10} {:<8} {:>10.1f} MB/s {:>10.0f} ops/s errors:{}",
+        phase,
+        mode,
+        bytes / seconds / 1e6,
+        static_cast<double>(result.m_ops) / seconds,
+        result.m_errors
+    );
+}
+
+PhaseResult RunBlocking(int fd, std::span<std::byte> buffer, const std::vector<uint64_t>& offsets, bool write)
+{
+    size_t errors{ 0 };
+    const auto start{ RealClock::now() };
+    for (const auto offset : offsets)
+    {
+        const ssize_t res{ write ? pwrite(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset))
+                                 : pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset)) };
+        if (res != static_cast<ssize_t>(buffer.size()))
+        {
+            errors++;
+        }
+    }
+
+    if (write)
+    {
+        fdatasync(fd);
+    }
+
+    return PhaseResult{ .m_elapsed = RealClock::now() - start, .m_ops = offsets.size(), .m_errors = errors };
+}
+
+// Keeps one op in flight per buffer, each completion submitting the next offset from the same buffer.
+// Completions run here on the main thread, pulled off its own channel
+class URingPhase
+{
+public:
+    URingPhase(
+        IOThread& ioThread, const IOFile& file, size_t blockSize, const std::vector<uint64_t>& offsets, bool write
+    ) :
+        m_ioThread{ ioThread },
+        m_file{ file },
+        m_blockSize{ blockSize },
+        m_offsets{ offsets },
+        m_write{ write }
+    {
+    }
+
+    PhaseResult Run(std::span<const IOBuffer> buffers)
+    {
+        const auto start{ RealClock::now() };
+        for (const auto& buffer : buffers)
+        {
+            if (m_next < m_offsets.size())
+            {
+                Submit(buffer);
+            }
+        }
+
+        while (m_done < m_offsets.size())
+        {
+            CompleteEvents();
+        }
+
+        if (m_write)
+        {
+            bool synced{ false };
+            m_ioThread.Fsync(m_file, true, m_channel.tx, [&synced](int) { synced = true; });
+            while (not synced)
+            {
+                CompleteEvents();
+            }
+        }
+
+        return PhaseResult{ .m_elapsed = RealClock::now() - start, .m_ops = m_done, .m_errors = m_errors };
+    }
+
+private:
+    void CompleteEvents()
+    {
+        for (auto& event : m_channel.rx->tryReceiveMany(100ms))
+        {
+            static_cast<IOCompleteEvent&>(*event).Complete();
+        }
+    }
+
+    void Submit(const IOBuffer& buffer)
+    {
+        const uint64_t offset{ m_offsets[m_next++] };
+        auto onComplete = [this, buffer](int res)
+        {
+            m_done++;
+            if (res != static_cast<int>(m_blockSize))
+            {
+                m_errors++;
+            }
+
+            if (m_next < m_offsets.size())
+            {
+                Submit(buffer);
+            }
+        };
+
+        if (m_write)
+        {
+            m_ioThread.WriteFixed(m_file, buffer, buffer.m_data.first(m_blockSize), offset, m_channel.tx, onComplete);
+        }
+        else
+        {
+            m_ioThread.ReadFixed(m_file, buffer, buffer.m_data.first(m_blockSize), offset, m_channel.tx, onComplete);
+        }
+    }
+
+private:
+    IOThread& m_ioThread;
+    const IOFile m_file;
+    const size_t m_blockSize;
+    const std::vector<uint64_t>& m_offsets;
+    const bool m_write;
+    // completions come back here
+    Channel::ChannelPair<ThreadEvent> m_channel{ Channel::MakeChannel<ThreadEvent>() };
+    size_t m_next{ 0 };
+    size_t m_done{ 0 };
+    size_t m_errors{ 0 };
+};
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "file:{} size:{}MiB block:{}KiB queue-depth:{} direct:{} max-workers:{}",
+        options.m_path,
+        options.m_fileSize >> 20,
+        options.m_blockSize >> 10,
+        options.m_queueDepth,
+        options.m_direct,
+        options.m_maxWorkers
+    );
+
+    if (options.m_maxWorkers > 0)
+    {
+        URingRegistry::SetMaxWorkers(options.m_maxWorkers, 0);
+    }
+
+    const int fd{ open(options.m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | (options.m_direct ? O_DIRECT : 0), 0644) };
+    if (fd < 0)
+    {
+        std::println(std::cerr, "failed to open {}. {}", options.m_path, strerror(errno));
+        return 1;
+    }
+
+    const size_t nBlocks{ options.m_fileSize / options.m_blockSize };
+    std::vector<uint64_t> sequential(nBlocks);
+    std::iota(sequential.begin(), sequential.end(), 0);
+    for (auto& offset : sequential)
+    {
+        offset *= options.m_blockSize;
+    }
+
+    std::vector<uint64_t> random{ sequential };
+    std::shuffle(random.begin(), random.end(), std::mt19937_64{ 42 });
+
+    IOThread ioThread{ options.m_queueDepth, options.m_blockSize };
+    ioThread.Start();
+
+    std::vector<IOBuffer> buffers;
+    for (size_t i{ 0 }; i < options.m_queueDepth; i++)
+    {
+        if (auto buffer{ ioThread.AcquireBuffer() }; buffer.has_value())
+        {
+            std::ranges::fill(buffer->m_data, std::byte{ 0x5a });
+            buffers.push_back(*buffer);
+        }
+    }
+
+    const auto file{ ioThread.RegisterFile(fd) };
+    if (buffers.empty() or not file.has_value())
+    {
+        std::println(std::cerr, "failed to register io_uring buffers or files");
+        ioThread.Stop();
+        close(fd);
+        return 1;
+    }
+
+    // blocking ops reuse the first registered buffer, it's page aligned for O_DIRECT
+    const std::span<std::byte> blockingBuffer{ buffers.front().m_data.first(options.m_blockSize) };
+
+    auto runURing = [&](const std::vector<uint64_t>& offsets, bool write)
+    {
+        URingPhase phase{ ioThread, *file, options.m_blockSize, offsets, write };
+        return phase.Run(buffers);
+    };
+
+    // writes first, so the reads have data to read
+    Report("seq-write", "pwrite", RunBlocking(fd, blockingBuffer, sequential, true), options.m_blockSize);
+    Report("seq-write", "uring", runURing(sequential, true), options.m_blockSize);
+    Report("seq-read", "pread", RunBlocking(fd, blockingBuffer, sequential, false), options.m_blockSize);
+    Report("seq-read", "uring", runURing(sequential, false), options.m_blockSize);
+    Report("rand-read", "pread", RunBlocking(fd, blockingBuffer, random, false), options.m_blockSize);
+    Report("rand-read", "uring", runURing(random, false), options.m_blockSize);
+
+    // idle workers linger a few seconds, so this still shows what the phases needed
+    for (const auto& ring : URingRegistry::Workers())
+    {
+        std::println(
+            "ring fd:{} flags:{:#06x} workers-for:{}({}) io-wq-workers:{} rings-on-pool:{}",
+            ring.m_ringFd,
+            ring.m_setupFlags,
+            ring.m_ownerName,
+            ring.m_owner,
+            ring.m_workers,
+            ring.m_ringsOnPool
+        );
+    }
+
+    ioThread.UnregisterFile(*file);
+    for (const auto& buffer : buffers)
+    {
+        ioThread.ReleaseBuffer(buffer);
+    }
+    ioThread.Stop();
+
+    close(fd);
+    unlink(options.m_path.c_str());
+
+    return 0;
+}
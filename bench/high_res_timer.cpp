@@ -0,0 +1,224 @@
+#include <getopt.h>
+
+#include <algorithm>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "log/logger.hpp"
+#include "threading/thread.hpp"
+#include "timers/high_res_timer.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Paces one sub-millisecond periodic timer and reports how late each tick ran. Compares a cadence
+// timer from the timer threads, a Thread's high res timer delivering to the thread, and a bare
+// HighResTimer running its callback on its own thread. cpu shows what the spinning costs
+
+using namespace Sage;
+
+namespace
+{
+
+enum class Mode
+{
+    TimerThread,
+    HighRes,
+    HighResRaw
+};
+
+struct Options
+{
+    TimeUS m_period{ 200us };
+    TimeUS m_spinWindow{ std::chrono::duration_cast<TimeUS>(HighResTimer::DEFAULT_SPIN_WINDOW) };
+    TimeS m_duration{ 5s };
+    std::string m_mode{};
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "period",      required_argument, nullptr, 'p' },
+        { "spin-window", required_argument, nullptr, 'w' },
+        { "duration",    required_argument, nullptr, 'd' },
+        { "mode",        required_argument, nullptr, 'm' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --period|-p <us>"
+                     "\n\t[optional] --spin-window|-w <us>"
+                     "\n\t[optional] --duration|-d <seconds per mode>"
+                     "\n\t[optional] --mode|-m <timer-thread|high-res|high-res-raw, all if not given>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hp:w:d:m:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'p':
+                options.m_period = TimeUS{ std::max<long>(std::stol(optarg), 1) };
+                break;
+
+            case 'w':
+                options.m_spinWindow = TimeUS{ std::stol(optarg) };
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'm':
+                options.m_mode = optarg;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+// Runs one pacing timer of the given mode, counting its ticks
+class PacerThread final : public Thread
+{
+public:
+    PacerThread(
+        TimerService& timerService, Mode mode, const Options& options, LatencyHistogram& lateness, size_t& nTicks
+    ) :
+        Thread{ "PacerThread", timerService },
+        m_mode{ mode },
+        m_period{ options.m_period },
+        m_spinWindow{ options.m_spinWindow },
+        m_nTicks{ nTicks }
+    {
+        RecordTimerLateness(&lateness);
+    }
+
+protected:
+    void Starting() override
+    {
+        if (m_mode == Mode::TimerThread)
+        {
+            StartCadenceTimer("Pacer", m_period, [this](uint64_t) { m_nTicks++; });
+        }
+        else
+        {
+            StartHighResTimer("Pacer", m_period, [this] { m_nTicks++; }, m_spinWindow);
+        }
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    const Mode m_mode;
+    const TimeNS m_period;
+    const TimeNS m_spinWindow;
+    size_t& m_nTicks;
+};
+
+void RunMode(const std::string& name, Mode mode, const Options& options)
+{
+    TimerService timerService{ 1 };
+    timerService.Start();
+
+    LatencyHistogram lateness;
+    size_t nTicks{ 0 };
+    const auto usageBefore{ Bench::GetProcessUsage() };
+
+    if (mode == Mode::HighResRaw)
+    {
+        HighResTimer timer{ "Pacer",
+                            options.m_period,
+                            [&lateness, &nTicks](RealClock::time_point deadline)
+                            {
+                                lateness.Record(RealClock::now() - deadline);
+                                nTicks++;
+                            },
+                            options.m_spinWindow };
+        timer.Start();
+        std::this_thread::sleep_for(options.m_duration);
+        // joins, after which the histogram is ours to read
+        timer.Stop();
+    }
+    else
+    {
+        auto thread{ std::make_unique<PacerThread>(timerService, mode, options, lateness, nTicks) };
+        thread->Start();
+        std::this_thread::sleep_for(options.m_duration);
+        thread->Stop();
+        // joins, after which the histogram and count are ours to read
+        thread.reset();
+    }
+
+    const auto usage{ Bench::GetProcessUsage() };
+    timerService.Stop();
+
+    const double seconds{ std::chrono::duration<double>(options.m_duration).count() };
+    std::println(
+        "{:<13} ticks/s:{:.0f} context-switches:{} cpu:{}",
+        name,
+        static_cast<double>(nTicks) / seconds,
+        usage.m_contextSwitches - usageBefore.m_contextSwitches,
+        usage.m_cpuTime - usageBefore.m_cpuTime
+    );
+    Bench::PrintLateness(lateness, std::format("{:<14}", ""));
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "period:{} spin-window:{} duration:{} expected ticks/s:{:.0f}",
+        options.m_period,
+        options.m_spinWindow,
+        options.m_duration,
+        1.0 / std::chrono::duration<double>(options.m_period).count()
+    );
+
+    const std::vector<std::pair<std::string, Mode>> modes{
+        { "timer-thread", Mode::TimerThread },
+        { "high-res",     Mode::HighRes     },
+        { "high-res-raw", Mode::HighResRaw  },
+    };
+
+    for (const auto& [name, mode] : modes)
+    {
+        if (options.m_mode.empty() or options.m_mode == name)
+        {
+            RunMode(name, mode, options);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include <getopt.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <semaphore>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "threading/thread.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Two threads bouncing one event back and forth, timing each round trip. Compares channel threads,
+// reactor threads woken through their channel, and reactor threads posting straight into each
+// other's rings with IORING_OP_MSG_RING
+
+using namespace Sage;
+
+namespace
+{
+
+enum class Transport
+{
+    Channel,
+    ReactorChannel,
+    MsgRing
+};
+
+struct Options
+{
+    size_t m_roundTrips{ 100'000 };
+    std::string m_transport{};
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "round-trips", required_argument, nullptr, 'n' },
+        { "transport",   required_argument, nullptr, 't' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --round-trips|-n <round trips per transport>"
+                     "\n\t[optional] --transport|-t <channel|reactor-channel|msg-ring, all if not given>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hn:t:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'n':
+                options.m_roundTrips = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 't':
+                options.m_transport = optarg;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+// Carries when the round trip started
+class BallEvent final : public ThreadEvent
+{
+public:
+    // any receiver that isn't handled by Thread itself ends up in HandleEvent
+    explicit BallEvent(RealClock::time_point servedAt) :
+        ThreadEvent{ EventReceiver::WorkerThread },
+        m_servedAt{ servedAt }
+    {
+    }
+
+    const RealClock::time_point m_servedAt;
+};
+
+// Sends every ball it gets straight back. The server also times it and serves the next, until done
+class PlayerThread final : public Thread
+{
+public:
+    PlayerThread(
+        const std::string& name, TimerService& timerService, Transport transport, size_t nRoundTrips,
+        LatencyHistogram* latency, std::binary_semaphore* done
+    ) :
+        Thread{ name, timerService, 20ms, transport == Transport::Channel ? ThreadMode::Channel : ThreadMode::Reactor },
+        m_transport{ transport },
+        m_nRoundTrips{ nRoundTrips },
+        m_latency{ latency },
+        m_done{ done }
+    {
+    }
+
+    void SetPeer(PlayerThread& peer) noexcept { m_peer = &peer; }
+
+    void Serve() { TransmitEvent(std::make_unique<BallEvent>(RealClock::now())); }
+
+protected:
+    void HandleEvent(UniqueThreadEvent event) override
+    {
+        const auto servedAt{ static_cast<const BallEvent&>(*event).m_servedAt };
+
+        // the receiving side
+        if (m_latency == nullptr)
+        {
+            Send(std::move(event));
+            return;
+        }
+
+        // the first ball is served by main, and only starts the rally
+        if (m_nReturned++ > 0)
+        {
+            m_latency->Record(RealClock::now() - servedAt);
+        }
+
+        if (m_nReturned > m_nRoundTrips)
+        {
+            m_done->release();
+            return;
+        }
+
+        Send(std::make_unique<BallEvent>(RealClock::now()));
+    }
+
+private:
+    void Send(UniqueThreadEvent event)
+    {
+        if (m_transport == Transport::MsgRing)
+        {
+            TransmitEventDirect(*m_peer, std::move(event));
+        }
+        else
+        {
+            m_peer->TransmitEvent(std::move(event));
+        }
+    }
+
+private:
+    const Transport m_transport;
+    const size_t m_nRoundTrips;
+    // only set on the server
+    LatencyHistogram* const m_latency;
+    std::binary_semaphore* const m_done;
+    PlayerThread* m_peer{ nullptr };
+    size_t m_nReturned{ 0 };
+};
+
+void RunTransport(const std::string& name, Transport transport, const Options& options)
+{
+    TimerService timerService{ 1 };
+    timerService.Start();
+
+    LatencyHistogram latency;
+    std::binary_semaphore done{ 0 };
+    PlayerThread server{ "Server", timerService, transport, options.m_roundTrips, &latency, &done };
+    PlayerThread receiver{ "Receiver", timerService, transport, options.m_roundTrips, nullptr, nullptr };
+    server.SetPeer(receiver);
+    receiver.SetPeer(server);
+
+    server.Start();
+    receiver.Start();
+
+    const auto start{ RealClock::now() };
+    server.Serve();
+    done.acquire();
+    const auto elapsed{ RealClock::now() - start };
+
+    server.Stop();
+    receiver.Stop();
+
+    const double seconds{ std::chrono::duration<double>(elapsed).count() };
+    std::println(
+        "{:<16} round-trips/s:{:.0f} p50:{} p99:{} p99.9:{} max:{}",
+        name,
+        static_cast<double>(options.m_roundTrips) / seconds,
+        latency.Percentile(50),
+        latency.Percentile(99),
+        latency.Percentile(99.9),
+        latency.Max()
+    );
+
+    timerService.Stop();
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println("round-trips:{}", options.m_roundTrips);
+
+    const std::vector<std::pair<std::string, Transport>> transports{
+        { "channel",         Transport::Channel        },
+        { "reactor-channel", Transport::ReactorChannel },
+        { "msg-ring",        Transport::MsgRing        },
+    };
+
+    for (const auto& [name, transport] : transports)
+    {
+        if (options.m_transport.empty() or options.m_transport == name)
+        {
+            RunTransport(name, transport, options);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <print>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "io/io_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "threading/thread.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+#include "uring/io_uring.hpp"
+
+// One thread taking a steady stream of events while keeping reads in flight. A channel thread hands
+// its reads to an IOThread and gets completions back as events, a reactor thread queues them on its own ring.
+// Reports event latency, reads per second and context switches for each
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    TimeS m_duration{ 5s };
+    size_t m_eventRate{ 10'000 };
+    size_t m_queueDepth{ 32 };
+    size_t m_blockSize{ 4 << 10 };
+    std::string m_mode{};
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",     no_argument,       nullptr, 'h' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "rate",     required_argument, nullptr, 'r' },
+        { "depth",    required_argument, nullptr, 'q' },
+        { "block",    required_argument, nullptr, 'b' },
+        { "mode",     required_argument, nullptr, 'm' },
+        { 0,          0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --duration|-d <seconds per mode>"
+                     "\n\t[optional] --rate|-r <events per second>"
+                     "\n\t[optional] --depth|-q <reads in flight>"
+                     "\n\t[optional] --block|-b <KiB per read>"
+                     "\n\t[optional] --mode|-m <channel|reactor, both if not given>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hd:r:q:b:m:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'r':
+                options.m_eventRate = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'q':
+                options.m_queueDepth = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'b':
+                options.m_blockSize = std::max<size_t>(std::stoul(optarg), 1) << 10;
+                break;
+
+            case 'm':
+                options.m_mode = optarg;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+// Carries when it was sent
+class StampEvent final : public ThreadEvent
+{
+public:
+    // any receiver that isn't handled by Thread itself ends up in HandleEvent
+    StampEvent() : ThreadEvent{ EventReceiver::WorkerThread } {}
+
+    const RealClock::time_point m_sentAt{ RealClock::now() };
+};
+
+// Keeps depth reads of /dev/zero in flight, each completion queueing the next
+class MixedThread final : public Thread
+{
+public:
+    MixedThread(
+        TimerService& timerService, ThreadMode mode, IOThread* ioThread, int fd, size_t depth, size_t blockSize,
+        LatencyHistogram& latency, size_t& nReads
+    ) :
+        Thread{ "MixedThread", timerService, 20ms, mode },
+        m_ioThread{ ioThread },
+        m_fd{ fd },
+        m_latency{ latency },
+        m_nReads{ nReads },
+        m_buffers(depth, std::vector<std::byte>(blockSize))
+    {
+    }
+
+protected:
+    void Starting() override
+    {
+        for (auto& buffer : m_buffers)
+        {
+            Read(buffer);
+        }
+    }
+
+    void HandleEvent(UniqueThreadEvent event) override
+    {
+        m_latency.Record(RealClock::now() - static_cast<StampEvent&>(*event).m_sentAt);
+    }
+
+private:
+    void Read(std::span<std::byte> buffer)
+    {
+        auto onComplete = [this, buffer](int res)
+        {
+            if (res < 0)
+            {
+                return;
+            }
+
+            m_nReads++;
+            Read(buffer);
+        };
+
+        if (m_ioThread != nullptr)
+        {
+            m_ioThread->Read(IOFile{ .m_fd = m_fd }, buffer, 0, Tx(), onComplete);
+            return;
+        }
+
+        QueueIO([this, buffer](IOURing& ring, IOURing::UserData data)
+                { return ring.QueueRead(data, m_fd, buffer, 0); },
+                onComplete);
+    }
+
+private:
+    IOThread* const m_ioThread;
+    const int m_fd;
+    LatencyHistogram& m_latency;
+    size_t& m_nReads;
+    std::vector<std::vector<std::byte>> m_buffers;
+};
+
+void RunMode(const std::string& name, ThreadMode mode, const Options& options, int fd)
+{
+    TimerService timerService{};
+    timerService.Start();
+
+    // only the channel thread needs one
+    std::optional<IOThread> ioThread;
+    if (mode == ThreadMode::Channel)
+    {
+        ioThread.emplace();
+        ioThread->Start();
+    }
+
+    LatencyHistogram latency;
+    size_t nReads{ 0 };
+    auto thread{ std::make_unique<MixedThread>(
+        timerService,
+        mode,
+        ioThread.has_value() ? &*ioThread : nullptr,
+        fd,
+        options.m_queueDepth,
+        options.m_blockSize,
+        latency,
+        nReads
+    ) };
+
+    const long switchesBefore{ Bench::GetProcessUsage().m_contextSwitches };
+    thread->Start();
+
+    // paced against the schedule, not the last send, so the rate holds
+    const TimeNS interval{ TimeNS{ 1s } / options.m_eventRate };
+    const auto start{ RealClock::now() };
+    const auto end{ start + options.m_duration };
+    size_t nEvents{ 0 };
+    for (auto next{ start }; next < end; next += interval)
+    {
+        std::this_thread::sleep_until(next);
+        thread->TransmitEvent(std::make_unique<StampEvent>());
+        nEvents++;
+    }
+
+    thread->Stop();
+    // reads still in flight on the io thread land in the thread's buffers, so it goes first
+    if (ioThread.has_value())
+    {
+        ioThread->Stop();
+    }
+    // joins, after which the histogram and count are ours to read
+    thread.reset();
+
+    const long switches{ Bench::GetProcessUsage().m_contextSwitches - switchesBefore };
+    timerService.Stop();
+
+    const double seconds{ std::chrono::duration<double>(options.m_duration).count() };
+    std::println(
+        "{:<8} events:{} latency p50:{} p99:{} max:{} reads/s:{:.0f} context-switches:{}",
+        name,
+        nEvents,
+        std::chrono::duration_cast<TimeUS>(latency.Percentile(50)),
+        std::chrono::duration_cast<TimeUS>(latency.Percentile(99)),
+        std::chrono::duration_cast<TimeUS>(latency.Max()),
+        static_cast<double>(nReads) / seconds,
+        switches
+    );
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "duration:{} event-rate:{}/s depth:{} block:{}KiB",
+        options.m_duration,
+        options.m_eventRate,
+        options.m_queueDepth,
+        options.m_blockSize >> 10
+    );
+
+    const int fd{ open("/dev/zero", O_RDONLY | O_CLOEXEC) };
+    if (fd < 0)
+    {
+        std::println(std::cerr, "failed to open /dev/zero. {}", strerror(errno));
+        return 1;
+    }
+
+    for (const auto& [name, mode] : { std::pair{ "channel", ThreadMode::Channel },
+                                      std::pair{ "reactor", ThreadMode::Reactor } })
+    {
+        if (options.m_mode.empty() or options.m_mode == name)
+        {
+            RunMode(name, mode, options, fd);
+        }
+    }
+
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,379 @@
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <print>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "threading/pooled_event.hpp"
+#include "threading/request_reply.hpp"
+#include "threading/thread.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Keeps a window of requests in flight from one thread to another through a ReplySlotPool, half of them
+// with callbacks and half co_await'ed. The responder holds on to every k-th request so its timeout fires.
+// Exits non zero unless every request completed exactly once, with the expected number timed out
+
+namespace
+{
+
+// every heap allocation in the process, to show what a request costs
+std::atomic<size_t> g_nAllocs{ 0 };
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr{ std::malloc(size > 0 ? size : 1) }; ptr != nullptr)
+    {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_requests{ 200'000 };
+    size_t m_window{ 32 };
+    size_t m_holdEvery{ 1000 };
+    TimeMS m_timeout{ 50ms };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",       no_argument,       nullptr, 'h' },
+        { "requests",   required_argument, nullptr, 'n' },
+        { "window",     required_argument, nullptr, 'w' },
+        { "hold-every", required_argument, nullptr, 'k' },
+        { "timeout",    required_argument, nullptr, 't' },
+        { 0,            0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --requests|-n <requests in total>"
+                     "\n\t[optional] --window|-w <requests in flight, at most 64>"
+                     "\n\t[optional] --hold-every|-k <requests between ones left to time out, 0 for none>"
+                     "\n\t[optional] --timeout|-t <request timeout ms>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hn:w:k:t:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'n':
+                options.m_requests = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'w':
+                options.m_window = std::clamp<size_t>(std::stoul(optarg), 2, 64);
+                break;
+
+            case 'k':
+                options.m_holdEvery = std::stoul(optarg);
+                break;
+
+            case 't':
+                options.m_timeout = TimeMS{ std::max<long>(std::stol(optarg), 1) };
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+// Echoes back when it was sent
+class EchoRequest final : public RequestEvent<RealClock::time_point>, public PooledEvent<EchoRequest>
+{
+public:
+    // any receiver that isn't handled by Thread itself ends up in HandleEvent
+    explicit EchoRequest(RealClock::time_point sentAt) :
+        RequestEvent<RealClock::time_point>{ EventReceiver::WorkerThread },
+        m_sentAt{ sentAt }
+    {
+    }
+
+    const RealClock::time_point m_sentAt;
+};
+
+// Replies to everything, except every holdEvery-th request which it keeps until it stops
+class Responder final : public Thread
+{
+public:
+    Responder(TimerService& timerService, size_t holdEvery, size_t maxHeld) :
+        Thread{ "Responder", timerService },
+        m_holdEvery{ holdEvery }
+    {
+        m_held.reserve(maxHeld);
+    }
+
+protected:
+    void HandleEvent(UniqueThreadEvent event) override
+    {
+        auto& request{ static_cast<EchoRequest&>(*event) };
+        m_nReceived++;
+        if (m_holdEvery > 0 and m_nReceived % m_holdEvery == 0)
+        {
+            m_held.emplace_back(std::move(event));
+            return;
+        }
+
+        request.Reply(request.m_sentAt);
+    }
+
+    // every held request has timed out by now, so these late drops are ignored by the pool
+    void Stopping() override { m_held.clear(); }
+
+private:
+    const size_t m_holdEvery;
+    size_t m_nReceived{ 0 };
+    std::vector<UniqueThreadEvent> m_held{};
+};
+
+struct Results
+{
+    LatencyHistogram m_latency{};
+    size_t m_replies{ 0 };
+    size_t m_timedOut{ 0 };
+    size_t m_dropped{ 0 };
+    size_t m_exhausted{ 0 };
+};
+
+// Keeps the window full until every request has been sent, then signals once they have all completed
+class Requester final : public Thread
+{
+public:
+    using Pool = ReplySlotPool<RealClock::time_point, 64>;
+
+    Requester(
+        TimerService& timerService, Thread& responder, const Options& options, Results& results,
+        std::binary_semaphore& done
+    ) :
+        Thread{ "Requester", timerService },
+        m_responder{ responder },
+        m_nRequests{ options.m_requests },
+        m_window{ options.m_window },
+        m_timeout{ options.m_timeout },
+        m_results{ results },
+        m_done{ done }
+    {
+    }
+
+protected:
+    void Starting() override
+    {
+        for (size_t i{ 0 }; i < m_window; i++)
+        {
+            if (i % 2 == 0)
+            {
+                SendNext();
+            }
+            else
+            {
+                AwaitLoop();
+            }
+        }
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    void SendNext()
+    {
+        if (m_nSent == m_nRequests)
+        {
+            return;
+        }
+
+        m_nSent++;
+        const bool sent{ m_pool.Request(
+            m_responder,
+            std::make_unique<EchoRequest>(RealClock::now()),
+            m_timeout,
+            [this](Pool::Result result)
+            {
+                OnResult(result);
+                SendNext();
+            }
+        ) };
+
+        if (not sent)
+        {
+            OnResult(std::unexpected(ReplyError::PoolExhausted));
+        }
+    }
+
+    DetachedTask AwaitLoop()
+    {
+        while (m_nSent < m_nRequests)
+        {
+            m_nSent++;
+            auto request{ std::make_unique<EchoRequest>(RealClock::now()) };
+            OnResult(co_await m_pool.RequestAsync(m_responder, std::move(request), m_timeout));
+        }
+    }
+
+    void OnResult(const Pool::Result& result)
+    {
+        if (result.has_value())
+        {
+            m_results.m_latency.Record(RealClock::now() - *result);
+            m_results.m_replies++;
+        }
+        else
+        {
+            switch (result.error())
+            {
+                case ReplyError::TimedOut:
+                    m_results.m_timedOut++;
+                    break;
+                case ReplyError::Dropped:
+                    m_results.m_dropped++;
+                    break;
+                case ReplyError::PoolExhausted:
+                    m_results.m_exhausted++;
+                    break;
+            }
+        }
+
+        if (++m_nCompleted == m_nRequests)
+        {
+            m_done.release();
+        }
+    }
+
+private:
+    Thread& m_responder;
+    const size_t m_nRequests;
+    const size_t m_window;
+    const TimeMS m_timeout;
+    Results& m_results;
+    std::binary_semaphore& m_done;
+    size_t m_nSent{ 0 };
+    size_t m_nCompleted{ 0 };
+    Pool m_pool{ *this };
+};
+
+// Members of a thread are torn down before its loop is joined, so let the loop finish first
+void StopAndWait(Thread& thread)
+{
+    thread.Stop();
+    while (thread.IsRunning())
+    {
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "requests:{} window:{} hold-every:{} timeout:{}",
+        options.m_requests,
+        options.m_window,
+        options.m_holdEvery,
+        options.m_timeout
+    );
+
+    TimerService timerService{ 1 };
+    timerService.Start();
+
+    const size_t expectHeld{ options.m_holdEvery > 0 ? options.m_requests / options.m_holdEvery : 0 };
+    Results results{};
+    std::binary_semaphore done{ 0 };
+    auto responder{ std::make_unique<Responder>(timerService, options.m_holdEvery, expectHeld) };
+    auto requester{ std::make_unique<Requester>(timerService, *responder, options, results, done) };
+
+    responder->Start();
+    // give both loops a moment to come up, so their setup isn't counted
+    std::this_thread::sleep_for(10ms);
+
+    const size_t allocsBefore{ g_nAllocs.load(std::memory_order_relaxed) };
+    const auto start{ RealClock::now() };
+    requester->Start();
+
+    // every held request costs one timeout, most of them overlapping
+    const auto deadline{ 10s + (options.m_timeout * static_cast<TimeMS::rep>(expectHeld + 1)) };
+    const bool finished{ done.try_acquire_for(deadline) };
+    const auto elapsed{ RealClock::now() - start };
+    const size_t allocs{ g_nAllocs.load(std::memory_order_relaxed) - allocsBefore };
+
+    // the responder goes first, its held requests still point into the requester's pool
+    StopAndWait(*responder);
+    StopAndWait(*requester);
+    responder.reset();
+    requester.reset();
+    timerService.Stop();
+
+    const double seconds{ std::chrono::duration<double>(elapsed).count() };
+    std::println(
+        "requests/s:{:.0f} p50:{} p99:{} p99.9:{} max:{} allocs/request:{:.2f}",
+        static_cast<double>(options.m_requests) / seconds,
+        results.m_latency.Percentile(50),
+        results.m_latency.Percentile(99),
+        results.m_latency.Percentile(99.9),
+        results.m_latency.Max(),
+        static_cast<double>(allocs) / static_cast<double>(options.m_requests)
+    );
+
+    const size_t completed{ results.m_replies + results.m_timedOut + results.m_dropped + results.m_exhausted };
+    const bool pass{ finished and completed == options.m_requests and results.m_timedOut == expectHeld and
+                     results.m_dropped == 0 and results.m_exhausted == 0 };
+    std::println(
+        "replies:{} timed-out:{} dropped:{} pool-exhausted:{} expected-timeouts:{} {}",
+        results.m_replies,
+        results.m_timedOut,
+        results.m_dropped,
+        results.m_exhausted,
+        expectHeld,
+        pass ? "ok" : "FAILED"
+    );
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,446 @@
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "io/socket_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/thread.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Echo server and clients over loopback TCP, all on the socket thread's ring. Clients connect
+// all at once, then each connection keeps one message in flight, timing it until its echo is back.
+// Reports connections per second, messages per second and round trip latency
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_connections{ 64 };
+    size_t m_clients{ 2 };
+    size_t m_messageSize{ 64 };
+    TimeS m_duration{ 5s };
+    bool m_zeroCopy{ false };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "connections", required_argument, nullptr, 'c' },
+        { "clients",     required_argument, nullptr, 'n' },
+        { "message",     required_argument, nullptr, 'm' },
+        { "duration",    required_argument, nullptr, 'd' },
+        { "zero-copy",   no_argument,       nullptr, 'z' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --connections|-c <connections, over all clients>"
+                     "\n\t[optional] --clients|-n <client threads>"
+                     "\n\t[optional] --message|-m <message bytes>"
+                     "\n\t[optional] --duration|-d <seconds>"
+                     "\n\t[optional] --zero-copy|-z "
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hc:n:m:d:z", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'c':
+                options.m_connections = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'n':
+                options.m_clients = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'm':
+                options.m_messageSize = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'z':
+                options.m_zeroCopy = true;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    options.m_clients = std::min(options.m_clients, options.m_connections);
+
+    return options;
+}
+
+void Send(Connection& connection, std::vector<std::byte> data, bool zeroCopy)
+{
+    if (zeroCopy)
+    {
+        connection.SendZeroCopy(std::move(data));
+    }
+    else
+    {
+        connection.Send(std::move(data));
+    }
+}
+
+// Sends back whatever each connection receives
+class EchoServer final : public Thread
+{
+public:
+    EchoServer(TimerService& timerService, SocketThread& socketThread, int listenFd, bool zeroCopy) :
+        Thread{ "EchoServer", timerService },
+        m_socketThread{ socketThread },
+        m_listenFd{ listenFd },
+        m_zeroCopy{ zeroCopy }
+    {
+    }
+
+protected:
+    void Starting() override
+    {
+        m_listener = std::make_unique<Listener>(m_socketThread, m_listenFd, Tx());
+        m_listener->Start([this](int fd) { OnAccepted(fd); });
+    }
+
+    void Stopping() override
+    {
+        m_connections.clear();
+        m_listener.reset();
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    void OnAccepted(int fd)
+    {
+        if (fd < 0)
+        {
+            LOG_ERROR("accept failed. {}", strerror(-fd));
+            return;
+        }
+
+        auto connection{ std::make_unique<Connection>(m_socketThread, fd, Tx()) };
+        Connection* raw{ connection.get() };
+        raw->StartReceiving(
+            [this, raw](int res, std::span<const std::byte> data)
+            {
+                if (res <= 0)
+                {
+                    m_connections.erase(raw);
+                    return;
+                }
+
+                Send(*raw, { data.begin(), data.end() }, m_zeroCopy);
+            }
+        );
+        m_connections.emplace(raw, std::move(connection));
+    }
+
+private:
+    SocketThread& m_socketThread;
+    const int m_listenFd;
+    const bool m_zeroCopy;
+    std::unique_ptr<Listener> m_listener{ nullptr };
+    std::unordered_map<Connection*, std::unique_ptr<Connection>> m_connections;
+};
+
+struct ClientResult
+{
+    LatencyHistogram m_latency{};
+    size_t m_connected{ 0 };
+    size_t m_failed{ 0 };
+    TimeNS m_connectTime{ 0 };
+    TimeNS m_echoTime{ 0 };
+};
+
+// Connects all of its connections at once, then keeps one message in flight on each
+class EchoClient final : public Thread
+{
+public:
+    EchoClient(
+        const std::string& name, TimerService& timerService, SocketThread& socketThread, const sockaddr_in& server,
+        size_t nConnections, size_t messageSize, bool zeroCopy, ClientResult& result
+    ) :
+        Thread{ name, timerService },
+        m_socketThread{ socketThread },
+        m_server{ server },
+        m_nConnections{ nConnections },
+        m_messageSize{ messageSize },
+        m_zeroCopy{ zeroCopy },
+        m_result{ result }
+    {
+    }
+
+protected:
+    void Starting() override
+    {
+        m_connectStart = RealClock::now();
+        for (size_t i{ 0 }; i < m_nConnections; i++)
+        {
+            const int fd{ socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+            if (fd < 0)
+            {
+                OnConnected(fd, -errno);
+                continue;
+            }
+
+            const int noDelay{ 1 };
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            m_socketThread.Connect(
+                fd,
+                reinterpret_cast<const sockaddr*>(&m_server),
+                sizeof(m_server),
+                Tx(),
+                [this, fd](int res) { OnConnected(fd, res); }
+            );
+        }
+    }
+
+    void Stopping() override
+    {
+        if (m_echoStart != RealClock::time_point{})
+        {
+            m_result.m_echoTime = RealClock::now() - m_echoStart;
+        }
+        m_connections.clear();
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    struct ClientConnection
+    {
+        std::unique_ptr<Connection> m_connection;
+        RealClock::time_point m_sentAt{};
+        size_t m_received{ 0 };
+    };
+
+    void OnConnected(int fd, int res)
+    {
+        if (res < 0)
+        {
+            LOG_ERROR("connect failed. {}", strerror(-res));
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            m_result.m_failed++;
+        }
+        else
+        {
+            auto& client{ m_connections.emplace_back(std::make_unique<ClientConnection>()) };
+            client->m_connection = std::make_unique<Connection>(m_socketThread, fd, Tx());
+            ClientConnection* raw{ client.get() };
+            client->m_connection->StartReceiving([this, raw](int res, std::span<const std::byte> data)
+                                                 { OnReceived(*raw, res, data.size()); });
+            m_result.m_connected++;
+        }
+
+        if (m_result.m_connected + m_result.m_failed < m_nConnections)
+        {
+            return;
+        }
+
+        // every connection is up, start echoing on all of them together
+        m_echoStart = RealClock::now();
+        m_result.m_connectTime = m_echoStart - m_connectStart;
+        for (auto& client : m_connections)
+        {
+            SendMessage(*client);
+        }
+    }
+
+    void OnReceived(ClientConnection& client, int res, size_t nBytes)
+    {
+        if (res <= 0)
+        {
+            client.m_connection->Close();
+            return;
+        }
+
+        // a message may arrive over several receives
+        client.m_received += nBytes;
+        if (client.m_received < m_messageSize)
+        {
+            return;
+        }
+
+        m_result.m_latency.Record(RealClock::now() - client.m_sentAt);
+        client.m_received -= m_messageSize;
+        SendMessage(client);
+    }
+
+    void SendMessage(ClientConnection& client)
+    {
+        client.m_sentAt = RealClock::now();
+        Send(*client.m_connection, std::vector<std::byte>(m_messageSize, std::byte{ 0x2a }), m_zeroCopy);
+    }
+
+private:
+    SocketThread& m_socketThread;
+    const sockaddr_in m_server;
+    const size_t m_nConnections;
+    const size_t m_messageSize;
+    const bool m_zeroCopy;
+    ClientResult& m_result;
+    std::vector<std::unique_ptr<ClientConnection>> m_connections;
+    RealClock::time_point m_connectStart{};
+    RealClock::time_point m_echoStart{};
+};
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "connections:{} clients:{} message:{}B duration:{} zero-copy:{}",
+        options.m_connections,
+        options.m_clients,
+        options.m_messageSize,
+        options.m_duration,
+        options.m_zeroCopy
+    );
+
+    // any free port on loopback
+    const int listenFd{ socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0) };
+    sockaddr_in server{ .sin_family = AF_INET, .sin_port = 0, .sin_addr = { htonl(INADDR_LOOPBACK) }, .sin_zero = {} };
+    socklen_t serverLen{ sizeof(server) };
+    if (listenFd < 0 or bind(listenFd, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0 or
+        listen(listenFd, SOMAXCONN) != 0 or
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&server), &serverLen) != 0)
+    {
+        std::println(std::cerr, "failed to listen on loopback. {}", strerror(errno));
+        return 1;
+    }
+
+    TimerService timerService{ 1 };
+    timerService.Start();
+
+    SocketThread socketThread;
+    socketThread.Start();
+
+    auto echoServer{ std::make_unique<EchoServer>(timerService, socketThread, listenFd, options.m_zeroCopy) };
+    echoServer->Start();
+
+    // one per client, so recording needs no synchronisation
+    std::vector<ClientResult> results(options.m_clients);
+    std::vector<std::unique_ptr<EchoClient>> clients;
+    for (size_t i{ 0 }; i < options.m_clients; i++)
+    {
+        // spread the remainder over the first few clients
+        const size_t nConnections{ (options.m_connections / options.m_clients) +
+                                   (i < options.m_connections % options.m_clients ? 1 : 0) };
+        clients.emplace_back(std::make_unique<EchoClient>(
+            std::format("EchoClient-{}", i),
+            timerService,
+            socketThread,
+            server,
+            nConnections,
+            options.m_messageSize,
+            options.m_zeroCopy,
+            results[i]
+        ));
+    }
+
+    for (auto& client : clients)
+    {
+        client->Start();
+    }
+
+    std::this_thread::sleep_for(options.m_duration);
+
+    for (auto& client : clients)
+    {
+        client->Stop();
+    }
+
+    // joins, after which the results are ours to read
+    clients.clear();
+
+    echoServer->Stop();
+    echoServer.reset();
+
+    socketThread.Stop();
+    timerService.Stop();
+
+    LatencyHistogram latency;
+    size_t connected{ 0 };
+    size_t failed{ 0 };
+    TimeNS connectTime{ 0 };
+    double messagesPerSecond{ 0 };
+    for (const auto& result : results)
+    {
+        latency.Merge(result.m_latency);
+        connected += result.m_connected;
+        failed += result.m_failed;
+        connectTime = std::max(connectTime, result.m_connectTime);
+        if (result.m_echoTime > 0ns)
+        {
+            messagesPerSecond += static_cast<double>(result.m_latency.Count()) /
+                                 std::chrono::duration<double>(result.m_echoTime).count();
+        }
+    }
+
+    std::println(
+        "connected:{} failed:{} connections/s:{:.0f}",
+        connected,
+        failed,
+        connectTime > 0ns ? static_cast<double>(connected) / std::chrono::duration<double>(connectTime).count() : 0.0
+    );
+    std::println("messages:{} messages/s:{:.0f}", latency.Count(), messagesPerSecond);
+    std::println(
+        "round trip p50:{} p99:{} p99.9:{} max:{}",
+        std::chrono::duration_cast<TimeUS>(latency.Percentile(50)),
+        std::chrono::duration_cast<TimeUS>(latency.Percentile(99)),
+        std::chrono::duration_cast<TimeUS>(latency.Percentile(99.9)),
+        std::chrono::duration_cast<TimeUS>(latency.Max())
+    );
+
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <print>
+#include <string>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "io/splice_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+
+// Copies one file to another, and optionally a second through tee, with a pread/pwrite loop and then
+// with SpliceThread, which never brings the data into user space. Meant for tmpfs paths, so the
+// copy itself is measured rather than a device
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    std::string m_dir{ "/dev/shm" };
+    size_t m_fileSize{ size_t{ 2 } << 30 };
+    size_t m_chunkSize{ SpliceThread::DEFAULT_CHUNK_SIZE };
+    size_t m_depth{ SpliceThread::DEFAULT_DEPTH };
+    bool m_tee{ false };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",  no_argument,       nullptr, 'h' },
+        { "dir",   required_argument, nullptr, 'f' },
+        { "size",  required_argument, nullptr, 's' },
+        { "chunk", required_argument, nullptr, 'c' },
+        { "depth", required_argument, nullptr, 'q' },
+        { "tee",   no_argument,       nullptr, 't' },
+        { 0,       0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --dir|-f <directory the files are created and removed in>"
+                     "\n\t[optional] --size|-s <file GiB>"
+                     "\n\t[optional] --chunk|-c <KiB per chunk, and per read/write>"
+                     "\n\t[optional] --depth|-q <chunks in flight>"
+                     "\n\t[optional] --tee|-t <also copy to a second file>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hf:s:c:q:t", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'f':
+                options.m_dir = optarg;
+                break;
+
+            case 's':
+                options.m_fileSize = std::max<size_t>(std::stoul(optarg), 1) << 30;
+                break;
+
+            case 'c':
+                options.m_chunkSize = std::max<size_t>(std::stoul(optarg), 4) << 10;
+                break;
+
+            case 'q':
+                options.m_depth = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 't':
+                options.m_tee = true;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+struct CopyResult
+{
+    TimeNS m_elapsed;
+    uint64_t m_bytes;
+    int m_error;
+};
+
+void Report(const char* mode, const CopyResult& result, int out, int teeOut, uint64_t expected)
+{
+    // what actually landed, not only what the copy claims
+    auto sizeOf = [](int fd)
+    {
+        struct stat st{};
+        return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+    };
+
+    const bool verified{ sizeOf(out) == expected and (teeOut < 0 or sizeOf(teeOut) == expected) };
+    const double seconds{ std::chrono::duration<double>(result.m_elapsed).count() };
+    std::println(
+        "{:<10} {:>8.2f} GB/s elapsed:{} bytes:{} error:{} verified:{}",
+        mode,
+        static_cast<double>(result.m_bytes) / seconds / 1e9,
+        std::chrono::duration_cast<TimeMS>(result.m_elapsed),
+        result.m_bytes,
+        result.m_error == 0 ? "none" : strerror(-result.m_error),
+        verified
+    );
+}
+
+bool CreateSource(int fd, size_t fileSize, size_t blockSize)
+{
+    std::vector<char> block(blockSize);
+    for (size_t i{ 0 }; i < blockSize; i++)
+    {
+        block[i] = static_cast<char>('a' + (i % 26));
+    }
+
+    for (size_t offset{ 0 }; offset < fileSize; offset += blockSize)
+    {
+        const size_t len{ std::min(blockSize, fileSize - offset) };
+        if (pwrite(fd, block.data(), len, static_cast<off_t>(offset)) != static_cast<ssize_t>(len))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+CopyResult RunReadWrite(int in, int out, int teeOut, size_t fileSize, size_t blockSize)
+{
+    std::vector<char> buffer(blockSize);
+    uint64_t bytes{ 0 };
+    int error{ 0 };
+
+    const auto start{ RealClock::now() };
+    while (bytes < fileSize and error == 0)
+    {
+        const size_t want{ std::min(blockSize, fileSize - bytes) };
+        const ssize_t nRead{ pread(in, buffer.data(), want, static_cast<off_t>(bytes)) };
+        if (nRead <= 0)
+        {
+            error = nRead < 0 ? -errno : 0;
+            break;
+        }
+
+        const auto len{ static_cast<size_t>(nRead) };
+        for (const int fd : { out, teeOut })
+        {
+            if (fd >= 0 and pwrite(fd, buffer.data(), len, static_cast<off_t>(bytes)) != nRead)
+            {
+                error = -EIO;
+            }
+        }
+
+        bytes += len;
+    }
+
+    return CopyResult{ .m_elapsed = RealClock::now() - start, .m_bytes = bytes, .m_error = error };
+}
+
+// Progress comes back on main's own channel, as in a Thread
+CopyResult RunSplice(SpliceThread& spliceThread, int in, int out, int teeOut, size_t fileSize)
+{
+    auto channel{ Channel::MakeChannel<ThreadEvent>() };
+    SpliceProgress last{};
+    size_t nReports{ 0 };
+
+    const auto start{ RealClock::now() };
+    spliceThread.Copy(SpliceRequest{ .m_in = in,
+                                     .m_out = out,
+                                     .m_teeOut = teeOut,
+                                     .m_length = fileSize,
+                                     .m_replyTo = channel.tx,
+                                     .m_cb =
+                                         [&last, &nReports](const SpliceProgress& progress)
+                                     {
+                                         last = progress;
+                                         nReports++;
+                                     } });
+
+    while (not last.m_finished)
+    {
+        for (auto& event : channel.rx->tryReceiveMany(100ms))
+        {
+            static_cast<IOCompleteEvent&>(*event).Complete();
+        }
+    }
+    const auto elapsed{ RealClock::now() - start };
+
+    std::println("splice progress reports:{}", nReports);
+
+    return CopyResult{ .m_elapsed = elapsed, .m_bytes = last.m_bytes, .m_error = last.m_error };
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    SpliceThread spliceThread{ options.m_depth, options.m_chunkSize };
+    spliceThread.Start();
+
+    std::println(
+        "dir:{} size:{}GiB chunk:{}KiB depth:{} tee:{}",
+        options.m_dir,
+        options.m_fileSize >> 30,
+        spliceThread.ChunkSize() >> 10,
+        options.m_depth,
+        options.m_tee
+    );
+
+    const std::string srcPath{ options.m_dir + "/bench-splice-src.dat" };
+    const std::string dstPath{ options.m_dir + "/bench-splice-dst.dat" };
+    const std::string teePath{ options.m_dir + "/bench-splice-tee.dat" };
+
+    const int in{ open(srcPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+    if (in < 0 or not CreateSource(in, options.m_fileSize, spliceThread.ChunkSize()))
+    {
+        std::println(std::cerr, "failed to create {}. {}", srcPath, strerror(errno));
+        spliceThread.Stop();
+        return 1;
+    }
+
+    // a fresh output each run, so nothing is overwritten in place
+    auto openOutput = [](const std::string& path, bool wanted)
+    { return wanted ? open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1; };
+
+    {
+        const int out{ openOutput(dstPath, true) };
+        const int teeOut{ openOutput(teePath, options.m_tee) };
+        const auto result{ RunReadWrite(in, out, teeOut, options.m_fileSize, spliceThread.ChunkSize()) };
+        Report("read/write", result, out, teeOut, options.m_fileSize);
+        close(out);
+        if (teeOut >= 0)
+        {
+            close(teeOut);
+        }
+    }
+
+    {
+        const int out{ openOutput(dstPath, true) };
+        const int teeOut{ openOutput(teePath, options.m_tee) };
+        const auto result{ RunSplice(spliceThread, in, out, teeOut, options.m_fileSize) };
+        Report("splice", result, out, teeOut, options.m_fileSize);
+        close(out);
+        if (teeOut >= 0)
+        {
+            close(teeOut);
+        }
+    }
+
+    spliceThread.Stop();
+
+    close(in);
+    unlink(srcPath.c_str());
+    unlink(dstPath.c_str());
+    unlink(teePath.c_str());
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <getopt.h>
+
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "log/logger.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_thread.hpp"
+
+// Churns updates and cancels across a large set of live timers and times how long the
+// timer thread takes to work through them. Timers are armed far out so none fire.
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_timers{ 100'000 };
+    size_t m_ops{ 1'000'000 };
+    TimerBackend m_backend{ TimerBackend::URing };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "timers",      required_argument, nullptr, 't' },
+        { "ops",         required_argument, nullptr, 'o' },
+        { "timer-wheel", no_argument,       nullptr, 'w' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --timers|-t <live timers>"
+                     "\n\t[optional] --ops|-o <update and cancel ops>"
+                     "\n\t[optional] --timer-wheel|-w "
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "ht:o:w", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 't':
+                options.m_timers = std::stoul(optarg);
+                break;
+
+            case 'o':
+                options.m_ops = std::stoul(optarg);
+                break;
+
+            case 'w':
+                options.m_backend = TimerBackend::Wheel;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+void WaitForRequests(const TimerThread& timerThread, size_t nRequests)
+{
+    while (timerThread.HandledRequests() < nRequests)
+    {
+        std::this_thread::sleep_for(100us);
+    }
+}
+
+void Report(std::string_view phase, size_t nOps, const TimeNS& elapsed)
+{
+    const double seconds{ std::chrono::duration<double>(elapsed).count() };
+    std::println(
+        "{:<8} ops:{:>9} elapsed:{:>10.3f}ms ops/s:{:>12.0f} ns/op:{:>8.1f}",
+        phase,
+        nOps,
+        seconds * 1e3,
+        static_cast<double>(nOps) / seconds,
+        static_cast<double>(elapsed.count()) / static_cast<double>(nOps)
+    );
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    TimerThread timerThread{ options.m_backend };
+    timerThread.Start();
+
+    // expiries never get this far, the receiver only has to outlive the timers
+    auto [tx, rx]{ Channel::MakeChannel<ThreadEvent>() };
+
+    std::mt19937_64 rng{ 42 };
+    std::uniform_int_distribution<size_t> pickTimer{ 0, options.m_timers - 1 };
+    std::uniform_int_distribution<int> pickOp{ 0, 3 };
+    std::uniform_int_distribution<TimeNS::rep> pickTimeout{ TimeNS{ 30min }.count(), TimeNS{ 60min }.count() };
+
+    std::println(
+        "backend:{} timers:{} ops:{}",
+        options.m_backend == TimerBackend::Wheel ? "wheel" : "uring",
+        options.m_timers,
+        options.m_ops
+    );
+
+    size_t nRequests{ 0 };
+    std::vector<TimerEventId> timers(options.m_timers);
+
+    auto start{ RealClock::now() };
+    for (auto& id : timers)
+    {
+        id = timerThread.RequestTimerAdd(TimeNS{ pickTimeout(rng) }, tx);
+        nRequests++;
+    }
+    WaitForRequests(timerThread, nRequests);
+    Report("add", options.m_timers, RealClock::now() - start);
+
+    // 3 in 4 updates, the rest cancel and replace a timer so the live count stays put
+    start = RealClock::now();
+    for (size_t i{ 0 }; i < options.m_ops; i++)
+    {
+        auto& id{ timers[pickTimer(rng)] };
+        if (pickOp(rng) != 0)
+        {
+            timerThread.RequestTimerUpdate(id, TimeNS{ pickTimeout(rng) });
+            nRequests++;
+        }
+        else
+        {
+            timerThread.RequestTimerStop(id);
+            id = timerThread.RequestTimerAdd(TimeNS{ pickTimeout(rng) }, tx);
+            nRequests += 2;
+        }
+    }
+    WaitForRequests(timerThread, nRequests);
+    Report("churn", options.m_ops, RealClock::now() - start);
+
+    start = RealClock::now();
+    for (const auto id : timers)
+    {
+        timerThread.RequestTimerStop(id);
+        nRequests++;
+    }
+    WaitForRequests(timerThread, nRequests);
+    Report("cancel", options.m_timers, RealClock::now() - start);
+
+    timerThread.Stop();
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <getopt.h>
+
+#include <iostream>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "channel/channel.hpp"
+#include "log/logger.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_thread.hpp"
+
+// Runs a population of periodic timers with jittered periods and reports how many expiries
+// each timer thread wakeup delivered, alongside the process' context switches and cpu time.
+// Run once with and once without slack to see what coalescing buys.
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_timers{ 10'000 };
+    TimeMS m_period{ 100ms };
+    TimeMS m_slack{ 0ms };
+    TimeS m_duration{ 5s };
+    TimerBackend m_backend{ TimerBackend::URing };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",        no_argument,       nullptr, 'h' },
+        { "timers",      required_argument, nullptr, 't' },
+        { "period",      required_argument, nullptr, 'p' },
+        { "slack",       required_argument, nullptr, 's' },
+        { "duration",    required_argument, nullptr, 'd' },
+        { "timer-wheel", no_argument,       nullptr, 'w' },
+        { 0,             0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --timers|-t <periodic timers>"
+                     "\n\t[optional] --period|-p <base period ms>"
+                     "\n\t[optional] --slack|-s <slack ms>"
+                     "\n\t[optional] --duration|-d <seconds>"
+                     "\n\t[optional] --timer-wheel|-w "
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "ht:p:s:d:w", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 't':
+                options.m_timers = std::stoul(optarg);
+                break;
+
+            case 'p':
+                options.m_period = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 's':
+                options.m_slack = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'w':
+                options.m_backend = TimerBackend::Wheel;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    TimerThread timerThread{ options.m_backend };
+    timerThread.Start();
+
+    auto [tx, rx]{ Channel::MakeChannel<ThreadEvent>() };
+
+    // drains expiries so they're actually delivered, like a real receiver would
+    size_t nReceived{ 0 };
+    size_t nDeliveries{ 0 };
+    std::jthread receiver{ [&rx, &nReceived, &nDeliveries](std::stop_token stopToken)
+                           {
+                               while (not stopToken.stop_requested())
+                               {
+                                   for (const auto& event : rx->tryReceiveMany(10ms))
+                                   {
+                                       nReceived += static_cast<const TimerExpiredEvent&>(*event).m_expiries.size();
+                                       nDeliveries++;
+                                   }
+                               }
+                           } };
+
+    std::println(
+        "backend:{} timers:{} period:{} slack:{} duration:{}",
+        options.m_backend == TimerBackend::Wheel ? "wheel" : "uring",
+        options.m_timers,
+        options.m_period,
+        options.m_slack,
+        options.m_duration
+    );
+
+    // up to 10% jitter, so timers don't line up on their own
+    std::mt19937_64 rng{ 42 };
+    std::uniform_int_distribution<TimeNS::rep> pickJitter{ 0, TimeNS{ options.m_period }.count() / 10 };
+
+    std::vector<TimerEventId> timers(options.m_timers);
+    for (auto& id : timers)
+    {
+        id = timerThread.RequestTimerAdd(options.m_period + TimeNS{ pickJitter(rng) }, tx, options.m_slack);
+    }
+
+    const auto statsBefore{ timerThread.GetStats() };
+    const auto usageBefore{ Bench::GetProcessUsage() };
+
+    std::this_thread::sleep_for(options.m_duration);
+
+    const auto statsAfter{ timerThread.GetStats() };
+    const auto usageAfter{ Bench::GetProcessUsage() };
+
+    for (const auto id : timers)
+    {
+        timerThread.RequestTimerStop(id);
+    }
+
+    const TimerThread::Stats stats{ .m_expiries = statsAfter.m_expiries - statsBefore.m_expiries,
+                                    .m_wakeups = statsAfter.m_wakeups - statsBefore.m_wakeups,
+                                    .m_ringEnters = statsAfter.m_ringEnters - statsBefore.m_ringEnters };
+    std::println(
+        "expiries:{} wakeups:{} coalescing-ratio:{:.2f} ring-enters:{} context-switches:{} cpu:{}",
+        stats.m_expiries,
+        stats.m_wakeups,
+        stats.CoalescingRatio(),
+        stats.m_ringEnters,
+        usageAfter.m_contextSwitches - usageBefore.m_contextSwitches,
+        usageAfter.m_cpuTime - usageBefore.m_cpuTime
+    );
+
+    timerThread.Stop();
+    receiver.request_stop();
+    receiver.join();
+    std::println("received:{} deliveries:{}", nReceived, nDeliveries);
+
+    return 0;
+}
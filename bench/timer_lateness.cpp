@@ -0,0 +1,173 @@
+#include <getopt.h>
+
+#include <iostream>
+#include <print>
+#include <thread>
+
+#include "bench_util.hpp"
+#include "log/logger.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+
+// Arms a population of periodic timers with varied periods spread across many threads and
+// reports how late their callbacks ran against when they were due, along with the cpu cost.
+// Run it before and after a timer change to qualify it.
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_timers{ 10'000 };
+    size_t m_threads{ 8 };
+    TimeMS m_minPeriod{ 10ms };
+    TimeMS m_maxPeriod{ 1000ms };
+    TimeMS m_slack{ 0ms };
+    TimeS m_duration{ 10s };
+    size_t m_timerShards{ std::thread::hardware_concurrency() };
+    TimerBackend m_backend{ TimerBackend::URing };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",         no_argument,       nullptr, 'h' },
+        { "timers",       required_argument, nullptr, 't' },
+        { "threads",      required_argument, nullptr, 'n' },
+        { "min-period",   required_argument, nullptr, 'p' },
+        { "max-period",   required_argument, nullptr, 'P' },
+        { "slack",        required_argument, nullptr, 's' },
+        { "duration",     required_argument, nullptr, 'd' },
+        { "timer-shards", required_argument, nullptr, 'S' },
+        { "timer-wheel",  no_argument,       nullptr, 'w' },
+        { 0,              0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --timers|-t <periodic timers, over all threads>"
+                     "\n\t[optional] --threads|-n <receiving threads>"
+                     "\n\t[optional] --min-period|-p <ms>"
+                     "\n\t[optional] --max-period|-P <ms>"
+                     "\n\t[optional] --slack|-s <slack ms>"
+                     "\n\t[optional] --duration|-d <seconds>"
+                     "\n\t[optional] --timer-shards|-S <timer threads>"
+                     "\n\t[optional] --timer-wheel|-w "
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "ht:n:p:P:s:d:S:w", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 't':
+                options.m_timers = std::stoul(optarg);
+                break;
+
+            case 'n':
+                options.m_threads = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'p':
+                options.m_minPeriod = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'P':
+                options.m_maxPeriod = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 's':
+                options.m_slack = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'S':
+                options.m_timerShards = std::stoul(optarg);
+                break;
+
+            case 'w':
+                options.m_backend = TimerBackend::Wheel;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    options.m_maxPeriod = std::max(options.m_minPeriod, options.m_maxPeriod);
+
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "backend:{} timers:{} threads:{} periods:[{}, {}] slack:{} duration:{} timer-shards:{}",
+        options.m_backend == TimerBackend::Wheel ? "wheel" : "uring",
+        options.m_timers,
+        options.m_threads,
+        options.m_minPeriod,
+        options.m_maxPeriod,
+        options.m_slack,
+        options.m_duration,
+        options.m_timerShards
+    );
+
+    TimerService timerService{ options.m_timerShards, options.m_backend };
+    timerService.Start();
+
+    Bench::LatenessThreads threads{
+        timerService, options.m_timers, options.m_threads, options.m_minPeriod, options.m_maxPeriod, options.m_slack
+    };
+
+    const auto cpuBefore{ Bench::GetProcessUsage().m_cpuTime };
+    const auto statsBefore{ timerService.GetStats() };
+
+    const LatencyHistogram lateness{ threads.Run(options.m_duration) };
+
+    const auto cpu{ Bench::GetProcessUsage().m_cpuTime - cpuBefore };
+    const auto statsAfter{ timerService.GetStats() };
+    timerService.Stop();
+
+    const size_t nCallbacks{ lateness.Count() };
+    std::println(
+        "callbacks:{} timer-expiries:{} timer-wakeups:{}",
+        nCallbacks,
+        statsAfter.m_expiries - statsBefore.m_expiries,
+        statsAfter.m_wakeups - statsBefore.m_wakeups
+    );
+    Bench::PrintLateness(lateness);
+    std::println(
+        "cpu:{} cpu/callback:{:.0f}ns",
+        cpu,
+        nCallbacks == 0 ? 0.0 : static_cast<double>(TimeNS{ cpu }.count()) / static_cast<double>(nCallbacks)
+    );
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include <getopt.h>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <print>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "log/logger.hpp"
+#include "threading/thread.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+#include "uring/io_uring.hpp"
+
+// Runs one periodic timer for many periods under each overrun policy, on each ring setup, and checks
+// every tick is accounted for. Once idle, and once with a callback that stalls for a few periods every
+// so often. Exits non zero if any count is off, so it doubles as a check of the overrun handling
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    TimeMS m_period{ 2ms };
+    size_t m_periods{ 500 };
+    size_t m_stallEvery{ 50 };
+    size_t m_stallPeriods{ 3 };
+    TimerBackend m_backend{ TimerBackend::URing };
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",          no_argument,       nullptr, 'h' },
+        { "period",        required_argument, nullptr, 'p' },
+        { "periods",       required_argument, nullptr, 'n' },
+        { "stall-every",   required_argument, nullptr, 'e' },
+        { "stall-periods", required_argument, nullptr, 's' },
+        { "timer-wheel",   no_argument,       nullptr, 'w' },
+        { 0,               0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --period|-p <ms>"
+                     "\n\t[optional] --periods|-n <periods per run>"
+                     "\n\t[optional] --stall-every|-e <callbacks between stalls>"
+                     "\n\t[optional] --stall-periods|-s <periods each stall lasts>"
+                     "\n\t[optional] --timer-wheel|-w "
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "hp:n:e:s:w", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 'p':
+                options.m_period = TimeMS{ std::max<long>(std::stol(optarg), 1) };
+                break;
+
+            case 'n':
+                options.m_periods = std::max<size_t>(std::stoul(optarg), 10);
+                break;
+
+            case 'e':
+                options.m_stallEvery = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 's':
+                options.m_stallPeriods = std::max<size_t>(std::stoul(optarg), 2);
+                break;
+
+            case 'w':
+                options.m_backend = TimerBackend::Wheel;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    return options;
+}
+
+struct Counts
+{
+    size_t m_calls{ 0 };
+    size_t m_reported{ 0 };
+};
+
+// Counts the callbacks and the missed ticks reported to them, stalling every stallEvery calls if asked
+class OverrunThread final : public Thread
+{
+public:
+    OverrunThread(
+        TimerService& timerService, TimerOverrunPolicy policy, const Options& options, bool stall, Counts& counts
+    ) :
+        Thread{ "OverrunThread", timerService },
+        m_policy{ policy },
+        m_period{ options.m_period },
+        m_stallEvery{ stall ? options.m_stallEvery : 0 },
+        m_stall{ options.m_period * static_cast<TimeMS::rep>(options.m_stallPeriods) },
+        m_counts{ counts }
+    {
+    }
+
+protected:
+    void Starting() override
+    {
+        StartTimer(
+            "Overrun",
+            m_period,
+            m_policy,
+            [this](size_t nMissed)
+            {
+                m_counts.m_calls++;
+                m_counts.m_reported += nMissed;
+                if (m_stallEvery > 0 and m_counts.m_calls % m_stallEvery == 0)
+                {
+                    std::this_thread::sleep_for(m_stall);
+                }
+            }
+        );
+    }
+
+    void HandleEvent(UniqueThreadEvent) override {}
+
+private:
+    const TimerOverrunPolicy m_policy;
+    const TimeMS m_period;
+    const size_t m_stallEvery;
+    const TimeMS m_stall;
+    Counts& m_counts;
+};
+
+// A run is a pass if every tick that came due was either called or reported, give or take the edges
+bool RunPolicy(
+    TimerService& timerService, const std::string& name, TimerOverrunPolicy policy, const Options& options, bool stall
+)
+{
+    Counts counts{};
+    auto thread{ std::make_unique<OverrunThread>(timerService, policy, options, stall, counts) };
+
+    const auto start{ RealClock::now() };
+    thread->Start();
+    std::this_thread::sleep_for(options.m_period * static_cast<TimeMS::rep>(options.m_periods));
+    thread->Stop();
+    const auto elapsed{ RealClock::now() - start };
+    // joins, after which the counts are ours to read
+    thread.reset();
+
+    const double due{ std::chrono::duration<double>(elapsed) / std::chrono::duration<double>(options.m_period) };
+    // a stall still running at the stop loses up to its length, plus a tick at either edge
+    const double tolerance{ static_cast<double>(options.m_stallPeriods + 2) + (due * 0.02) };
+    const double calls{ static_cast<double>(counts.m_calls) };
+    const double accounted{ static_cast<double>(counts.m_calls + counts.m_reported) };
+
+    bool pass{ false };
+    switch (policy)
+    {
+        case TimerOverrunPolicy::FireAll:
+        {
+            // every tick gets a call of its own
+            pass = std::abs(calls - due) <= tolerance;
+            break;
+        }
+
+        case TimerOverrunPolicy::Coalesce:
+        {
+            // every tick is either called or reported, and stalls fold into fewer calls
+            pass = std::abs(accounted - due) <= tolerance and (not stall or calls < due - tolerance);
+            break;
+        }
+
+        case TimerOverrunPolicy::Skip:
+        {
+            // late ticks are dropped, but everything on time after a stall still fires
+            const double stallCycle{ static_cast<double>(options.m_stallEvery + options.m_stallPeriods) };
+            const double onTime{ stall ? due * static_cast<double>(options.m_stallEvery) / stallCycle : due };
+            pass = std::abs(calls - onTime) <= tolerance + (stall ? due / stallCycle : 0.0);
+            break;
+        }
+    }
+
+    std::println(
+        "{:<9} {:<7} due:{:.0f} calls:{} reported-missed:{} {}",
+        name,
+        stall ? "stalled" : "idle",
+        due,
+        counts.m_calls,
+        counts.m_reported,
+        pass ? "ok" : "FAILED"
+    );
+    return pass;
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "backend:{} period:{} periods:{} stall-every:{} stall-periods:{}",
+        options.m_backend == TimerBackend::Wheel ? "wheel" : "uring",
+        options.m_period,
+        options.m_periods,
+        options.m_stallEvery,
+        options.m_stallPeriods
+    );
+
+    const std::vector<std::pair<std::string, URingSetup>> profiles{
+        { "default",       URingSetup{}               },
+        { "coop-taskrun",  URingSetup::CoopTaskrun()  },
+        { "single-issuer", URingSetup::SingleIssuer() },
+    };
+
+    const std::vector<std::pair<std::string, TimerOverrunPolicy>> policies{
+        { "fire-all", TimerOverrunPolicy::FireAll  },
+        { "coalesce", TimerOverrunPolicy::Coalesce },
+        { "skip",     TimerOverrunPolicy::Skip     },
+    };
+
+    size_t nFailed{ 0 };
+    for (const auto& [profile, setup] : profiles)
+    {
+        std::println("profile:{}", profile);
+
+        TimerService timerService{ 1, options.m_backend, setup };
+        timerService.Start();
+
+        for (const auto& [name, policy] : policies)
+        {
+            for (const bool stall : { false, true })
+            {
+                nFailed += RunPolicy(timerService, name, policy, options, stall) ? 0 : 1;
+            }
+        }
+
+        timerService.Stop();
+    }
+
+    if (nFailed > 0)
+    {
+        std::println("{} runs FAILED", nFailed);
+        return 1;
+    }
+
+    return 0;
+}
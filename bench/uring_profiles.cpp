@@ -0,0 +1,214 @@
+#include <getopt.h>
+
+#include <format>
+#include <iostream>
+#include <optional>
+#include <print>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "log/logger.hpp"
+#include "timers/latency_histogram.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
+#include "uring/io_uring.hpp"
+
+// Runs the same periodic timer workload on each ring setup profile in turn and reports the
+// calls the timer rings made into the kernel, context switches, cpu and timer lateness for each.
+// cpu includes any SQ poller threads, which belong to the process
+
+using namespace Sage;
+
+namespace
+{
+
+struct Options
+{
+    size_t m_timers{ 1000 };
+    size_t m_threads{ 4 };
+    TimeMS m_minPeriod{ 1ms };
+    TimeMS m_maxPeriod{ 10ms };
+    TimeS m_duration{ 5s };
+    size_t m_timerShards{ 1 };
+    TimeMS m_sqPollIdle{ 10ms };
+    std::optional<int> m_sqPollCpu{ std::nullopt };
+    unsigned m_cqSize{ 0 };
+    std::string m_profile{};
+};
+
+Options GetCliArgs(int argc, char** const argv)
+{
+    static const option argOptions[]{
+        { "help",         no_argument,       nullptr, 'h' },
+        { "timers",       required_argument, nullptr, 't' },
+        { "threads",      required_argument, nullptr, 'n' },
+        { "min-period",   required_argument, nullptr, 'p' },
+        { "max-period",   required_argument, nullptr, 'P' },
+        { "duration",     required_argument, nullptr, 'd' },
+        { "timer-shards", required_argument, nullptr, 'S' },
+        { "sqpoll-idle",  required_argument, nullptr, 'i' },
+        { "sqpoll-cpu",   required_argument, nullptr, 'c' },
+        { "cq-size",      required_argument, nullptr, 'q' },
+        { "profile",      required_argument, nullptr, 'o' },
+        { 0,              0,                 0,       0   }
+    };
+
+    auto usage = [&argv]
+    {
+        std::cout << "Usage: " << argv[0]
+                  << "\n\t[optional] --timers|-t <periodic timers, over all threads>"
+                     "\n\t[optional] --threads|-n <receiving threads>"
+                     "\n\t[optional] --min-period|-p <ms>"
+                     "\n\t[optional] --max-period|-P <ms>"
+                     "\n\t[optional] --duration|-d <seconds per profile>"
+                     "\n\t[optional] --timer-shards|-S <timer threads>"
+                     "\n\t[optional] --sqpoll-idle|-i <ms>"
+                     "\n\t[optional] --sqpoll-cpu|-c <cpu to pin SQ pollers to>"
+                     "\n\t[optional] --cq-size|-q <completion queue entries>"
+                     "\n\t[optional] --profile|-o <default|sqpoll|single-issuer|coop-taskrun, all if not given>"
+                     "\n\t[optional] --help|-h"
+                  << std::endl;
+    };
+
+    Options options{};
+
+    int option;
+    int optIndex;
+    while ((option = getopt_long(argc, argv, "ht:n:p:P:d:S:i:c:q:o:", argOptions, &optIndex)) != -1)
+    {
+        switch (option)
+        {
+            case 'h':
+                usage();
+                std::exit(0);
+                break;
+
+            case 't':
+                options.m_timers = std::stoul(optarg);
+                break;
+
+            case 'n':
+                options.m_threads = std::max<size_t>(std::stoul(optarg), 1);
+                break;
+
+            case 'p':
+                options.m_minPeriod = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'P':
+                options.m_maxPeriod = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'd':
+                options.m_duration = TimeS{ std::stol(optarg) };
+                break;
+
+            case 'S':
+                options.m_timerShards = std::stoul(optarg);
+                break;
+
+            case 'i':
+                options.m_sqPollIdle = TimeMS{ std::stol(optarg) };
+                break;
+
+            case 'c':
+                options.m_sqPollCpu = std::stoi(optarg);
+                break;
+
+            case 'q':
+                options.m_cqSize = static_cast<unsigned>(std::stoul(optarg));
+                break;
+
+            case 'o':
+                options.m_profile = optarg;
+                break;
+
+            case '?':
+            default:
+                usage();
+                std::exit(1);
+                break;
+        }
+    }
+
+    options.m_maxPeriod = std::max(options.m_minPeriod, options.m_maxPeriod);
+
+    return options;
+}
+
+void RunProfile(const std::string& name, const URingSetup& setup, const Options& options)
+{
+    TimerService timerService{ options.m_timerShards, TimerBackend::URing, setup };
+    timerService.Start();
+
+    // same periods for every profile
+    Bench::LatenessThreads threads{
+        timerService, options.m_timers, options.m_threads, options.m_minPeriod, options.m_maxPeriod
+    };
+
+    const auto usageBefore{ Bench::GetProcessUsage() };
+    const auto statsBefore{ timerService.GetStats() };
+
+    const LatencyHistogram lateness{ threads.Run(options.m_duration) };
+
+    const auto usage{ Bench::GetProcessUsage() };
+    const auto stats{ timerService.GetStats() };
+    const unsigned setupFlags{ timerService.Shard(0).RingSetupFlags() };
+    timerService.Stop();
+
+    const size_t nExpiries{ stats.m_expiries - statsBefore.m_expiries };
+    const size_t nEnters{ stats.m_ringEnters - statsBefore.m_ringEnters };
+    std::println(
+        "{:<14} flags:{:#06x} expiries:{} ring-enters:{} enters/expiry:{:.3f} context-switches:{} cpu:{}",
+        name,
+        setupFlags,
+        nExpiries,
+        nEnters,
+        nExpiries == 0 ? 0.0 : static_cast<double>(nEnters) / static_cast<double>(nExpiries),
+        usage.m_contextSwitches - usageBefore.m_contextSwitches,
+        usage.m_cpuTime - usageBefore.m_cpuTime
+    );
+    Bench::PrintLateness(lateness, std::format("{:<15}", ""));
+}
+
+} // namespace
+
+int main(int argc, char** const argv)
+{
+    const Options options{ GetCliArgs(argc, argv) };
+
+    Logger::SetupLogger("", Logger::Level::Warning);
+
+    std::println(
+        "timers:{} threads:{} periods:[{}, {}] duration:{} timer-shards:{} cq-size:{}",
+        options.m_timers,
+        options.m_threads,
+        options.m_minPeriod,
+        options.m_maxPeriod,
+        options.m_duration,
+        options.m_timerShards,
+        options.m_cqSize
+    );
+
+    const std::vector<std::pair<std::string, URingSetup>> profiles{
+        { "default",       URingSetup{}                                                 },
+        { "sqpoll",        URingSetup::SqPoll(options.m_sqPollIdle, options.m_sqPollCpu) },
+        { "single-issuer", URingSetup::SingleIssuer()                                   },
+        { "coop-taskrun",  URingSetup::CoopTaskrun()                                    },
+    };
+
+    for (auto [name, setup] : profiles)
+    {
+        if (not options.m_profile.empty() and options.m_profile != name)
+        {
+            continue;
+        }
+
+        setup.m_cqSize = options.m_cqSize;
+        RunProfile(name, setup, options);
+    }
+
+    return 0;
+}
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <deque>
 #include <iterator>
 #include <memory>
 #include <mutex>
 #include <semaphore>
+#include <sys/eventfd.h>
 #include <utility>
 
 #include "log/logger.hpp"
 #include "timers/time_utils.hpp"
+#include "timers/virtual_scheduler.hpp"
 
 namespace Sage::Channel
 {
@@ -22,6 +25,10 @@ template<typename T> struct Notifier
     std::recursive_mutex m_queueMtx{};
     std::deque<std::unique_ptr<T>> m_queue{};
     bool m_rxDisconnected{ true };
+    // receivers that block on an io_uring instead of m_notify are woken through this eventfd.
+    // Only written while parked, and only touched under the queue lock so it stays open
+    int m_wakeFd{ -1 };
+    std::atomic<bool> m_rxParked{ false };
 };
 
 template<typename T> using SharedNotifier = std::shared_ptr<Notifier<T>>;
@@ -40,6 +47,8 @@ public:
         LOG_DEBUG("rx dropped");
         std::scoped_lock lk{ m_notifier->m_queueMtx };
         m_notifier->m_rxDisconnected = true;
+        // nobody is left to handle these
+        VirtualScheduler::WorkDone(m_notifier->m_queue.size());
     }
 
     std::unique_ptr<T> receive()
@@ -136,8 +145,32 @@ public:
         return std::make_pair(std::move(res), leftInQueue);
     }
 
+    // Stops receiving, so anything sent from now on is dropped, and hands back what was still queued
+    std::deque<std::unique_ptr<T>> disconnect()
+    {
+        std::deque<std::unique_ptr<T>> res;
+        std::scoped_lock lk{ m_notifier->m_queueMtx };
+        m_notifier->m_rxDisconnected = true;
+        VirtualScheduler::WorkDone(m_notifier->m_queue.size());
+        std::swap(res, m_notifier->m_queue);
+        return res;
+    }
+
     void wakeImmediately() { m_notifier->m_notify.release(); }
 
+    // For receivers that wait on an io_uring. Sends made while parked write to wakeFd, which the
+    // receiver keeps a read queued on. -1 stops that, after which wakeFd can be closed
+    void wakeThrough(int wakeFd)
+    {
+        std::scoped_lock lk{ m_notifier->m_queueMtx };
+        m_notifier->m_wakeFd = wakeFd;
+    }
+
+    // Park before the last non-blocking receive ahead of a wait, so nothing sent after it is missed
+    void park() { m_notifier->m_rxParked.store(true); }
+
+    void unpark() { m_notifier->m_rxParked.store(false, std::memory_order_relaxed); }
+
 private:
     const SharedNotifier<T> m_notifier;
 };
@@ -155,7 +188,8 @@ public:
         sem.release();
     }
 
-    void send(std::unique_ptr<T> t, bool logOnDrop = true)
+    // false if the receiver has gone and t was dropped
+    bool send(std::unique_ptr<T> t, bool logOnDrop = true)
     {
         {
             std::scoped_lock lk{ m_notifier->m_queueMtx };
@@ -164,30 +198,60 @@ public:
             if (dropped)
             {
                 LOG_IF(logOnDrop, LOG_WARNING);
-                return;
+                return false;
             }
 
             auto& queue{ m_notifier->m_queue };
             queue.emplace_back(std::move(t));
+            VirtualScheduler::WorkQueued();
         }
 
         std::binary_semaphore& sem{ m_notifier->m_notify };
         sem.release();
+        wakeParkedRx();
+        return true;
     }
 
-    void flushAndSend(std::unique_ptr<T> t)
+    // Returns what was flushed, so the caller can account for it and drop it outside the lock
+    std::deque<std::unique_ptr<T>> flushAndSend(std::unique_ptr<T> t)
     {
+        std::deque<std::unique_ptr<T>> flushed;
         {
             std::scoped_lock lk{ m_notifier->m_queueMtx };
-            LOG_RETURN_IF(m_notifier->m_rxDisconnected, LOG_WARNING);
+            if (m_notifier->m_rxDisconnected)
+            {
+                LOG_WARNING("rx disconnected, nothing flushed");
+                return flushed;
+            }
 
             auto& queue{ m_notifier->m_queue };
-            queue.clear();
+            VirtualScheduler::WorkDone(queue.size());
+            std::swap(flushed, queue);
             queue.emplace_back(std::move(t));
+            VirtualScheduler::WorkQueued();
         }
 
         std::binary_semaphore& sem{ m_notifier->m_notify };
         sem.release();
+        wakeParkedRx();
+        return flushed;
+    }
+
+private:
+    // After the release, so a receiver that parked too late to be woken still sees the semaphore
+    void wakeParkedRx()
+    {
+        // a plain load first keeps the common case free of a locked instruction
+        if (not m_notifier->m_rxParked.load() or not m_notifier->m_rxParked.exchange(false))
+        {
+            return;
+        }
+
+        std::scoped_lock lk{ m_notifier->m_queueMtx };
+        if (m_notifier->m_wakeFd >= 0)
+        {
+            eventfd_write(m_notifier->m_wakeFd, 1);
+        }
     }
 
 private:
@@ -0,0 +1,343 @@
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <stop_token>
+#include <utility>
+
+#include "channel/channel.hpp"
+#include "io/io_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+IOThread::IOThread(
+    size_t nBuffers, size_t bufferSize, unsigned nFileSlots, unsigned queueSize, Channel::ChannelPair<IORequest> channel
+) :
+    // whole pages, so every buffer stays page aligned
+    m_bufferSize{ ((bufferSize + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT },
+    m_uring{ queueSize, IOURing::SubmitMode::Deferred },
+    m_bufferRegion{ static_cast<std::byte*>(std::aligned_alloc(BUFFER_ALIGNMENT, nBuffers * m_bufferSize)) },
+    m_tx{ std::move(channel.tx) },
+    m_thread{ &IOThread::Run, this, std::move(channel.rx) }
+{
+    LOG_DEBUG("io thread c'tor");
+
+    // registration is synchronous, and done before the thread is started so every op can use it
+    if (m_bufferRegion == nullptr)
+    {
+        LOG_ERROR("failed to allocate {} io buffers of {} bytes", nBuffers, m_bufferSize);
+    }
+    else
+    {
+        std::vector<iovec> buffers(nBuffers);
+        for (size_t i{ 0 }; i < nBuffers; i++)
+        {
+            buffers[i] = iovec{ .iov_base = m_bufferRegion.get() + (i * m_bufferSize), .iov_len = m_bufferSize };
+        }
+
+        if (m_uring.RegisterBuffers(buffers))
+        {
+            // handed out from the back, so lowest index first
+            for (size_t i{ nBuffers }; i > 0; i--)
+            {
+                m_freeBuffers.push_back(static_cast<int>(i - 1));
+            }
+        }
+    }
+
+    if (m_uring.RegisterFiles(nFileSlots))
+    {
+        for (unsigned i{ nFileSlots }; i > 0; i--)
+        {
+            m_freeFileSlots.push_back(static_cast<int>(i - 1));
+        }
+    }
+}
+
+IOThread::~IOThread() { LOG_DEBUG("io thread d'tor"); }
+
+std::optional<IOBuffer> IOThread::AcquireBuffer()
+{
+    std::scoped_lock lk{ m_buffersMtx };
+    if (m_freeBuffers.empty())
+    {
+        return std::nullopt;
+    }
+
+    const int index{ m_freeBuffers.back() };
+    m_freeBuffers.pop_back();
+
+    return IOBuffer{ .m_data = { m_bufferRegion.get() + (static_cast<size_t>(index) * m_bufferSize), m_bufferSize },
+                     .m_index = index };
+}
+
+void IOThread::ReleaseBuffer(const IOBuffer& buffer)
+{
+    std::scoped_lock lk{ m_buffersMtx };
+    m_freeBuffers.push_back(buffer.m_index);
+}
+
+std::optional<IOFile> IOThread::RegisterFile(int fd)
+{
+    std::scoped_lock lk{ m_fileSlotsMtx };
+    if (m_freeFileSlots.empty())
+    {
+        LOG_WARNING("no free file slots for fd:{}", fd);
+        return std::nullopt;
+    }
+
+    const int slot{ m_freeFileSlots.back() };
+    if (not m_uring.UpdateFile(static_cast<unsigned>(slot), fd))
+    {
+        return std::nullopt;
+    }
+
+    m_freeFileSlots.pop_back();
+    return IOFile{ .m_fd = slot, .m_fixed = true };
+}
+
+void IOThread::UnregisterFile(const IOFile& file)
+{
+    LOG_RETURN_IF(not file.m_fixed, LOG_ERROR);
+
+    std::scoped_lock lk{ m_fileSlotsMtx };
+    m_uring.UpdateFile(static_cast<unsigned>(file.m_fd), -1);
+    m_freeFileSlots.push_back(file.m_fd);
+}
+
+void IOThread::Read(
+    const IOFile& file, std::span<std::byte> buffer, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::Read,
+                                                   .m_file = file,
+                                                   .m_buffer = buffer,
+                                                   .m_offset = offset,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::Write(
+    const IOFile& file, std::span<const std::byte> buffer, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::Write,
+                                                   .m_file = file,
+                                                   .m_constBuffer = buffer,
+                                                   .m_offset = offset,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::ReadFixed(
+    const IOFile& file, const IOBuffer& buffer, std::span<std::byte> data, uint64_t offset, SharedThreadTx replyTo,
+    IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::ReadFixed,
+                                                   .m_file = file,
+                                                   .m_buffer = data,
+                                                   .m_offset = offset,
+                                                   .m_bufferIndex = buffer.m_index,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::WriteFixed(
+    const IOFile& file, const IOBuffer& buffer, std::span<const std::byte> data, uint64_t offset,
+    SharedThreadTx replyTo, IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::WriteFixed,
+                                                   .m_file = file,
+                                                   .m_constBuffer = data,
+                                                   .m_offset = offset,
+                                                   .m_bufferIndex = buffer.m_index,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::Readv(
+    const IOFile& file, std::vector<iovec> iovecs, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::Readv,
+                                                   .m_file = file,
+                                                   .m_offset = offset,
+                                                   .m_iovecs = std::move(iovecs),
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::Writev(
+    const IOFile& file, std::vector<iovec> iovecs, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::Writev,
+                                                   .m_file = file,
+                                                   .m_offset = offset,
+                                                   .m_iovecs = std::move(iovecs),
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::Fsync(const IOFile& file, bool dataOnly, SharedThreadTx replyTo, IOCompleteCb cb)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::Fsync,
+                                                   .m_file = file,
+                                                   .m_dataOnly = dataOnly,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::OpenAt(int dirFd, std::string path, int flags, mode_t mode, SharedThreadTx replyTo, IOCompleteCb cb)
+{
+    Request(std::make_unique<IORequest>(IORequest{ .m_op = IORequest::Op::OpenAt,
+                                                   .m_dirFd = dirFd,
+                                                   .m_path = std::move(path),
+                                                   .m_flags = flags,
+                                                   .m_mode = mode,
+                                                   .m_replyTo = std::move(replyTo),
+                                                   .m_cb = std::move(cb) }));
+}
+
+void IOThread::Request(std::unique_ptr<IORequest> request)
+{
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    if (not m_tx->send(std::move(request)))
+    {
+        // stopped, so it was dropped without a reply
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void IOThread::Run(std::unique_ptr<Channel::Rx<IORequest>> rx)
+{
+    pthread_setname_np(pthread_self(), "IOThread");
+
+    // For for start trigger
+    m_startLatch.wait();
+
+    LOG_INFO("io thread started");
+
+    std::stop_token stopToken{ m_thread.get_stop_token() };
+    while (not stopToken.stop_requested())
+    {
+        // only block on the channel when the ring has nothing to give back
+        HandleRequests(*rx, m_inFlight == 0 ? TimeNS{ IDLE_WAIT_TIMEOUT } : 0ns);
+
+        if (m_inFlight > 0)
+        {
+            ReapCompletions(BUSY_WAIT_TIMEOUT);
+        }
+    }
+
+    // never submitted, and nothing sent from here on is taken
+    for (auto& request : rx->disconnect())
+    {
+        OnCompleteRequest(std::move(request), -ECANCELED);
+    }
+
+    // the kernel may still be writing into memory the submitters own, so give it a chance to finish
+    const auto drainDeadline{ RealClock::now() + STOP_DRAIN_TIMEOUT };
+    while (m_inFlight > 0 and RealClock::now() < drainDeadline)
+    {
+        ReapCompletions(BUSY_WAIT_TIMEOUT);
+    }
+
+    if (m_inFlight > 0)
+    {
+        LOG_CRITICAL("io thread stopped with {} ops still in flight", m_inFlight);
+    }
+
+    LOG_INFO("io thread stopped");
+
+    m_stopLatch.count_down();
+}
+
+void IOThread::HandleRequests(Channel::Rx<IORequest>& rx, const TimeNS& timeout)
+{
+    auto requests{ rx.tryReceiveMany(timeout) };
+    for (auto& request : requests)
+    {
+        if (not QueueRequest(*request))
+        {
+            OnCompleteRequest(std::move(request), -EBUSY);
+            continue;
+        }
+
+        // the ring hands it back as the user data on completion
+        static_cast<void>(request.release());
+        m_inFlight++;
+    }
+}
+
+bool IOThread::QueueRequest(IORequest& request)
+{
+    const auto userData{ reinterpret_cast<IOURing::UserData>(&request) };
+    const IOFile& file{ request.m_file };
+
+    switch (request.m_op)
+    {
+        case IORequest::Op::Read:
+            return m_uring.QueueRead(userData, file.m_fd, request.m_buffer, request.m_offset, file.m_fixed);
+
+        case IORequest::Op::Write:
+            return m_uring.QueueWrite(userData, file.m_fd, request.m_constBuffer, request.m_offset, file.m_fixed);
+
+        case IORequest::Op::ReadFixed:
+            return m_uring.QueueReadFixed(
+                userData, file.m_fd, request.m_buffer, request.m_offset, request.m_bufferIndex, file.m_fixed
+            );
+
+        case IORequest::Op::WriteFixed:
+            return m_uring.QueueWriteFixed(
+                userData, file.m_fd, request.m_constBuffer, request.m_offset, request.m_bufferIndex, file.m_fixed
+            );
+
+        case IORequest::Op::Readv:
+            return m_uring.QueueReadv(userData, file.m_fd, request.m_iovecs, request.m_offset, file.m_fixed);
+
+        case IORequest::Op::Writev:
+            return m_uring.QueueWritev(userData, file.m_fd, request.m_iovecs, request.m_offset, file.m_fixed);
+
+        case IORequest::Op::Fsync:
+            return m_uring.QueueFsync(userData, file.m_fd, request.m_dataOnly, file.m_fixed);
+
+        case IORequest::Op::OpenAt:
+            return m_uring.QueueOpenAt(
+                userData, request.m_dirFd, request.m_path.c_str(), request.m_flags, request.m_mode
+            );
+    }
+
+    return false;
+}
+
+void IOThread::ReapCompletions(const TimeNS& timeout)
+{
+    for (auto batch{ m_uring.WaitForEvents(timeout) }; not batch.empty(); batch = m_uring.PeekEvents())
+    {
+        for (const io_uring_cqe* uringEvent : batch)
+        {
+            m_inFlight--;
+            OnCompleteRequest(
+                std::unique_ptr<IORequest>{ reinterpret_cast<IORequest*>(uringEvent->user_data) }, uringEvent->res
+            );
+        }
+    }
+}
+
+void IOThread::OnCompleteRequest(std::unique_ptr<IORequest> request, int res)
+{
+    LOG_DEBUG("io op:{} completed res:{}", static_cast<int>(request->m_op), res);
+
+    m_pending.fetch_sub(1, std::memory_order_relaxed);
+    request->m_replyTo->send(std::make_unique<IOCompleteEvent>(std::move(request->m_cb), res));
+}
+
+} // namespace Sage
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+// A file as ops see it. Fixed files are a slot in the ring's registered file table,
+// which saves the kernel looking the fd up on every op
+struct IOFile
+{
+    int m_fd;
+    bool m_fixed{ false };
+};
+
+// One of the ring's registered buffers. Fixed reads and writes into it skip pinning the pages per op
+struct IOBuffer
+{
+    std::span<std::byte> m_data;
+    int m_index;
+};
+
+// An op on its way to the io thread, and then in flight on its ring until it completes
+struct IORequest
+{
+    enum class Op
+    {
+        Read,
+        Write,
+        ReadFixed,
+        WriteFixed,
+        Readv,
+        Writev,
+        Fsync,
+        OpenAt
+    };
+
+    Op m_op;
+    IOFile m_file{ .m_fd = -1 };
+    // reads
+    std::span<std::byte> m_buffer{};
+    // writes
+    std::span<const std::byte> m_constBuffer{};
+    uint64_t m_offset{ 0 };
+    // fixed ops only
+    int m_bufferIndex{ 0 };
+    // readv and writev. owned here so they outlive the submission
+    std::vector<iovec> m_iovecs{};
+    // fsync
+    bool m_dataOnly{ false };
+    // openat
+    int m_dirFd{ -1 };
+    std::string m_path{};
+    int m_flags{ 0 };
+    mode_t m_mode{ 0 };
+    std::shared_ptr<Channel::Tx<ThreadEvent>> m_replyTo;
+    IOCompleteCb m_cb;
+};
+
+// Runs file io for other threads on its own ring. Ops are queued from any thread and the
+// completion callback comes back to run on the thread given as replyTo, as an IOCompleteEvent.
+// Only the ops are async, the memory they read into or write from must stay valid until then
+
+class IOThread
+{
+public:
+    using SharedThreadTx = std::shared_ptr<Channel::Tx<ThreadEvent>>;
+
+    static constexpr size_t DEFAULT_BUFFERS{ 64 };
+    static constexpr size_t DEFAULT_BUFFER_SIZE{ 1 << 20 };
+    static constexpr unsigned DEFAULT_FILE_SLOTS{ 1024 };
+    static constexpr unsigned DEFAULT_QUEUE_SIZE{ 1024 };
+
+    explicit IOThread(
+        size_t nBuffers = DEFAULT_BUFFERS,
+        size_t bufferSize = DEFAULT_BUFFER_SIZE,
+        unsigned nFileSlots = DEFAULT_FILE_SLOTS,
+        unsigned queueSize = DEFAULT_QUEUE_SIZE,
+        // must always be last
+        Channel::ChannelPair<IORequest> channel = Channel::MakeChannel<IORequest>()
+    );
+
+    ~IOThread();
+
+    void Start() { m_startLatch.count_down(); }
+
+    // Waits a short while for ops in flight to complete. Ops not yet submitted complete with -ECANCELED
+    void Stop()
+    {
+        m_thread.request_stop();
+        m_stopLatch.wait();
+    }
+
+    // Registered buffers are page aligned, so they also suit O_DIRECT. nullopt when all are taken
+    std::optional<IOBuffer> AcquireBuffer();
+
+    void ReleaseBuffer(const IOBuffer& buffer);
+
+    // Puts fd in a free slot of the registered file table. The caller still owns and closes fd
+    std::optional<IOFile> RegisterFile(int fd);
+
+    void UnregisterFile(const IOFile& file);
+
+    // Ops. The result goes to cb on replyTo's thread
+
+    void Read(
+        const IOFile& file, std::span<std::byte> buffer, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+    );
+
+    void Write(
+        const IOFile& file, std::span<const std::byte> buffer, uint64_t offset, SharedThreadTx replyTo,
+        IOCompleteCb cb
+    );
+
+    // data is all or part of buffer
+
+    void ReadFixed(
+        const IOFile& file, const IOBuffer& buffer, std::span<std::byte> data, uint64_t offset,
+        SharedThreadTx replyTo, IOCompleteCb cb
+    );
+
+    void WriteFixed(
+        const IOFile& file, const IOBuffer& buffer, std::span<const std::byte> data, uint64_t offset,
+        SharedThreadTx replyTo, IOCompleteCb cb
+    );
+
+    void Readv(
+        const IOFile& file, std::vector<iovec> iovecs, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+    );
+
+    void Writev(
+        const IOFile& file, std::vector<iovec> iovecs, uint64_t offset, SharedThreadTx replyTo, IOCompleteCb cb
+    );
+
+    void Fsync(const IOFile& file, bool dataOnly, SharedThreadTx replyTo, IOCompleteCb cb);
+
+    // Completes with the new fd, which the caller owns
+    void OpenAt(int dirFd, std::string path, int flags, mode_t mode, SharedThreadTx replyTo, IOCompleteCb cb);
+
+    // Ops queued to this thread that have not completed yet
+    size_t Pending() const noexcept { return m_pending.load(std::memory_order_relaxed); }
+
+private:
+    IOThread(const IOThread&) = delete;
+    IOThread(IOThread&&) = delete;
+    IOThread& operator=(const IOThread&) = delete;
+    IOThread& operator=(IOThread&&) = delete;
+
+    void Request(std::unique_ptr<IORequest> request);
+
+    void Run(std::unique_ptr<Channel::Rx<IORequest>> rx);
+
+    void HandleRequests(Channel::Rx<IORequest>& rx, const TimeNS& timeout);
+
+    // False if the ring has no room for it
+    bool QueueRequest(IORequest& request);
+
+    void ReapCompletions(const TimeNS& timeout);
+
+    void OnCompleteRequest(std::unique_ptr<IORequest> request, int res);
+
+private:
+    struct FreeBuffer
+    {
+        void operator()(std::byte* region) const noexcept { std::free(region); }
+    };
+
+private:
+    const size_t m_bufferSize;
+    // submitted once per loop, together with the wait
+    IOURing m_uring;
+    std::unique_ptr<std::byte, FreeBuffer> m_bufferRegion;
+    std::mutex m_buffersMtx;
+    std::vector<int> m_freeBuffers;
+    std::mutex m_fileSlotsMtx;
+    std::vector<int> m_freeFileSlots;
+    // ops submitted to the ring that have not completed
+    size_t m_inFlight{ 0 };
+    std::atomic<size_t> m_pending{ 0 };
+    std::shared_ptr<Channel::Tx<IORequest>> m_tx;
+    std::latch m_startLatch{ 1 };
+    std::latch m_stopLatch{ 1 };
+    std::jthread m_thread;
+
+private:
+    // waiting on the channel alone, with nothing in flight
+    static constexpr TimeMS IDLE_WAIT_TIMEOUT{ 20ms };
+    // waiting on the ring while ops are in flight, before checking the channel again
+    static constexpr TimeUS BUSY_WAIT_TIMEOUT{ 200us };
+    static constexpr TimeMS STOP_DRAIN_TIMEOUT{ 1000ms };
+    // a page, as O_DIRECT wants
+    static constexpr size_t BUFFER_ALIGNMENT{ 4096 };
+};
+
+} // namespace Sage
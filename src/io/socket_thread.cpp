@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <pthread.h>
+#include <stop_token>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+
+#include "channel/channel.hpp"
+#include "io/socket_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "uring/buffer_ring.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+// Socket thread
+
+SocketThread::SocketThread(
+    unsigned nRecvBuffers, size_t recvBufferSize, unsigned queueSize, Channel::ChannelPair<SocketRequest> channel
+) :
+    m_uring{ queueSize, IOURing::SubmitMode::Deferred },
+    m_recvBuffers{ m_uring, RECV_BUFFER_GROUP, nRecvBuffers, recvBufferSize },
+    // blocking, so the ring parks the read until there's a wakeup rather than failing it
+    m_wakeFd{ eventfd(0, EFD_CLOEXEC) },
+    m_tx{ std::move(channel.tx) },
+    m_thread{ &SocketThread::Run, this, std::move(channel.rx) }
+{
+    LOG_DEBUG("socket thread c'tor");
+
+    if (m_wakeFd < 0)
+    {
+        LOG_CRITICAL("failed to create socket thread wakeup. {}", strerror(errno));
+    }
+}
+
+SocketThread::~SocketThread()
+{
+    LOG_DEBUG("socket thread d'tor");
+
+    if (m_wakeFd >= 0)
+    {
+        close(m_wakeFd);
+    }
+}
+
+void SocketThread::Stop()
+{
+    m_thread.request_stop();
+    eventfd_write(m_wakeFd, 1);
+    m_stopLatch.wait();
+}
+
+void SocketThread::Accept(int listenFd, std::shared_ptr<SocketStream> stream, SharedThreadTx replyTo)
+{
+    Request(std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::Accept,
+                                                           .m_fd = listenFd,
+                                                           .m_replyTo = std::move(replyTo),
+                                                           .m_stream = std::move(stream) }));
+}
+
+void SocketThread::Recv(int fd, std::shared_ptr<SocketStream> stream, SharedThreadTx replyTo)
+{
+    Request(std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::Recv,
+                                                           .m_fd = fd,
+                                                           .m_replyTo = std::move(replyTo),
+                                                           .m_stream = std::move(stream) }));
+}
+
+void SocketThread::Send(int fd, std::vector<std::byte> data, SharedThreadTx replyTo, IOCompleteCb cb)
+{
+    Request(std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::Send,
+                                                           .m_fd = fd,
+                                                           .m_data = std::move(data),
+                                                           .m_replyTo = std::move(replyTo),
+                                                           .m_cb = std::move(cb) }));
+}
+
+void SocketThread::SendZeroCopy(int fd, std::vector<std::byte> data, SharedThreadTx replyTo, IOCompleteCb cb)
+{
+    Request(std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::SendZeroCopy,
+                                                           .m_fd = fd,
+                                                           .m_data = std::move(data),
+                                                           .m_replyTo = std::move(replyTo),
+                                                           .m_cb = std::move(cb) }));
+}
+
+void SocketThread::Connect(int fd, const sockaddr* addr, socklen_t addrLen, SharedThreadTx replyTo, IOCompleteCb cb)
+{
+    auto request{ std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::Connect,
+                                                                 .m_fd = fd,
+                                                                 .m_addrLen = addrLen,
+                                                                 .m_replyTo = std::move(replyTo),
+                                                                 .m_cb = std::move(cb) }) };
+    std::memcpy(&request->m_addr, addr, std::min<size_t>(addrLen, sizeof(request->m_addr)));
+    Request(std::move(request));
+}
+
+void SocketThread::Close(int fd)
+{
+    Request(std::make_unique<SocketRequest>(SocketRequest{ .m_op = SocketRequest::Op::Close, .m_fd = fd }));
+}
+
+void SocketThread::Request(std::unique_ptr<SocketRequest> request)
+{
+    const bool isClose{ request->m_op == SocketRequest::Op::Close };
+    const int fd{ request->m_fd };
+    if (not m_tx->send(std::move(request)))
+    {
+        // stopped, so nobody else will close it
+        if (isClose)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    // only worth the syscall when the thread is parked on the ring
+    if (m_waiting.exchange(false))
+    {
+        eventfd_write(m_wakeFd, 1);
+    }
+}
+
+void SocketThread::Run(std::unique_ptr<Channel::Rx<SocketRequest>> rx)
+{
+    pthread_setname_np(pthread_self(), "SocketThread");
+
+    // For for start trigger
+    m_startLatch.wait();
+
+    LOG_INFO("socket thread started");
+
+    ArmWakeup();
+
+    std::stop_token stopToken{ m_thread.get_stop_token() };
+    while (not stopToken.stop_requested())
+    {
+        // anything sent from here on wakes the ring, so nothing is left waiting on the channel
+        m_waiting.store(true);
+        HandleRequests(*rx);
+
+        ReapCompletions(URING_WAIT_TIMEOUT);
+        m_waiting.store(false, std::memory_order_relaxed);
+    }
+
+    m_stopping = true;
+    for (auto& [fd, request] : m_multishots)
+    {
+        request->m_closing = true;
+        m_uring.QueueCancel(IGNORED_USER_DATA, reinterpret_cast<IOURing::UserData>(request));
+    }
+    m_multishots.clear();
+
+    // never queued, and nothing sent from here on is taken. The ring holds its own reference to any
+    // socket it still has ops on, so closing here is safe
+    for (auto& request : rx->disconnect())
+    {
+        if (request->m_op == SocketRequest::Op::Close)
+        {
+            close(request->m_fd);
+        }
+        else if (request->m_stream != nullptr)
+        {
+            ReplyStream(*request, -ECANCELED, {});
+        }
+        else
+        {
+            Reply(*request, -ECANCELED);
+        }
+    }
+
+    // the kernel may still be reading from sends, so give it a chance to finish
+    const auto drainDeadline{ RealClock::now() + STOP_DRAIN_TIMEOUT };
+    while (m_inFlight > 0 and RealClock::now() < drainDeadline)
+    {
+        ReapCompletions(URING_WAIT_TIMEOUT);
+    }
+
+    if (m_inFlight > 0)
+    {
+        LOG_CRITICAL("socket thread stopped with {} ops still in flight", m_inFlight);
+    }
+
+    LOG_INFO("socket thread stopped");
+
+    m_stopLatch.count_down();
+}
+
+void SocketThread::HandleRequests(Channel::Rx<SocketRequest>& rx)
+{
+    auto requests{ rx.tryReceiveMany(0ns) };
+    for (auto& request : requests)
+    {
+        if (request->m_op == SocketRequest::Op::Close)
+        {
+            if (auto it{ m_multishots.find(request->m_fd) }; it != m_multishots.end())
+            {
+                it->second->m_closing = true;
+                m_uring.QueueCancel(IGNORED_USER_DATA, reinterpret_cast<IOURing::UserData>(it->second));
+                // the fd may be reused as soon as it's closed
+                m_multishots.erase(it);
+            }
+
+            // ops in flight hold on to the socket, so the cancel still finds them
+            m_uring.QueueClose(IGNORED_USER_DATA, request->m_fd);
+            continue;
+        }
+
+        if (not QueueRequest(*request))
+        {
+            if (request->m_stream != nullptr)
+            {
+                ReplyStream(*request, -EBUSY, {});
+            }
+            else
+            {
+                Reply(*request, -EBUSY);
+            }
+            continue;
+        }
+
+        if (request->m_stream != nullptr)
+        {
+            m_multishots[request->m_fd] = request.get();
+        }
+
+        // the ring hands it back as the user data on completion
+        static_cast<void>(request.release());
+        m_inFlight++;
+    }
+}
+
+bool SocketThread::QueueRequest(SocketRequest& request)
+{
+    const auto userData{ reinterpret_cast<IOURing::UserData>(&request) };
+
+    switch (request.m_op)
+    {
+        case SocketRequest::Op::Accept:
+            return m_uring.QueueMultishotAccept(userData, request.m_fd);
+
+        case SocketRequest::Op::Recv:
+            return m_recvBuffers.IsValid() and
+                   m_uring.QueueMultishotRecv(userData, request.m_fd, m_recvBuffers.BufferGroup());
+
+        case SocketRequest::Op::Send:
+            return m_uring.QueueSend(userData, request.m_fd, request.m_data);
+
+        case SocketRequest::Op::SendZeroCopy:
+            return m_uring.QueueSendZeroCopy(userData, request.m_fd, request.m_data);
+
+        case SocketRequest::Op::Connect:
+            return m_uring.QueueConnect(
+                userData, request.m_fd, reinterpret_cast<const sockaddr*>(&request.m_addr), request.m_addrLen
+            );
+
+        // never goes on the ring as itself
+        case SocketRequest::Op::Close:
+            return false;
+    }
+
+    return false;
+}
+
+void SocketThread::ArmWakeup()
+{
+    m_uring.QueueRead(WAKEUP_USER_DATA, m_wakeFd, std::as_writable_bytes(std::span{ &m_wakeCount, 1 }), 0);
+}
+
+void SocketThread::ReapCompletions(const TimeNS& timeout)
+{
+    for (auto batch{ m_uring.WaitForEvents(timeout) }; not batch.empty(); batch = m_uring.PeekEvents())
+    {
+        for (const io_uring_cqe* uringEvent : batch)
+        {
+            switch (uringEvent->user_data)
+            {
+                case WAKEUP_USER_DATA:
+                    ArmWakeup();
+                    break;
+
+                case IGNORED_USER_DATA:
+                    break;
+
+                default:
+                    OnCompleteRequest(*reinterpret_cast<SocketRequest*>(uringEvent->user_data), *uringEvent);
+                    break;
+            }
+        }
+    }
+}
+
+void SocketThread::OnCompleteRequest(SocketRequest& request, const io_uring_cqe& cEvent)
+{
+    bool done{ true };
+    switch (request.m_op)
+    {
+        case SocketRequest::Op::Accept:
+            done = OnCompleteAccept(request, cEvent);
+            break;
+
+        case SocketRequest::Op::Recv:
+            done = OnCompleteRecv(request, cEvent);
+            break;
+
+        case SocketRequest::Op::SendZeroCopy:
+            done = OnCompleteSendZeroCopy(request, cEvent);
+            break;
+
+        case SocketRequest::Op::Send:
+        case SocketRequest::Op::Connect:
+        case SocketRequest::Op::Close:
+            Reply(request, cEvent.res);
+            break;
+    }
+
+    if (not done)
+    {
+        return;
+    }
+
+    if (auto it{ m_multishots.find(request.m_fd) }; it != m_multishots.end() and it->second == &request)
+    {
+        m_multishots.erase(it);
+    }
+
+    m_inFlight--;
+    delete &request;
+}
+
+bool SocketThread::OnCompleteAccept(SocketRequest& request, const io_uring_cqe& cEvent)
+{
+    if (cEvent.res < 0)
+    {
+        // cancelled by a close, so nobody is listening for it
+        if (not request.m_closing)
+        {
+            LOG_ERROR("accept on fd:{} failed. {}", request.m_fd, strerror(-cEvent.res));
+            ReplyStream(request, cEvent.res, {});
+        }
+        return true;
+    }
+
+    if (request.m_closing)
+    {
+        close(cEvent.res);
+    }
+    else
+    {
+        ReplyStream(request, cEvent.res, {});
+    }
+
+    if ((cEvent.flags & IORING_CQE_F_MORE) != 0)
+    {
+        return false;
+    }
+
+    if (request.m_closing or m_stopping)
+    {
+        return true;
+    }
+
+    // the kernel ended it without an error, so carry on where it left off
+    if (not QueueRequest(request))
+    {
+        ReplyStream(request, -EBUSY, {});
+        return true;
+    }
+
+    return false;
+}
+
+bool SocketThread::OnCompleteRecv(SocketRequest& request, const io_uring_cqe& cEvent)
+{
+    const bool more{ (cEvent.flags & IORING_CQE_F_MORE) != 0 };
+
+    if (cEvent.res > 0)
+    {
+        const auto bufferId{ URingBufferRing::BufferIdOf(cEvent) };
+        if (not bufferId.has_value()) [[unlikely]]
+        {
+            LOG_ERROR("recv on fd:{} completed without a buffer", request.m_fd);
+            return not more;
+        }
+
+        // copied out so the buffer goes straight back to the kernel, however slow the owner is
+        const auto data{ m_recvBuffers.Buffer(*bufferId, static_cast<size_t>(cEvent.res)) };
+        std::vector<std::byte> received{ data.begin(), data.end() };
+        m_recvBuffers.Recycle(*bufferId);
+
+        if (not request.m_closing)
+        {
+            ReplyStream(request, cEvent.res, std::move(received));
+        }
+    }
+
+    if (more)
+    {
+        return false;
+    }
+
+    if (request.m_closing or m_stopping)
+    {
+        return true;
+    }
+
+    // ran out of buffers, or the kernel ended it without an error. carry on where it left off
+    if (cEvent.res > 0 or cEvent.res == -ENOBUFS)
+    {
+        if (QueueRequest(request))
+        {
+            return false;
+        }
+
+        ReplyStream(request, -EBUSY, {});
+        return true;
+    }
+
+    // the peer closed, or an error
+    ReplyStream(request, cEvent.res, {});
+    return true;
+}
+
+bool SocketThread::OnCompleteSendZeroCopy(SocketRequest& request, const io_uring_cqe& cEvent)
+{
+    // the kernel is done with the data
+    if ((cEvent.flags & IORING_CQE_F_NOTIF) != 0)
+    {
+        return true;
+    }
+
+    Reply(request, cEvent.res);
+
+    // a failed send never gets a notification
+    return (cEvent.flags & IORING_CQE_F_MORE) == 0;
+}
+
+void SocketThread::Reply(SocketRequest& request, int res)
+{
+    if (request.m_cb)
+    {
+        request.m_replyTo->send(std::make_unique<IOCompleteEvent>(std::move(request.m_cb), res));
+    }
+}
+
+void SocketThread::ReplyStream(SocketRequest& request, int res, std::vector<std::byte>&& data)
+{
+    const bool accepted{ request.m_op == SocketRequest::Op::Accept and res >= 0 };
+    auto onComplete = [stream = request.m_stream, data = std::move(data), accepted](int result)
+    {
+        if (not stream->m_stopped)
+        {
+            stream->m_cb(result, data);
+        }
+        // nobody left to own it
+        else if (accepted)
+        {
+            close(result);
+        }
+    };
+
+    request.m_replyTo->send(std::make_unique<IOCompleteEvent>(std::move(onComplete), res));
+}
+
+// Listener
+
+Listener::Listener(SocketThread& socketThread, int listenFd, SocketThread::SharedThreadTx owner) :
+    m_socketThread{ socketThread },
+    m_fd{ listenFd },
+    m_owner{ std::move(owner) }
+{
+}
+
+void Listener::Start(AcceptCb cb)
+{
+    LOG_RETURN_IF(m_fd < 0 or m_stream != nullptr, LOG_ERROR);
+
+    m_stream = std::make_shared<SocketStream>(
+        SocketStream{ .m_cb = [cb = std::move(cb)](int res, std::span<const std::byte>) mutable { cb(res); } }
+    );
+    m_socketThread.Accept(m_fd, m_stream, m_owner);
+}
+
+void Listener::Close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    if (m_stream != nullptr)
+    {
+        m_stream->m_stopped = true;
+    }
+
+    m_socketThread.Close(std::exchange(m_fd, -1));
+}
+
+// Connection
+
+Connection::Connection(SocketThread& socketThread, int fd, SocketThread::SharedThreadTx owner) :
+    m_socketThread{ socketThread },
+    m_fd{ fd },
+    m_owner{ std::move(owner) }
+{
+}
+
+void Connection::StartReceiving(SocketStreamCb cb)
+{
+    LOG_RETURN_IF(m_fd < 0 or m_stream != nullptr, LOG_ERROR);
+
+    m_stream = std::make_shared<SocketStream>(SocketStream{ .m_cb = std::move(cb) });
+    m_socketThread.Recv(m_fd, m_stream, m_owner);
+}
+
+void Connection::Send(std::vector<std::byte> data, IOCompleteCb cb)
+{
+    LOG_RETURN_IF(m_fd < 0, LOG_ERROR);
+
+    m_socketThread.Send(m_fd, std::move(data), m_owner, Guard(std::move(cb)));
+}
+
+void Connection::SendZeroCopy(std::vector<std::byte> data, IOCompleteCb cb)
+{
+    LOG_RETURN_IF(m_fd < 0, LOG_ERROR);
+
+    m_socketThread.SendZeroCopy(m_fd, std::move(data), m_owner, Guard(std::move(cb)));
+}
+
+void Connection::Close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    *m_closed = true;
+    if (m_stream != nullptr)
+    {
+        m_stream->m_stopped = true;
+    }
+
+    m_socketThread.Close(std::exchange(m_fd, -1));
+}
+
+IOCompleteCb Connection::Guard(IOCompleteCb cb)
+{
+    if (not cb)
+    {
+        return {};
+    }
+
+    return [closed = m_closed, cb = std::move(cb)](int res) mutable
+    {
+        if (not *closed)
+        {
+            cb(res);
+        }
+    };
+}
+
+} // namespace Sage
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <span>
+#include <sys/socket.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+#include "uring/buffer_ring.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+// Called for every completion of a multishot op, on the owner's thread.
+// For receives res > 0 is the bytes in data, 0 the peer closing and < 0 -errno.
+// For accepts res is the new fd, or -errno. There are no more calls after a 0 or an error
+using SocketStreamCb = std::move_only_function<void(int res, std::span<const std::byte> data)>;
+
+// The owner's side of a multishot op. Only ever touched on the owner's thread,
+// the socket thread only passes it along with each completion
+struct SocketStream
+{
+    SocketStreamCb m_cb;
+    bool m_stopped{ false };
+};
+
+// An op on its way to the socket thread, and then in flight on its ring until it completes
+struct SocketRequest
+{
+    enum class Op
+    {
+        Accept,
+        Recv,
+        Send,
+        SendZeroCopy,
+        Connect,
+        Close
+    };
+
+    Op m_op;
+    int m_fd;
+    // sends. owned here so it outlives the op
+    std::vector<std::byte> m_data{};
+    // connect
+    sockaddr_storage m_addr{};
+    socklen_t m_addrLen{ 0 };
+    std::shared_ptr<Channel::Tx<ThreadEvent>> m_replyTo{};
+    // one shot ops
+    IOCompleteCb m_cb{};
+    // multishot ops
+    std::shared_ptr<SocketStream> m_stream{};
+    bool m_closing{ false };
+};
+
+// Runs socket io for other threads on its own ring. Receives are multishot into a shared
+// provided buffer ring, and copied out as they complete so the buffer goes straight back to the kernel.
+// Results come back to the thread given as replyTo, as IOCompleteEvents.
+// Most code wants the Listener and Connection wrappers below rather than this directly
+
+class SocketThread
+{
+public:
+    using SharedThreadTx = std::shared_ptr<Channel::Tx<ThreadEvent>>;
+
+    static constexpr unsigned DEFAULT_RECV_BUFFERS{ 1024 };
+    static constexpr size_t DEFAULT_RECV_BUFFER_SIZE{ 16 << 10 };
+    static constexpr unsigned DEFAULT_QUEUE_SIZE{ 1024 };
+
+    explicit SocketThread(
+        unsigned nRecvBuffers = DEFAULT_RECV_BUFFERS,
+        size_t recvBufferSize = DEFAULT_RECV_BUFFER_SIZE,
+        unsigned queueSize = DEFAULT_QUEUE_SIZE,
+        // must always be last
+        Channel::ChannelPair<SocketRequest> channel = Channel::MakeChannel<SocketRequest>()
+    );
+
+    ~SocketThread();
+
+    void Start() { m_startLatch.count_down(); }
+
+    // Stops every multishot op and waits a short while for ops in flight to complete.
+    // Closes still queued are done there and then, other ops not yet queued complete with -ECANCELED
+    void Stop();
+
+    // Keeps accepting on listenFd until it's closed
+    void Accept(int listenFd, std::shared_ptr<SocketStream> stream, SharedThreadTx replyTo);
+
+    // Keeps receiving on fd until it's closed, the peer closes or there's an error
+    void Recv(int fd, std::shared_ptr<SocketStream> stream, SharedThreadTx replyTo);
+
+    // cb gets the bytes sent, or -errno. It may be empty
+    void Send(int fd, std::vector<std::byte> data, SharedThreadTx replyTo, IOCompleteCb cb);
+
+    // Skips copying data into the kernel, which pays off for large sends
+    void SendZeroCopy(int fd, std::vector<std::byte> data, SharedThreadTx replyTo, IOCompleteCb cb);
+
+    void Connect(int fd, const sockaddr* addr, socklen_t addrLen, SharedThreadTx replyTo, IOCompleteCb cb);
+
+    // Stops any multishot op on fd and closes it
+    void Close(int fd);
+
+private:
+    SocketThread(const SocketThread&) = delete;
+    SocketThread(SocketThread&&) = delete;
+    SocketThread& operator=(const SocketThread&) = delete;
+    SocketThread& operator=(SocketThread&&) = delete;
+
+    void Request(std::unique_ptr<SocketRequest> request);
+
+    void Run(std::unique_ptr<Channel::Rx<SocketRequest>> rx);
+
+    void HandleRequests(Channel::Rx<SocketRequest>& rx);
+
+    // False if the ring has no room for it
+    bool QueueRequest(SocketRequest& request);
+
+    void ArmWakeup();
+
+    void ReapCompletions(const TimeNS& timeout);
+
+    void OnCompleteRequest(SocketRequest& request, const io_uring_cqe& cEvent);
+
+    // True once the request is done with
+    bool OnCompleteAccept(SocketRequest& request, const io_uring_cqe& cEvent);
+    bool OnCompleteRecv(SocketRequest& request, const io_uring_cqe& cEvent);
+    bool OnCompleteSendZeroCopy(SocketRequest& request, const io_uring_cqe& cEvent);
+
+    // Runs cb on the owner's thread, with the result of a one shot op
+    static void Reply(SocketRequest& request, int res);
+
+    // Runs the stream's callback on the owner's thread
+    static void ReplyStream(SocketRequest& request, int res, std::vector<std::byte>&& data);
+
+private:
+    // user data that isn't a request
+    enum : IOURing::UserData
+    {
+        WAKEUP_USER_DATA,
+        IGNORED_USER_DATA
+    };
+
+    // submitted once per loop, together with the wait
+    IOURing m_uring;
+    URingBufferRing m_recvBuffers;
+    // readable whenever requests were sent while the thread waited on the ring
+    const int m_wakeFd;
+    uint64_t m_wakeCount{ 0 };
+    std::atomic<bool> m_waiting{ false };
+    // accepts and receives in flight, by fd
+    std::unordered_map<int, SocketRequest*> m_multishots;
+    // requests the ring still holds
+    size_t m_inFlight{ 0 };
+    bool m_stopping{ false };
+    std::shared_ptr<Channel::Tx<SocketRequest>> m_tx;
+    std::latch m_startLatch{ 1 };
+    std::latch m_stopLatch{ 1 };
+    std::jthread m_thread;
+
+private:
+    static constexpr uint16_t RECV_BUFFER_GROUP{ 0 };
+    static constexpr TimeMS URING_WAIT_TIMEOUT{ 20ms };
+    static constexpr TimeMS STOP_DRAIN_TIMEOUT{ 1000ms };
+};
+
+// A listening socket, owned by and used on one Thread. Accepted fds are handed to cb on that thread
+
+class Listener
+{
+public:
+    // fd < 0 is -errno, after which accepting has stopped
+    using AcceptCb = std::move_only_function<void(int fd)>;
+
+    Listener(SocketThread& socketThread, int listenFd, SocketThread::SharedThreadTx owner);
+
+    ~Listener() { Close(); }
+
+    int Fd() const noexcept { return m_fd; }
+
+    void Start(AcceptCb cb);
+
+    // Stops accepting and closes the listening socket
+    void Close();
+
+private:
+    Listener(const Listener&) = delete;
+    Listener(Listener&&) = delete;
+    Listener& operator=(const Listener&) = delete;
+    Listener& operator=(Listener&&) = delete;
+
+private:
+    SocketThread& m_socketThread;
+    int m_fd;
+    const SocketThread::SharedThreadTx m_owner;
+    std::shared_ptr<SocketStream> m_stream{};
+};
+
+// A connected socket, owned by and used on one Thread. Send and receive callbacks run on that
+// thread, and none run once it's closed
+
+class Connection
+{
+public:
+    Connection(SocketThread& socketThread, int fd, SocketThread::SharedThreadTx owner);
+
+    ~Connection() { Close(); }
+
+    int Fd() const noexcept { return m_fd; }
+
+    bool IsOpen() const noexcept { return m_fd >= 0; }
+
+    void StartReceiving(SocketStreamCb cb);
+
+    // cb gets the bytes sent, or -errno. It may be empty
+    void Send(std::vector<std::byte> data, IOCompleteCb cb = {});
+
+    // Skips copying data into the kernel, which pays off for large sends
+    void SendZeroCopy(std::vector<std::byte> data, IOCompleteCb cb = {});
+
+    void Close();
+
+private:
+    Connection(const Connection&) = delete;
+    Connection(Connection&&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    Connection& operator=(Connection&&) = delete;
+
+    // Drops cb's result once the connection is closed
+    IOCompleteCb Guard(IOCompleteCb cb);
+
+private:
+    SocketThread& m_socketThread;
+    int m_fd;
+    const SocketThread::SharedThreadTx m_owner;
+    std::shared_ptr<SocketStream> m_stream{};
+    // shared with send callbacks still in flight
+    std::shared_ptr<bool> m_closed{ std::make_shared<bool>(false) };
+};
+
+} // namespace Sage
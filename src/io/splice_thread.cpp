@@ -0,0 +1,549 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <pthread.h>
+#include <stop_token>
+#include <unistd.h>
+#include <utility>
+
+#include "channel/channel.hpp"
+#include "io/splice_thread.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+SpliceThread::SpliceThread(size_t depth, size_t chunkSize, Channel::ChannelPair<SpliceRequest> channel) :
+    m_chunkSize{ chunkSize },
+    m_uring{ static_cast<uint>(depth * 4), IOURing::SubmitMode::Deferred },
+    m_tx{ std::move(channel.tx) },
+    m_thread{ &SpliceThread::Run, this, std::move(channel.rx) }
+{
+    LOG_DEBUG("splice thread c'tor");
+
+    // set up before the thread is started, so every copy can use them
+    for (size_t i{ 0 }; i < depth; i++)
+    {
+        auto chunk{ std::make_unique<Chunk>() };
+        if (not OpenPipes(*chunk))
+        {
+            continue;
+        }
+
+        chunk->m_ops = { ChunkOp{ chunk.get(), OpKind::Fill },
+                         ChunkOp{ chunk.get(), OpKind::Tee },
+                         ChunkOp{ chunk.get(), OpKind::Drain },
+                         ChunkOp{ chunk.get(), OpKind::TeeDrain } };
+        m_freeChunks.push_back(chunk.get());
+        m_chunks.push_back(std::move(chunk));
+    }
+    m_usableChunks = m_chunks.size();
+
+    if (m_chunks.empty())
+    {
+        LOG_CRITICAL("splice thread has no pipes to copy through");
+    }
+}
+
+SpliceThread::~SpliceThread()
+{
+    LOG_DEBUG("splice thread d'tor");
+
+    for (auto& chunk : m_chunks)
+    {
+        ClosePipes(*chunk);
+    }
+}
+
+void SpliceThread::Copy(SpliceRequest request) { m_tx->send(std::make_unique<SpliceRequest>(std::move(request))); }
+
+void SpliceThread::Run(std::unique_ptr<Channel::Rx<SpliceRequest>> rx)
+{
+    pthread_setname_np(pthread_self(), "SpliceThread");
+
+    // For for start trigger
+    m_startLatch.wait();
+
+    LOG_INFO("splice thread started");
+
+    std::stop_token stopToken{ m_thread.get_stop_token() };
+    while (not stopToken.stop_requested())
+    {
+        // only block on the channel when the ring has nothing to give back
+        HandleRequests(*rx, m_inFlight == 0 ? TimeNS{ IDLE_WAIT_TIMEOUT } : 0ns);
+        StartChunks();
+
+        if (m_inFlight > 0)
+        {
+            ReapCompletions(BUSY_WAIT_TIMEOUT);
+        }
+
+        // only once nothing is walking the queue
+        std::erase_if(m_transfers, [](const auto& transfer) { return transfer->m_finished; });
+    }
+
+    // the kernel may still be moving data between fds the callers own, so stop it and let it finish
+    if (m_inFlight > 0)
+    {
+        m_uring.QueueCancelAll(IGNORED_USER_DATA);
+    }
+
+    const auto drainDeadline{ RealClock::now() + STOP_DRAIN_TIMEOUT };
+    while (m_inFlight > 0 and RealClock::now() < drainDeadline)
+    {
+        ReapCompletions(BUSY_WAIT_TIMEOUT);
+    }
+
+    if (m_inFlight > 0)
+    {
+        LOG_CRITICAL("splice thread stopped with {} ops still in flight", m_inFlight);
+    }
+
+    // copies that never got all their chunks started
+    FailTransfers(-ECANCELED);
+
+    LOG_INFO("splice thread stopped");
+
+    m_stopLatch.count_down();
+}
+
+void SpliceThread::HandleRequests(Channel::Rx<SpliceRequest>& rx, const TimeNS& timeout)
+{
+    auto requests{ rx.tryReceiveMany(timeout) };
+    for (auto& request : requests)
+    {
+        auto cb{ std::make_shared<SpliceProgressCb>(std::move(request->m_cb)) };
+        auto transfer{
+            std::make_unique<Transfer>(Transfer{ .m_request = std::move(*request), .m_cb = std::move(cb) })
+        };
+
+        if (transfer->m_request.m_length == 0)
+        {
+            Report(*transfer, true);
+            continue;
+        }
+
+        m_transfers.push_back(std::move(transfer));
+    }
+}
+
+void SpliceThread::StartChunks()
+{
+    // nothing would ever start them, so don't leave the callers waiting on a finish
+    if (m_usableChunks == 0 and not m_transfers.empty())
+    {
+        LOG_ERROR("splice thread has no pipes, failing {} copies", m_transfers.size());
+        FailTransfers(-EMFILE);
+        return;
+    }
+
+    bool started{ true };
+    while (started and not m_freeChunks.empty())
+    {
+        // a chunk each per pass, so copies take turns
+        started = false;
+        for (auto& transfer : m_transfers)
+        {
+            const SpliceRequest& request{ transfer->m_request };
+            if (m_freeChunks.empty())
+            {
+                break;
+            }
+
+            if (transfer->m_error != 0 or transfer->m_eof or transfer->m_nextOffset >= request.m_length or
+                (request.m_inOffset < 0 and transfer->m_chunksInFlight > 0))
+            {
+                continue;
+            }
+
+            Chunk& chunk{ *m_freeChunks.back() };
+            m_freeChunks.pop_back();
+
+            chunk.m_transfer = transfer.get();
+            chunk.m_offset = transfer->m_nextOffset;
+            chunk.m_length = std::min<uint64_t>(m_chunkSize, request.m_length - transfer->m_nextOffset);
+            chunk.m_filled = 0;
+            chunk.m_drained = 0;
+            chunk.m_teeDrained = 0;
+            chunk.m_teePending = false;
+            chunk.m_parked = false;
+            chunk.m_eof = false;
+            chunk.m_error = 0;
+
+            transfer->m_nextOffset += chunk.m_length;
+            transfer->m_chunksInFlight++;
+            started = true;
+
+            QueueRound(chunk);
+        }
+    }
+}
+
+void SpliceThread::Advance(Chunk& chunk)
+{
+    // the copy failed elsewhere, or is being cancelled
+    if (chunk.m_error == 0 and (m_thread.get_stop_token().stop_requested() or chunk.m_transfer->m_error != 0))
+    {
+        chunk.m_error = -ECANCELED;
+    }
+
+    const bool mayDrain{ MayDrain(chunk) };
+
+    if (chunk.m_error != 0)
+    {
+        FinishChunk(chunk);
+    }
+    else if (chunk.m_teePending)
+    {
+        // the tee pipe has to get its copy before the pipe is drained
+        QueueOp(chunk, OpKind::Tee, chunk.m_inPipe);
+    }
+    else if (not mayDrain and (chunk.m_inPipe > 0 or chunk.m_inTeePipe > 0))
+    {
+        // resumed once the chunks before it are out. the rest of a short fill waits too, tee would
+        // copy what's already in the pipe again
+        chunk.m_parked = true;
+    }
+    else if (chunk.m_inPipe > 0 or chunk.m_inTeePipe > 0)
+    {
+        // the rest of a short drain
+        if (chunk.m_inPipe > 0)
+        {
+            QueueOp(chunk, OpKind::Drain, chunk.m_inPipe);
+        }
+        if (chunk.m_inTeePipe > 0)
+        {
+            QueueOp(chunk, OpKind::TeeDrain, chunk.m_inTeePipe);
+        }
+    }
+    else if (not chunk.m_eof and chunk.m_filled < chunk.m_length)
+    {
+        // the rest of a short fill
+        QueueRound(chunk);
+    }
+    else
+    {
+        FinishChunk(chunk);
+    }
+}
+
+void SpliceThread::QueueRound(Chunk& chunk)
+{
+    const bool tee{ chunk.m_transfer->m_request.m_teeOut >= 0 };
+    const bool drain{ MayDrain(chunk) };
+    const uint64_t len{ chunk.m_length - chunk.m_filled };
+
+    // each op only runs once the one before moved all of len, anything short is picked up by Advance
+    if (not m_uring.BeginChain((tee ? 2 : 1) * (drain ? 2 : 1)))
+    {
+        chunk.m_error = -EBUSY;
+        FinishChunk(chunk);
+        return;
+    }
+
+    QueueOp(chunk, OpKind::Fill, len);
+    if (tee)
+    {
+        QueueOp(chunk, OpKind::Tee, len);
+    }
+    if (drain)
+    {
+        QueueOp(chunk, OpKind::Drain, len);
+    }
+    if (drain and tee)
+    {
+        QueueOp(chunk, OpKind::TeeDrain, len);
+    }
+
+    m_uring.EndChain();
+}
+
+bool SpliceThread::MayDrain(const Chunk& chunk) noexcept
+{
+    const SpliceRequest& request{ chunk.m_transfer->m_request };
+    const bool streamOut{ request.m_outOffset < 0 or (request.m_teeOut >= 0 and request.m_teeOffset < 0) };
+    return not streamOut or chunk.m_offset == chunk.m_transfer->m_drainOffset;
+}
+
+void SpliceThread::ResumeParked(Transfer& transfer)
+{
+    for (auto& chunk : m_chunks)
+    {
+        // a failed copy only finishes them
+        if (chunk->m_parked and chunk->m_transfer == &transfer and
+            (transfer.m_error != 0 or chunk->m_offset == transfer.m_drainOffset))
+        {
+            chunk->m_parked = false;
+            Advance(*chunk);
+        }
+    }
+}
+
+void SpliceThread::QueueOp(Chunk& chunk, OpKind kind, uint64_t len)
+{
+    const SpliceRequest& request{ chunk.m_transfer->m_request };
+    ChunkOp& op{ chunk.m_ops[static_cast<size_t>(kind)] };
+    const auto userData{ reinterpret_cast<IOURing::UserData>(&op) };
+    const auto nBytes{ static_cast<unsigned>(len) };
+
+    // streams have no offsets, they move from wherever they are
+    auto offsetOf = [&chunk](int64_t start, uint64_t done)
+    { return start < 0 ? int64_t{ -1 } : start + static_cast<int64_t>(chunk.m_offset + done); };
+
+    bool queued{ false };
+    switch (kind)
+    {
+        case OpKind::Fill:
+            queued = m_uring.QueueSplice(
+                userData,
+                request.m_in,
+                offsetOf(request.m_inOffset, chunk.m_filled),
+                chunk.m_pipe[1],
+                -1,
+                nBytes,
+                SPLICE_F_MOVE
+            );
+            break;
+
+        case OpKind::Tee:
+            queued = m_uring.QueueTee(userData, chunk.m_pipe[0], chunk.m_teePipe[1], nBytes);
+            break;
+
+        case OpKind::Drain:
+            queued = m_uring.QueueSplice(
+                userData,
+                chunk.m_pipe[0],
+                -1,
+                request.m_out,
+                offsetOf(request.m_outOffset, chunk.m_drained),
+                nBytes,
+                SPLICE_F_MOVE
+            );
+            break;
+
+        case OpKind::TeeDrain:
+            queued = m_uring.QueueSplice(
+                userData,
+                chunk.m_teePipe[0],
+                -1,
+                request.m_teeOut,
+                offsetOf(request.m_teeOffset, chunk.m_teeDrained),
+                nBytes,
+                SPLICE_F_MOVE
+            );
+            break;
+    }
+
+    if (not queued)
+    {
+        chunk.m_error = -EBUSY;
+        return;
+    }
+
+    chunk.m_inFlight++;
+    m_inFlight++;
+}
+
+void SpliceThread::ReapCompletions(const TimeNS& timeout)
+{
+    for (auto batch{ m_uring.WaitForEvents(timeout) }; not batch.empty(); batch = m_uring.PeekEvents())
+    {
+        for (const io_uring_cqe* uringEvent : batch)
+        {
+            if (uringEvent->user_data == IGNORED_USER_DATA)
+            {
+                continue;
+            }
+
+            m_inFlight--;
+            OnCompleteOp(*reinterpret_cast<ChunkOp*>(uringEvent->user_data), uringEvent->res);
+        }
+    }
+}
+
+void SpliceThread::OnCompleteOp(ChunkOp& op, int res)
+{
+    Chunk& chunk{ *op.m_chunk };
+    chunk.m_inFlight--;
+
+    // fills lead every chain, so a fill moving nothing hit the end of the input
+    const bool eof{ op.m_kind == OpKind::Fill and res == 0 };
+
+    // the rest of a chain after a short op, which Advance picks up again
+    if (res == -ECANCELED and not m_thread.get_stop_token().stop_requested())
+    {
+        res = 0;
+    }
+    else if (res < 0)
+    {
+        LOG_ERROR("splice op:{} failed. {}", static_cast<int>(op.m_kind), strerror(-res));
+        chunk.m_error = chunk.m_error == 0 ? res : chunk.m_error;
+        res = 0;
+    }
+
+    const auto nBytes{ static_cast<uint64_t>(res) };
+    switch (op.m_kind)
+    {
+        case OpKind::Fill:
+            chunk.m_eof = chunk.m_eof or eof;
+            chunk.m_filled += nBytes;
+            chunk.m_inPipe += nBytes;
+            chunk.m_teePending = nBytes > 0 and chunk.m_transfer->m_request.m_teeOut >= 0;
+            break;
+
+        case OpKind::Tee:
+            if (nBytes > 0)
+            {
+                chunk.m_teePending = false;
+            }
+            // the tee pipe is empty and as big as the pipe, so tee never moves less than it holds
+            if (nBytes > 0 and nBytes != chunk.m_inPipe)
+            {
+                chunk.m_error = chunk.m_error == 0 ? -EIO : chunk.m_error;
+            }
+            chunk.m_inTeePipe += nBytes;
+            break;
+
+        case OpKind::Drain:
+            chunk.m_drained += nBytes;
+            chunk.m_inPipe -= nBytes;
+            break;
+
+        case OpKind::TeeDrain:
+            chunk.m_teeDrained += nBytes;
+            chunk.m_inTeePipe -= nBytes;
+            break;
+    }
+
+    if (chunk.m_inFlight == 0)
+    {
+        Advance(chunk);
+    }
+}
+
+void SpliceThread::FinishChunk(Chunk& chunk)
+{
+    Transfer& transfer{ *chunk.m_transfer };
+    const bool wasHead{ chunk.m_offset == transfer.m_drainOffset };
+    if (wasHead)
+    {
+        transfer.m_drainOffset += chunk.m_length;
+    }
+
+    transfer.m_bytesDone += chunk.m_drained;
+    transfer.m_chunksInFlight--;
+    transfer.m_eof = transfer.m_eof or chunk.m_eof;
+    if (chunk.m_error != 0 and transfer.m_error == 0)
+    {
+        transfer.m_error = chunk.m_error;
+    }
+
+    // whatever a failure left behind in the pipes would end up in the next copy
+    bool reusable{ true };
+    if (chunk.m_inPipe > 0 or chunk.m_inTeePipe > 0)
+    {
+        ClosePipes(chunk);
+        reusable = OpenPipes(chunk);
+        chunk.m_inPipe = 0;
+        chunk.m_inTeePipe = 0;
+    }
+
+    chunk.m_transfer = nullptr;
+    if (reusable)
+    {
+        m_freeChunks.push_back(&chunk);
+    }
+    else
+    {
+        m_usableChunks--;
+        LOG_CRITICAL("splice thread is down to {} usable chunks", m_usableChunks);
+    }
+
+    // erased from the queue by the run loop, which may be walking it right now
+    transfer.m_finished = transfer.m_chunksInFlight == 0 and
+                          (transfer.m_error != 0 or transfer.m_eof or
+                           transfer.m_nextOffset >= transfer.m_request.m_length);
+    Report(transfer, transfer.m_finished);
+
+    if (wasHead or transfer.m_error != 0)
+    {
+        ResumeParked(transfer);
+    }
+}
+
+void SpliceThread::FailTransfers(int error)
+{
+    for (auto& transfer : m_transfers)
+    {
+        if (not transfer->m_finished)
+        {
+            transfer->m_error = transfer->m_error == 0 ? error : transfer->m_error;
+            transfer->m_finished = true;
+            Report(*transfer, true);
+        }
+    }
+    m_transfers.clear();
+}
+
+void SpliceThread::Report(Transfer& transfer, bool finished)
+{
+    const SpliceRequest& request{ transfer.m_request };
+    if (not finished and transfer.m_bytesDone - transfer.m_lastReported < request.m_progressEvery)
+    {
+        return;
+    }
+
+    transfer.m_lastReported = transfer.m_bytesDone;
+    const SpliceProgress progress{ .m_bytes = transfer.m_bytesDone,
+                                   .m_finished = finished,
+                                   .m_error = finished ? transfer.m_error : 0 };
+    request.m_replyTo->send(
+        std::make_unique<IOCompleteEvent>([cb = transfer.m_cb, progress](int) { (*cb)(progress); }, 0)
+    );
+}
+
+bool SpliceThread::OpenPipes(Chunk& chunk)
+{
+    if (pipe2(chunk.m_pipe, O_CLOEXEC) < 0 or pipe2(chunk.m_teePipe, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("failed to create splice pipes. {}", strerror(errno));
+        ClosePipes(chunk);
+        return false;
+    }
+
+    // a chunk has to fit in a pipe. Growing one past pipe-max-size needs privileges
+    for (const int fd : { chunk.m_pipe[1], chunk.m_teePipe[1] })
+    {
+        int size{ fcntl(fd, F_SETPIPE_SZ, static_cast<int>(m_chunkSize)) };
+        if (size < 0)
+        {
+            size = fcntl(fd, F_GETPIPE_SZ);
+        }
+
+        if (size > 0 and static_cast<size_t>(size) < m_chunkSize)
+        {
+            LOG_WARNING("splice pipes only grew to {} bytes of {}", size, m_chunkSize);
+            m_chunkSize = static_cast<size_t>(size);
+        }
+    }
+
+    return true;
+}
+
+void SpliceThread::ClosePipes(Chunk& chunk)
+{
+    for (int* fd : { &chunk.m_pipe[0], &chunk.m_pipe[1], &chunk.m_teePipe[0], &chunk.m_teePipe[1] })
+    {
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+} // namespace Sage
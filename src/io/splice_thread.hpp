@@ -0,0 +1,225 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+struct SpliceProgress
+{
+    // written to the output, and to the tee output too when there is one
+    uint64_t m_bytes{ 0 };
+    // nothing comes after the finished one
+    bool m_finished{ false };
+    // -errno when the copy failed
+    int m_error{ 0 };
+};
+
+// Runs on the owner's thread
+using SpliceProgressCb = std::move_only_function<void(const SpliceProgress& progress)>;
+
+// A copy on its way to the splice thread
+struct SpliceRequest
+{
+    int m_in;
+    int m_out;
+    // also gets everything written to out, through tee. -1 for none
+    int m_teeOut{ -1 };
+    uint64_t m_length;
+    // Where the copy starts in each fd, leaving the fd's own position alone. -1 for a stream, pipes and
+    // sockets, which move from wherever they are. A seekable input is copied a chunk per pipe side by
+    // side, a stream one chunk at a time. Stream outputs get the chunks in order
+    int64_t m_inOffset{ 0 };
+    int64_t m_outOffset{ 0 };
+    int64_t m_teeOffset{ 0 };
+    // bytes between progress reports. The finished report always comes
+    uint64_t m_progressEvery{ 64 << 20 };
+    std::shared_ptr<Channel::Tx<ThreadEvent>> m_replyTo;
+    SpliceProgressCb m_cb;
+};
+
+// Moves data between fds on its own ring without it ever entering user space. Each chunk is spliced
+// into a pipe and out again, with tee copying it to a second pipe on the way for a tee output.
+// The ops of a chunk go in as one linked chain, falling back to single ops after short transfers.
+// In-flight depth is bounded by the pipes, which all copies share. Progress comes back to the thread
+// given as replyTo, as IOCompleteEvents. The caller owns the fds and keeps them open until finished
+
+class SpliceThread
+{
+public:
+    using SharedThreadTx = std::shared_ptr<Channel::Tx<ThreadEvent>>;
+
+    static constexpr size_t DEFAULT_DEPTH{ 16 };
+    // the default most a pipe can be grown to without privileges
+    static constexpr size_t DEFAULT_CHUNK_SIZE{ 1 << 20 };
+
+    explicit SpliceThread(
+        size_t depth = DEFAULT_DEPTH,
+        size_t chunkSize = DEFAULT_CHUNK_SIZE,
+        // must always be last
+        Channel::ChannelPair<SpliceRequest> channel = Channel::MakeChannel<SpliceRequest>()
+    );
+
+    ~SpliceThread();
+
+    void Start() { m_startLatch.count_down(); }
+
+    // Cancels the copies left and waits a short while for their ops to complete
+    void Stop()
+    {
+        m_thread.request_stop();
+        m_stopLatch.wait();
+    }
+
+    // What the pipes could be grown to, which may be less than asked for
+    size_t ChunkSize() const noexcept { return m_chunkSize; }
+
+    void Copy(SpliceRequest request);
+
+private:
+    SpliceThread(const SpliceThread&) = delete;
+    SpliceThread(SpliceThread&&) = delete;
+    SpliceThread& operator=(const SpliceThread&) = delete;
+    SpliceThread& operator=(SpliceThread&&) = delete;
+
+    // A copy once it's running
+    struct Transfer
+    {
+        SpliceRequest m_request;
+        // shared by every progress event
+        std::shared_ptr<SpliceProgressCb> m_cb;
+        uint64_t m_nextOffset{ 0 };
+        uint64_t m_bytesDone{ 0 };
+        uint64_t m_lastReported{ 0 };
+        size_t m_chunksInFlight{ 0 };
+        // offset of the chunk whose turn it is to drain, with a stream output
+        uint64_t m_drainOffset{ 0 };
+        // the input ran out before m_length
+        bool m_eof{ false };
+        int m_error{ 0 };
+        // the finished report went out
+        bool m_finished{ false };
+    };
+
+    struct Chunk;
+
+    enum class OpKind
+    {
+        Fill,
+        Tee,
+        Drain,
+        TeeDrain
+    };
+
+    // the user data of an op in flight
+    struct ChunkOp
+    {
+        Chunk* m_chunk;
+        OpKind m_kind;
+    };
+
+    // One pipe, or two with a tee output, and the part of a copy going through them
+    struct Chunk
+    {
+        int m_pipe[2]{ -1, -1 };
+        int m_teePipe[2]{ -1, -1 };
+        std::array<ChunkOp, 4> m_ops{};
+        Transfer* m_transfer{ nullptr };
+        uint64_t m_offset{ 0 };
+        uint64_t m_length{ 0 };
+        uint64_t m_filled{ 0 };
+        uint64_t m_drained{ 0 };
+        uint64_t m_teeDrained{ 0 };
+        // in the pipes right now
+        uint64_t m_inPipe{ 0 };
+        uint64_t m_inTeePipe{ 0 };
+        // filled, but not yet copied to the tee pipe, which has to happen before draining
+        bool m_teePending{ false };
+        // filled, and waiting its turn at a stream output
+        bool m_parked{ false };
+        bool m_eof{ false };
+        int m_error{ 0 };
+        size_t m_inFlight{ 0 };
+    };
+
+    void Run(std::unique_ptr<Channel::Rx<SpliceRequest>> rx);
+
+    void HandleRequests(Channel::Rx<SpliceRequest>& rx, const TimeNS& timeout);
+
+    // Hands free chunks to copies with data left to start
+    void StartChunks();
+
+    // Queues the ops that move the chunk on, or finishes it
+    void Advance(Chunk& chunk);
+
+    // Fill, tee and drain linked, for when nothing is short. Chunks waiting their turn at a stream
+    // output only fill
+    void QueueRound(Chunk& chunk);
+
+    // Stream outputs take chunks in order, so only the oldest chunk of a copy may drain into them
+    static bool MayDrain(const Chunk& chunk) noexcept;
+
+    // Moves on the chunks of a copy that waited for the one just finished
+    void ResumeParked(Transfer& transfer);
+
+    void QueueOp(Chunk& chunk, OpKind kind, uint64_t len);
+
+    void ReapCompletions(const TimeNS& timeout);
+
+    void OnCompleteOp(ChunkOp& op, int res);
+
+    void FinishChunk(Chunk& chunk);
+
+    // Only every m_progressEvery bytes, unless finished
+    void Report(Transfer& transfer, bool finished);
+
+    // Finishes every copy left with error, unless it already failed
+    void FailTransfers(int error);
+
+    // Shrinks the chunk size to what the pipes could be grown to
+    bool OpenPipes(Chunk& chunk);
+
+    static void ClosePipes(Chunk& chunk);
+
+private:
+    // never an op's
+    static constexpr IOURing::UserData IGNORED_USER_DATA{ 0 };
+
+    size_t m_chunkSize;
+    // four ops per chunk at most
+    IOURing m_uring;
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    std::vector<Chunk*> m_freeChunks;
+    // chunks whose pipes could be opened. Copies fail once there are none
+    size_t m_usableChunks{ 0 };
+    // oldest first, and taking turns at free chunks
+    std::deque<std::unique_ptr<Transfer>> m_transfers;
+    // ops submitted to the ring that have not completed
+    size_t m_inFlight{ 0 };
+    std::shared_ptr<Channel::Tx<SpliceRequest>> m_tx;
+    std::latch m_startLatch{ 1 };
+    std::latch m_stopLatch{ 1 };
+    std::jthread m_thread;
+
+private:
+    // waiting on the channel alone, with nothing in flight
+    static constexpr TimeMS IDLE_WAIT_TIMEOUT{ 20ms };
+    // waiting on the ring while ops are in flight, before checking the channel again
+    static constexpr TimeUS BUSY_WAIT_TIMEOUT{ 200us };
+    static constexpr TimeMS STOP_DRAIN_TIMEOUT{ 1000ms };
+};
+
+} // namespace Sage
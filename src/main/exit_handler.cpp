@@ -49,9 +49,9 @@ std::jthread Create(ExitHandle&& theExitHandle)
             shutdownTick,
             [&]
             {
-                static const auto shutdownStart{ Clock::now() - shutdownTick };
+                static const auto shutdownStart{ RealClock::now() - shutdownTick };
 
-                auto now = Clock::now();
+                auto now = RealClock::now();
                 auto duration = std::chrono::duration_cast<TimeMS>(now - shutdownStart);
                 if (duration >= shutdownThreshold)
                 {
@@ -2,12 +2,15 @@
 
 #include <csignal>
 #include <iostream>
-#include <utility>
+#include <thread>
+#include <tuple>
 
 #include "log/logger.hpp"
 #include "main/exit_handler.hpp"
 #include "main/manager_thread.hpp"
+#include "main/work_dispatcher.hpp"
 #include "main/worker_thread.hpp"
+#include "timers/timer_service.hpp"
 #include "timers/timer_thread.hpp"
 
 using namespace Sage;
@@ -15,10 +18,14 @@ using namespace Sage;
 auto GetCliArgs(int argc, char** const argv)
 {
     static const option argOptions[]{
-        { "help",  no_argument,       nullptr, 'h' },
-        { "level", required_argument, nullptr, 'l' },
-        { "file",  required_argument, nullptr, 'f' },
-        { 0,       0,                 0,       0   }
+        { "help",         no_argument,       nullptr, 'h' },
+        { "level",        required_argument, nullptr, 'l' },
+        { "file",         required_argument, nullptr, 'f' },
+        { "dispatch",     required_argument, nullptr, 'd' },
+        { "virtual-time", no_argument,       nullptr, 'v' },
+        { "timer-wheel",  no_argument,       nullptr, 'w' },
+        { "timer-shards", required_argument, nullptr, 's' },
+        { 0,              0,                 0,       0   }
     };
 
     auto usage = [&argv]
@@ -33,6 +40,10 @@ auto GetCliArgs(int argc, char** const argv)
                   << "\n\t[optional] --level|-l "
                      "<t|trace|d|debug|i|info|w|warn|e|error|c|critical>"
                      "\n\t[optional] --file|-f <filename> "
+                     "\n\t[optional] --dispatch|-d <broadcast|round-robin|least-queue|p2c|hash>"
+                     "\n\t[optional] --virtual-time|-v "
+                     "\n\t[optional] --timer-wheel|-w "
+                     "\n\t[optional] --timer-shards|-s <n> (default: one per cpu)"
                      "\n\t[optional] --help|-h"
                   << std::endl;
     };
@@ -70,10 +81,14 @@ auto GetCliArgs(int argc, char** const argv)
 
     Logger::Level logLevel{ Logger::Info };
     std::string logFile;
+    DispatchStrategy dispatchStrategy{ DispatchStrategy::Broadcast };
+    bool virtualTime{ false };
+    TimerBackend timerBackend{ TimerBackend::URing };
+    size_t timerShards{ std::thread::hardware_concurrency() };
 
     int option;
     int optIndex;
-    while ((option = getopt_long(argc, argv, "hl:f:", argOptions, &optIndex)) != -1)
+    while ((option = getopt_long(argc, argv, "hl:f:d:vws:", argOptions, &optIndex)) != -1)
     {
         switch (option)
         {
@@ -90,6 +105,30 @@ auto GetCliArgs(int argc, char** const argv)
                 logFile = optarg;
                 break;
 
+            case 'd':
+            {
+                auto strategy{ ParseDispatchStrategy(optarg) };
+                if (not strategy.has_value())
+                {
+                    usage();
+                    std::exit(1);
+                }
+                dispatchStrategy = *strategy;
+                break;
+            }
+
+            case 'v':
+                virtualTime = true;
+                break;
+
+            case 'w':
+                timerBackend = TimerBackend::Wheel;
+                break;
+
+            case 's':
+                timerShards = std::stoul(optarg);
+                break;
+
             case '?':
             default:
                 usage();
@@ -98,7 +137,7 @@ auto GetCliArgs(int argc, char** const argv)
         }
     }
 
-    return std::make_pair(logLevel, logFile);
+    return std::make_tuple(logLevel, logFile, dispatchStrategy, virtualTime, timerBackend, timerShards);
 }
 
 int main(int argc, char** const argv)
@@ -107,25 +146,32 @@ int main(int argc, char** const argv)
 
     try
     {
-        auto [logLevel, logFile]{ GetCliArgs(argc, argv) };
+        auto [logLevel, logFile, dispatchStrategy, virtualTime, timerBackend, timerShards]{ GetCliArgs(argc, argv) };
 
         // Setup logging
         Logger::SetupLogger(logFile, logLevel);
 
         LOG_INFO("==== starting ====");
 
-        TimerThread* timerThreadPtr{ nullptr };
+        if (virtualTime)
+        {
+            // before any threads exist
+            LOG_INFO("running on virtual time");
+            Clock::EnableVirtualTime();
+        }
+
+        TimerService* timerServicePtr{ nullptr };
         ManagerThread* managerPtr{ nullptr };
         std::jthread exitHandler = ExitHandler::Create(
-            [&timerThreadPtr, &managerPtr]
+            [&timerServicePtr, &managerPtr]
             {
                 LOG_INFO("exit-handle triggered");
 
-                if (timerThreadPtr != nullptr)
+                if (timerServicePtr != nullptr)
                 {
                     // only stop it once
-                    timerThreadPtr->Stop();
-                    timerThreadPtr = nullptr;
+                    timerServicePtr->Stop();
+                    timerServicePtr = nullptr;
                 }
 
                 if (managerPtr != nullptr)
@@ -135,18 +181,19 @@ int main(int argc, char** const argv)
             }
         );
 
-        TimerThread timerThread;
-        timerThreadPtr = &timerThread;
+        TimerService timerService{ timerShards, timerBackend };
+        timerServicePtr = &timerService;
 
-        timerThread.Start();
+        timerService.Start();
 
-        ManagerThread manager{ timerThread };
+        ManagerThread manager{ timerService };
         managerPtr = &manager;
 
         manager.SetTransmitPeriod(20ms);
+        manager.SetDispatchStrategy(dispatchStrategy);
         manager.Start();
 
-        std::array workers{ WorkerThread{ timerThread }, WorkerThread{ timerThread } };
+        std::array workers{ WorkerThread{ timerService }, WorkerThread{ timerService } };
         for (auto& worker : workers)
         {
             worker.Start();
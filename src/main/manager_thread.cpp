@@ -13,12 +13,19 @@ enum ManagerTimerEvent
     TransmitWork
 };
 
-ManagerThread::ManagerThread(TimerThread& timerThread) : Thread{ "MngrThread", timerThread } {}
+ManagerThread::ManagerThread(TimerService& timerService) : Thread{ "MngrThread", timerService } {}
 
 void ManagerThread::AttachWorker(Thread* worker)
 {
     std::lock_guard lock{ m_workersMtx };
-    m_workers.emplace(worker);
+    m_dispatcher.Attach(worker);
+}
+
+void ManagerThread::SetDispatchStrategy(DispatchStrategy strategy)
+{
+    std::lock_guard lock{ m_workersMtx };
+    LOG_INFO("{} dispatch strategy set to {}", Name(), DispatchStrategyName(strategy));
+    m_dispatcher.SetStrategy(strategy);
 }
 
 void ManagerThread::RequestShutdown()
@@ -51,11 +58,11 @@ void ManagerThread::TryWaitForWorkersShutdown()
 {
     LOG_INFO("{} workers shutdown started", Name());
 
-    auto workerTeardownStart = Clock::now();
+    auto workerTeardownStart = RealClock::now();
     while (WorkersRunning())
     {
         std::this_thread::sleep_for(20ms);
-        auto now = Clock::now();
+        auto now = RealClock::now();
         auto duration = std::chrono::duration_cast<TimeMS>(now - workerTeardownStart);
 
         if (duration >= TEARDOWN_THRESHOLD)
@@ -78,11 +85,11 @@ void ManagerThread::TryWaitForManagerShutdown()
 {
     LOG_INFO("{} manager shutdown starting", Name());
 
-    auto managerTeardownStart = Clock::now();
+    auto managerTeardownStart = RealClock::now();
     while (IsRunning())
     {
         std::this_thread::sleep_for(20ms);
-        auto now = Clock::now();
+        auto now = RealClock::now();
         auto duration = std::chrono::duration_cast<TimeMS>(now - managerTeardownStart);
 
         if (duration >= TEARDOWN_THRESHOLD)
@@ -107,14 +114,64 @@ void ManagerThread::SendEventsToWorkers()
 
     LOG_RETURN_IF(m_workersTerminated, LOG_WARNING);
 
-    for (auto worker : m_workers)
+    const auto& workers{ m_dispatcher.Workers() };
+
+    if (m_dispatcher.Strategy() == DispatchStrategy::Broadcast)
     {
-        LOG_INFO("{} sending work to {}", Name(), worker->Name());
-        worker->TransmitEvent(std::make_unique<ManagerWorkerTestEvent>(m_testTimeout));
-        LOG_DEBUG("{} completed sending work to {}", Name(), worker->Name());
+        for (auto worker : workers)
+        {
+            LOG_INFO("{} sending work to {}", Name(), worker->Name());
+            SendWork(*worker, m_nextWorkKey++);
+            LOG_DEBUG("{} completed sending work to {}", Name(), worker->Name());
+        }
+        return;
+    }
+
+    // Same amount of work per tick as broadcast, but each unit goes to exactly one worker
+    for (size_t unit{ 0 }; unit < workers.size(); unit++)
+    {
+        const uint64_t key{ m_nextWorkKey++ };
+        Thread* worker{ m_dispatcher.Select(key) };
+        LOG_RETURN_IF(worker == nullptr, LOG_ERROR);
+
+        LOG_INFO(
+            "{} sending work key:{} to {} queue-depth:{} load:{}",
+            Name(),
+            key,
+            worker->Name(),
+            worker->QueueDepth(),
+            worker->LoadEstimate()
+        );
+        SendWork(*worker, key);
     }
 }
 
+void ManagerThread::SendWork(Thread& worker, uint64_t key)
+{
+    // workers this far behind get no more until they catch up
+    if (m_workReplies.InFlight() == MAX_WORK_IN_FLIGHT)
+    {
+        LOG_WARNING("{} n-in-flight:{} holding back work key:{}", Name(), MAX_WORK_IN_FLIGHT, key);
+        return;
+    }
+
+    m_workReplies.Request(
+        worker,
+        std::make_unique<ManagerWorkerTestEvent>(m_testTimeout, key),
+        DEFAULT_WORK_REPLY_TIMEOUT,
+        [this, key](WorkReplies::Result result)
+        {
+            if (not result.has_value())
+            {
+                LOG_WARNING("{} work key:{} {}", Name(), key, ReplyErrorName(result.error()));
+                return;
+            }
+
+            LOG_DEBUG("{} work key:{} done took:{}", Name(), key, *result);
+        }
+    );
+}
+
 void ManagerThread::TeardownWorkers()
 {
     std::lock_guard lock{ m_workersMtx };
@@ -127,7 +184,7 @@ void ManagerThread::TeardownWorkers()
     StopTimer(m_transmitTimerId);
 
     LOG_INFO("{} tearing down all workers", Name());
-    for (auto worker : m_workers)
+    for (auto worker : m_dispatcher.Workers())
     {
         LOG_INFO("{} stopping {}", Name(), worker->Name());
         worker->Stop();
@@ -150,15 +207,29 @@ bool ManagerThread::WorkersRunning()
 {
     std::lock_guard lock{ m_workersMtx };
 
+    const auto& workers{ m_dispatcher.Workers() };
     bool aWorkerIsRunning =
-        std::any_of(m_workers.cbegin(), m_workers.cend(), [](const Thread* worker) { return worker->IsRunning(); });
+        std::any_of(workers.cbegin(), workers.cend(), [](const Thread* worker) { return worker->IsRunning(); });
     return aWorkerIsRunning;
 }
 
 void ManagerThread::Starting()
 {
     LOG_INFO("{} setting up periodic timer for self transmitting", Name());
-    m_transmitTimerId = StartTimer("Manager-Transmit", m_transmitPeriod, [this] { SendEventsToWorkers(); });
+    // a late manager sends one round of work rather than a burst of them
+    m_transmitTimerId = StartTimer(
+        "Manager-Transmit",
+        m_transmitPeriod,
+        TimerOverrunPolicy::Coalesce,
+        [this](size_t nMissed)
+        {
+            if (nMissed > 0)
+            {
+                LOG_WARNING("{} transmit timer overran n-missed:{}", Name(), nMissed);
+            }
+            SendEventsToWorkers();
+        }
+    );
 }
 
 void ManagerThread::HandleEvent(UniqueThreadEvent threadEvent)
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <semaphore>
-#include <set>
 
+#include "main/work_dispatcher.hpp"
 #include "threading/events.hpp"
+#include "threading/request_reply.hpp"
 #include "threading/thread.hpp"
 #include "timers/time_utils.hpp"
 
@@ -18,8 +20,7 @@ class ManagerEvent : public ThreadEvent
 public:
     enum Event
     {
-        Shutdown,
-        WorkerTest
+        Shutdown
     };
 
     virtual ~ManagerEvent() override = default;
@@ -39,16 +40,21 @@ public:
     ManagerShutdownEvent() : ManagerEvent{ Event::Shutdown, EventReceiver::ManagerThread } {}
 };
 
-class ManagerWorkerTestEvent final : public ManagerEvent
+// The work workers get. They reply with how long it took
+
+class ManagerWorkerTestEvent final : public RequestEvent<TimeNS>
 {
 public:
-    explicit ManagerWorkerTestEvent(const TimeMS& timeout) :
-        ManagerEvent{ Event::WorkerTest, EventReceiver::WorkerThread },
-        m_timeout{ timeout }
+    ManagerWorkerTestEvent(const TimeMS& timeout, uint64_t key) :
+        RequestEvent<TimeNS>{ EventReceiver::WorkerThread },
+        m_timeout{ timeout },
+        m_key{ key }
     {
     }
 
     TimeMS m_timeout;
+    // affinity key for the unit of work
+    uint64_t m_key;
 };
 
 // Manager thread
@@ -59,9 +65,12 @@ public:
     static constexpr inline TimeMS TEARDOWN_THRESHOLD{ 1000ms };
     static constexpr inline TimeMS DEFAULT_TEST_TIMEOUT{ 10ms };
     static constexpr inline TimeMS DEFAULT_TRANSMIT_PERIOD{ 15ms };
+    static constexpr inline TimeMS DEFAULT_WORK_REPLY_TIMEOUT{ 1000ms };
+    // units of work sent without a reply yet. Work is held back beyond this
+    static constexpr inline size_t MAX_WORK_IN_FLIGHT{ 256 };
 
 public:
-    explicit ManagerThread(TimerThread& timerThread);
+    explicit ManagerThread(TimerService& timerService);
 
     void AttachWorker(Thread* worker);
 
@@ -71,9 +80,15 @@ public:
 
     void SetTransmitPeriod(const TimeMS& period) { m_transmitPeriod = period; }
 
+    void SetDispatchStrategy(DispatchStrategy strategy);
+
 private:
+    using WorkReplies = ReplySlotPool<TimeNS, MAX_WORK_IN_FLIGHT>;
+
     void SendEventsToWorkers();
 
+    void SendWork(Thread& worker, uint64_t key);
+
     void TeardownWorkers();
 
     void TryWaitForWorkersShutdown();
@@ -89,7 +104,7 @@ private:
     void HandleEvent(UniqueThreadEvent event) override;
 
 private:
-    std::set<Thread*> m_workers{};
+    WorkDispatcher m_dispatcher{};
     std::mutex m_workersMtx{};
     std::atomic<bool> m_workersTerminated{ false };
     std::binary_semaphore m_shutdownInitiateSignal{ 0 };
@@ -97,6 +112,8 @@ private:
     TimerEventId m_transmitTimerId{ 0 };
     TimeMS m_transmitPeriod{ DEFAULT_TRANSMIT_PERIOD };
     TimeMS m_testTimeout{ DEFAULT_TEST_TIMEOUT };
+    uint64_t m_nextWorkKey{ 0 };
+    WorkReplies m_workReplies{ *this };
 };
 
 } // namespace Sage
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <bit>
+
+#include "log/logger.hpp"
+#include "main/work_dispatcher.hpp"
+
+namespace Sage
+{
+
+namespace
+{
+
+// splitmix64 finaliser. Cheap and well mixed, std::hash is the identity for integers
+constexpr uint64_t MixHash(uint64_t value) noexcept
+{
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+std::optional<DispatchStrategy> ParseDispatchStrategy(std::string_view name) noexcept
+{
+    for (auto strategy : { DispatchStrategy::Broadcast,
+                           DispatchStrategy::RoundRobin,
+                           DispatchStrategy::LeastQueueDepth,
+                           DispatchStrategy::PowerOfTwoChoices,
+                           DispatchStrategy::ConsistentHash })
+    {
+        if (DispatchStrategyName(strategy) == name)
+        {
+            return strategy;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void WorkDispatcher::Attach(Thread* worker)
+{
+    LOG_RETURN_IF(worker == nullptr, LOG_ERROR);
+
+    if (std::find(m_workers.cbegin(), m_workers.cend(), worker) != m_workers.cend())
+    {
+        LOG_WARNING("worker {} already attached", worker->Name());
+        return;
+    }
+
+    m_workers.emplace_back(worker);
+    RebuildHashRing();
+}
+
+Thread* WorkDispatcher::Select(uint64_t key)
+{
+    if (m_workers.empty())
+    {
+        return nullptr;
+    }
+
+    switch (m_strategy)
+    {
+        case DispatchStrategy::LeastQueueDepth:
+            return SelectLeastQueueDepth();
+
+        case DispatchStrategy::PowerOfTwoChoices:
+            return SelectPowerOfTwoChoices();
+
+        case DispatchStrategy::ConsistentHash:
+            return SelectConsistentHash(key);
+
+        case DispatchStrategy::Broadcast:
+        case DispatchStrategy::RoundRobin:
+        default:
+            return SelectRoundRobin();
+    }
+}
+
+Thread* WorkDispatcher::SelectRoundRobin() noexcept
+{
+    Thread* worker{ m_workers[m_nextWorker % m_workers.size()] };
+    m_nextWorker++;
+    return worker;
+}
+
+Thread* WorkDispatcher::SelectLeastQueueDepth() const noexcept
+{
+    return *std::min_element(
+        m_workers.cbegin(),
+        m_workers.cend(),
+        [](const Thread* lhs, const Thread* rhs) { return lhs->QueueDepth() < rhs->QueueDepth(); }
+    );
+}
+
+Thread* WorkDispatcher::SelectPowerOfTwoChoices()
+{
+    if (m_workers.size() == 1)
+    {
+        return m_workers.front();
+    }
+
+    // two distinct workers, picked uniformly
+    std::uniform_int_distribution<size_t> firstDist{ 0, m_workers.size() - 1 };
+    std::uniform_int_distribution<size_t> secondDist{ 0, m_workers.size() - 2 };
+    const size_t first{ firstDist(m_rng) };
+    size_t second{ secondDist(m_rng) };
+    if (second >= first)
+    {
+        second++;
+    }
+
+    Thread* lhs{ m_workers[first] };
+    Thread* rhs{ m_workers[second] };
+
+    const auto lhsLoad{ lhs->LoadEstimate() };
+    const auto rhsLoad{ rhs->LoadEstimate() };
+    if (lhsLoad != rhsLoad)
+    {
+        return lhsLoad < rhsLoad ? lhs : rhs;
+    }
+
+    // no handle time history yet. fallback to queue depth
+    return lhs->QueueDepth() <= rhs->QueueDepth() ? lhs : rhs;
+}
+
+Thread* WorkDispatcher::SelectConsistentHash(uint64_t key) const noexcept
+{
+    const uint64_t hash{ MixHash(key) };
+    auto itr{ std::lower_bound(
+        m_hashRing.cbegin(),
+        m_hashRing.cend(),
+        hash,
+        [](const std::pair<uint64_t, Thread*>& node, uint64_t h) { return node.first < h; }
+    ) };
+
+    // wrap around the ring
+    if (itr == m_hashRing.cend())
+    {
+        itr = m_hashRing.cbegin();
+    }
+
+    return itr->second;
+}
+
+void WorkDispatcher::RebuildHashRing()
+{
+    m_hashRing.clear();
+    m_hashRing.reserve(m_workers.size() * VIRTUAL_NODES_PER_WORKER);
+
+    for (Thread* worker : m_workers)
+    {
+        // hash on the name so placement is stable across runs
+        const uint64_t workerHash{ std::hash<std::string>{}(worker->Name()) };
+        for (uint64_t node{ 0 }; node < VIRTUAL_NODES_PER_WORKER; node++)
+        {
+            m_hashRing.emplace_back(MixHash(workerHash ^ std::rotl(node, 32)), worker);
+        }
+    }
+
+    std::sort(m_hashRing.begin(), m_hashRing.end());
+}
+
+} // namespace Sage
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "threading/thread.hpp"
+
+namespace Sage
+{
+
+enum class DispatchStrategy
+{
+    Broadcast,         // every worker gets a copy of the work
+    RoundRobin,        // workers take turns
+    LeastQueueDepth,   // worker with the fewest outstanding events
+    PowerOfTwoChoices, // lower load estimate of two randomly sampled workers
+    ConsistentHash     // same key always lands on the same worker
+};
+
+constexpr std::string_view DispatchStrategyName(DispatchStrategy strategy) noexcept
+{
+    switch (strategy)
+    {
+        case DispatchStrategy::Broadcast:
+            return "broadcast";
+        case DispatchStrategy::RoundRobin:
+            return "round-robin";
+        case DispatchStrategy::LeastQueueDepth:
+            return "least-queue";
+        case DispatchStrategy::PowerOfTwoChoices:
+            return "p2c";
+        case DispatchStrategy::ConsistentHash:
+            return "hash";
+        default:
+            return "unknown";
+    }
+}
+
+std::optional<DispatchStrategy> ParseDispatchStrategy(std::string_view name) noexcept;
+
+// Routes units of work to attached workers. Not thread safe, the owner is expected to serialise access
+
+class WorkDispatcher
+{
+public:
+    explicit WorkDispatcher(DispatchStrategy strategy = DispatchStrategy::Broadcast) : m_strategy{ strategy } {}
+
+    DispatchStrategy Strategy() const noexcept { return m_strategy; }
+
+    void SetStrategy(DispatchStrategy strategy) noexcept { m_strategy = strategy; }
+
+    void Attach(Thread* worker);
+
+    const std::vector<Thread*>& Workers() const noexcept { return m_workers; }
+
+    // Worker that should handle the unit of work for key. nullptr when there are no workers.
+    // Broadcast has no single target and falls back to round robin
+    Thread* Select(uint64_t key);
+
+private:
+    Thread* SelectRoundRobin() noexcept;
+
+    Thread* SelectLeastQueueDepth() const noexcept;
+
+    Thread* SelectPowerOfTwoChoices();
+
+    Thread* SelectConsistentHash(uint64_t key) const noexcept;
+
+    void RebuildHashRing();
+
+private:
+    DispatchStrategy m_strategy;
+    std::vector<Thread*> m_workers{};
+    // sorted by hash
+    std::vector<std::pair<uint64_t, Thread*>> m_hashRing{};
+    size_t m_nextWorker{ 0 };
+    std::minstd_rand m_rng{ std::random_device{}() };
+
+private:
+    // points per worker on the hash ring, smooths out the key distribution
+    static constexpr uint64_t VIRTUAL_NODES_PER_WORKER{ 64 };
+};
+
+} // namespace Sage
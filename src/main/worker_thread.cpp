@@ -7,8 +7,8 @@ namespace Sage
 
 // Worker thread
 
-WorkerThread::WorkerThread(TimerThread& timerThread) :
-    Thread{ std::string("WkrThread-") + std::to_string(++s_id), timerThread }
+WorkerThread::WorkerThread(TimerService& timerService) :
+    Thread{ std::string("WkrThread-") + std::to_string(++s_id), timerService }
 {
 }
 
@@ -16,23 +16,13 @@ void WorkerThread::HandleEvent(UniqueThreadEvent threadEvent)
 {
     LOG_RETURN_IF(threadEvent->Receiver() != EventReceiver::WorkerThread, LOG_ERROR);
 
-    auto& event = static_cast<ManagerEvent&>(*threadEvent);
-    switch (event.Type())
-    {
-        case ManagerEvent::WorkerTest:
-        {
-            auto& rxEvent = static_cast<ManagerWorkerTestEvent&>(event);
-            LOG_INFO("{} handle-event 'Test'. sleeping for {}", Name(), rxEvent.m_timeout);
-            std::this_thread::sleep_for(rxEvent.m_timeout);
-            break;
-        }
+    // the only work a worker is sent
+    auto& rxEvent = static_cast<ManagerWorkerTestEvent&>(*threadEvent);
+    LOG_INFO("{} handle-event 'Test' key:{}. sleeping for {}", Name(), rxEvent.m_key, rxEvent.m_timeout);
 
-        default:
-        {
-            LOG_ERROR("{} handle-event unknown event:{}", Name(), static_cast<int>(event.Type()));
-            break;
-        }
-    }
+    const auto start{ RealClock::now() };
+    std::this_thread::sleep_for(rxEvent.m_timeout);
+    rxEvent.Reply(RealClock::now() - start);
 }
 
 } // namespace Sage
@@ -10,7 +10,7 @@ namespace Sage
 class WorkerThread final : public Thread
 {
 public:
-    explicit WorkerThread(TimerThread& timerThread);
+    explicit WorkerThread(TimerService& timerService);
 
 private:
     void HandleEvent(UniqueThreadEvent threadEvent) override;
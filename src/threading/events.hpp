@@ -1,10 +1,14 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <functional>
 #include <string_view>
 #include <sys/types.h>
+#include <vector>
 
 #include "channel/channel.hpp"
+#include "threading/pooled_event.hpp"
 
 namespace Sage
 {
@@ -17,6 +21,15 @@ class ThreadEvent;
 
 using TimerEventId = ssize_t;
 
+// Runs on the timer thread itself, so it has to be quick and must not throw
+using InlineTimerCb = std::move_only_function<void() noexcept>;
+
+// Builds the event a send timer delivers on each expiry. Also runs on the timer thread
+using ThreadEventFactory = std::move_only_function<std::unique_ptr<ThreadEvent>()>;
+
+// A receiving thread's count of events queued for it
+using SharedQueueDepth = std::shared_ptr<std::atomic<size_t>>;
+
 struct TimerEvent
 {
     virtual ~TimerEvent() noexcept = default;
@@ -47,12 +60,32 @@ struct TimerEvent
     }
 };
 
+enum class TimerMode
+{
+    Periodic, // fires every timeout until stopped
+    OneShot,  // fires once, timeout from now
+    Deadline, // fires once at an absolute point on the steady clock
+    Cadence   // fires at anchor + k * timeout, for every k from now on
+};
+
 struct TimerAddEvent : TimerEvent
 {
     EventType Type() const noexcept override { return Add; }
 
+    TimerMode m_mode{ TimerMode::Periodic };
     TimeNS m_timeout;
+    // deadline timers, or where a cadence's grid starts
+    Clock::time_point m_deadline;
+    // how late the timer may fire, so it can share a wakeup with others
+    TimeNS m_slack{ 0 };
     std::shared_ptr<Channel::Tx<ThreadEvent>> m_tx;
+    // inline timers only. run in place of an expiry for as long as they stay within budget
+    InlineTimerCb m_inlineCb{};
+    TimeNS m_inlineBudget{ 0 };
+    // send timers only. each expiry sends what this builds straight to m_tx
+    ThreadEventFactory m_makeEvent{};
+    // send timers only, optional. counts each event delivered to m_tx
+    SharedQueueDepth m_queueDepth{};
 };
 
 struct TimerUpdateEvent : TimerEvent
@@ -68,6 +101,8 @@ struct TimerStopEvent : TimerEvent
     EventType Type() const noexcept override { return Stop; }
 
     TimerEventId m_timerToStop;
+    // one-shot timers drop themselves once fired, so missing one is expected
+    bool m_oneShot{ false };
 };
 
 // Event dispatching
@@ -76,6 +111,9 @@ enum class EventReceiver
 {
     Self, // loop back events
     TimerExpired,
+    TimerTick,  // a single expiry from one of the receiving thread's own high res timers
+    Reply,      // replies to requests made by the receiving thread
+    IOComplete, // async io submitted by the receiving thread has completed
     ManagerThread,
     WorkerThread
 };
@@ -95,6 +133,12 @@ public:
                 return "Self";
             case EventReceiver::TimerExpired:
                 return "Timer";
+            case EventReceiver::TimerTick:
+                return "TimerTick";
+            case EventReceiver::Reply:
+                return "Reply";
+            case EventReceiver::IOComplete:
+                return "IOComplete";
             case EventReceiver::ManagerThread:
                 return "ManagerThread";
             case EventReceiver::WorkerThread:
@@ -118,7 +162,8 @@ class SelfEvent : public ThreadEvent
 public:
     enum Event
     {
-        Exit
+        Exit,
+        TimerDemoted
     };
 
     virtual ~SelfEvent() override = default;
@@ -138,17 +183,81 @@ public:
     ExitEvent() : SelfEvent{ Event::Exit } {}
 };
 
-class TimerExpiredEvent final : public ThreadEvent
+// An inline timer overran its budget. Its callback comes back to run on the owning thread,
+// like any other timer's, and its expiries follow
+
+class TimerDemotedEvent final : public SelfEvent
 {
 public:
+    TimerDemotedEvent(TimerEventId id, InlineTimerCb&& cb) :
+        SelfEvent{ Event::TimerDemoted },
+        m_id{ id },
+        m_cb{ std::move(cb) }
+    {
+    }
 
-    explicit TimerExpiredEvent(TimerEventId timerEvent) :
+    const TimerEventId m_id;
+    InlineTimerCb m_cb;
+};
+
+struct TimerExpiry
+{
+    TimerEventId m_id;
+    // when the expiry was due, before any slack. the receiver can measure lateness against it
+    Clock::time_point m_scheduled;
+    // periods before this one that the timer thread was too late to deliver
+    uint32_t m_missed{ 0 };
+    // cadence timers only, k in anchor + k * period. timers on the same grid share it
+    uint64_t m_phase{ 0 };
+};
+
+// Every expiry for one thread from a single timer thread pass
+
+class TimerExpiredEvent final : public ThreadEvent, public PooledEvent<TimerExpiredEvent>
+{
+public:
+    explicit TimerExpiredEvent(std::vector<TimerExpiry>&& expiries) :
         ThreadEvent{ EventReceiver::TimerExpired },
-        m_timerId{ timerEvent }
+        m_expiries{ std::move(expiries) }
     {
     }
 
-    TimerEventId m_timerId;
+    std::vector<TimerExpiry> m_expiries;
+};
+
+// One expiry, for timers that post each tick as it comes due. Pooled and without a vector, so a tick
+// allocates nothing
+
+class TimerTickEvent final : public ThreadEvent, public PooledEvent<TimerTickEvent>
+{
+public:
+    explicit TimerTickEvent(const TimerExpiry& expiry) : ThreadEvent{ EventReceiver::TimerTick }, m_expiry{ expiry } {}
+
+    const TimerExpiry m_expiry;
+};
+
+// Async io dispatching
+
+// res is the op's result as the kernel gave it, bytes transferred or a new fd, or -errno
+using IOCompleteCb = std::move_only_function<void(int res)>;
+
+// Runs an async op's completion callback on the thread that submitted it
+
+class IOCompleteEvent final : public ThreadEvent, public PooledEvent<IOCompleteEvent>
+{
+public:
+    IOCompleteEvent(IOCompleteCb&& cb, int res) :
+        ThreadEvent{ EventReceiver::IOComplete },
+        m_cb{ std::move(cb) },
+        m_res{ res }
+    {
+    }
+
+    void Complete() { m_cb(m_res); }
+
+private:
+    IOCompleteCb m_cb;
+    const int m_res;
 };
 
 } // namespace Sage
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+namespace Sage
+{
+
+// Fixed capacity free list of equally sized blocks. Safe to acquire and release from any thread
+
+template<size_t BLOCK_SIZE, size_t BLOCK_ALIGN, size_t CAPACITY> class BlockPool final
+{
+public:
+    BlockPool() noexcept
+    {
+        for (size_t i{ 0 }; i < CAPACITY; i++)
+        {
+            m_freeBlocks[i] = static_cast<uint32_t>(CAPACITY - 1 - i);
+        }
+    }
+
+    void* Acquire() noexcept
+    {
+        std::scoped_lock lk{ m_mtx };
+        if (m_nFree == 0)
+        {
+            return nullptr;
+        }
+
+        return m_blocks[m_freeBlocks[--m_nFree]].m_data;
+    }
+
+    // false if the block was not handed out by this pool
+    bool Release(void* ptr) noexcept
+    {
+        const auto* block{ static_cast<const std::byte*>(ptr) };
+        const auto* first{ m_blocks.front().m_data };
+        const auto* last{ m_blocks.back().m_data };
+        if (block < first or block > last)
+        {
+            return false;
+        }
+
+        const auto index{ static_cast<uint32_t>(static_cast<size_t>(block - first) / sizeof(Block)) };
+
+        std::scoped_lock lk{ m_mtx };
+        m_freeBlocks[m_nFree++] = index;
+        return true;
+    }
+
+private:
+    BlockPool(const BlockPool&) = delete;
+    BlockPool(BlockPool&&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+    BlockPool& operator=(BlockPool&&) = delete;
+
+    struct alignas(BLOCK_ALIGN) Block
+    {
+        std::byte m_data[BLOCK_SIZE];
+    };
+
+    std::array<Block, CAPACITY> m_blocks{};
+    std::array<uint32_t, CAPACITY> m_freeBlocks{};
+    size_t m_nFree{ CAPACITY };
+    std::mutex m_mtx{};
+};
+
+// Mixin for events that are sent frequently. Allocations are served from a per type pool
+// and only hit the heap once the pool is exhausted, or for larger derived types.
+
+template<typename Derived, size_t CAPACITY = 1024> class PooledEvent
+{
+public:
+    static void* operator new(std::size_t size)
+    {
+        if (size <= sizeof(Derived))
+        {
+            if (void* block{ Pool().Acquire() }; block != nullptr)
+            {
+                return block;
+            }
+        }
+
+        return ::operator new(size);
+    }
+
+    static void operator delete(void* ptr) noexcept
+    {
+        if (not Pool().Release(ptr))
+        {
+            ::operator delete(ptr);
+        }
+    }
+
+private:
+    static auto& Pool() noexcept
+    {
+        // Derived is only complete once this is instantiated
+        using Blocks = BlockPool<sizeof(Derived), alignof(Derived), CAPACITY>;
+
+        // Intentionally leaking. Events may still be released during static destruction
+        static Blocks* const s_pool{ new Blocks };
+        return *s_pool;
+    }
+};
+
+} // namespace Sage
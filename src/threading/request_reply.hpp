@@ -0,0 +1,397 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "channel/channel.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "threading/pooled_event.hpp"
+#include "threading/thread.hpp"
+#include "timers/time_utils.hpp"
+
+namespace Sage
+{
+
+enum class ReplyError
+{
+    TimedOut,     // no reply before the request timeout
+    Dropped,      // request was destroyed without a reply
+    PoolExhausted // no free reply slot to send the request with
+};
+
+constexpr std::string_view ReplyErrorName(ReplyError error) noexcept
+{
+    switch (error)
+    {
+        case ReplyError::TimedOut:
+            return "timed-out";
+        case ReplyError::Dropped:
+            return "dropped";
+        case ReplyError::PoolExhausted:
+            return "pool-exhausted";
+        default:
+            return "unknown";
+    }
+}
+
+// Completes replies on the requesting thread's loop
+
+class ReplySink
+{
+public:
+    virtual void CompleteReply(uint32_t slotIndex, uint32_t generation) = 0;
+
+protected:
+    ~ReplySink() = default;
+};
+
+template<typename Resp> class ReplySlots : public ReplySink
+{
+public:
+    using Result = std::expected<Resp, ReplyError>;
+
+    // Called from the responding thread. false if the slot no longer waits on this reply
+    virtual bool Fulfil(uint32_t slotIndex, uint32_t generation, Result&& result) = 0;
+
+protected:
+    ~ReplySlots() = default;
+};
+
+// Notifies the requester that its reply slot has been filled.
+// Carries no payload, the reply itself lives in the slot.
+
+class ReplyEvent final : public ThreadEvent, public PooledEvent<ReplyEvent>
+{
+public:
+    ReplyEvent(ReplySink& sink, uint32_t slotIndex, uint32_t generation) :
+        ThreadEvent{ EventReceiver::Reply },
+        m_sink{ sink },
+        m_slotIndex{ slotIndex },
+        m_generation{ generation }
+    {
+    }
+
+    void Complete() const { m_sink.CompleteReply(m_slotIndex, m_generation); }
+
+private:
+    ReplySink& m_sink;
+    const uint32_t m_slotIndex;
+    const uint32_t m_generation;
+};
+
+// Base for request events that expect a reply of type Resp.
+// The responder calls Reply() from its HandleEvent. A request destroyed without a reply completes as Dropped
+
+template<typename Resp> class RequestEvent : public ThreadEvent
+{
+public:
+    virtual ~RequestEvent() override
+    {
+        if (m_slots != nullptr)
+        {
+            Complete(std::unexpected(ReplyError::Dropped));
+        }
+    }
+
+    bool Reply(Resp value) { return Complete(std::move(value)); }
+
+protected:
+    explicit RequestEvent(EventReceiver receiver) : ThreadEvent{ receiver } {}
+
+private:
+    bool Complete(typename ReplySlots<Resp>::Result&& result)
+    {
+        LOG_RETURN_FALSE_IF(m_slots == nullptr, LOG_ERROR);
+
+        // only ever complete once
+        ReplySlots<Resp>* slots{ std::exchange(m_slots, nullptr) };
+        if (not slots->Fulfil(m_slotIndex, m_generation, std::move(result)))
+        {
+            LOG_DEBUG("late reply for slot:{} generation:{}", m_slotIndex, m_generation);
+            return false;
+        }
+
+        m_replyTx->send(std::make_unique<ReplyEvent>(*slots, m_slotIndex, m_generation));
+        return true;
+    }
+
+private:
+    template<typename, size_t> friend class ReplySlotPool;
+
+    ReplySlots<Resp>* m_slots{ nullptr };
+    uint32_t m_slotIndex{ 0 };
+    uint32_t m_generation{ 0 };
+    std::shared_ptr<Channel::Tx<ThreadEvent>> m_replyTx{ nullptr };
+};
+
+// Fixed set of reply slots owned by a requesting thread.
+// Requests, timeouts and reply callbacks must all happen on the owner thread, and so must destroying it.
+// The pool must outlive any requests it has in flight.
+// Timeouts are swept by one periodic timer started with the first request, so a request never starts or
+// stops a timer of its own. They complete up to timeoutGrain late
+
+template<typename Resp, size_t CAPACITY = 64> class ReplySlotPool final : public ReplySlots<Resp>
+{
+public:
+    using Result = typename ReplySlots<Resp>::Result;
+    using ReplyCb = std::move_only_function<void(Result)>;
+
+    static constexpr TimeMS DEFAULT_TIMEOUT_GRAIN{ 10ms };
+
+    class Awaiter;
+
+    explicit ReplySlotPool(Thread& owner, const TimeMS& timeoutGrain = DEFAULT_TIMEOUT_GRAIN) :
+        m_owner{ owner },
+        m_timeoutGrain{ std::max(timeoutGrain, TimeMS{ 1 }) }
+    {
+        for (size_t i{ 0 }; i < CAPACITY; i++)
+        {
+            m_freeSlots[i] = static_cast<uint32_t>(CAPACITY - 1 - i);
+        }
+    }
+
+    ~ReplySlotPool()
+    {
+        // an owner that has exited already stopped all of its timers
+        if (m_sweepTimer != 0 and m_owner.IsRunning())
+        {
+            m_owner.StopTimer(m_sweepTimer);
+        }
+    }
+
+    size_t InFlight() const noexcept { return CAPACITY - m_nFree; }
+
+    // Reply or error is delivered to cb on the owner's loop. false if no slot was free
+    template<typename Req>
+    bool Request(Thread& target, std::unique_ptr<Req> request, const TimeMS& timeout, ReplyCb cb)
+    {
+        static_assert(std::is_base_of_v<RequestEvent<Resp>, Req>, "requests must derive from RequestEvent<Resp>");
+        LOG_RETURN_FALSE_IF(m_nFree == 0, LOG_ERROR);
+
+        const uint32_t slotIndex{ m_freeSlots[--m_nFree] };
+        Slot& slot{ m_slots[slotIndex] };
+        const uint32_t generation{ Generation(slot.m_state.load(std::memory_order_relaxed)) + 1 };
+        slot.m_state.store(PackState(generation, SlotState::Pending), std::memory_order_release);
+        slot.m_cb = std::move(cb);
+        slot.m_deadline = Clock::now() + timeout;
+
+        if (m_sweepTimer == 0) [[unlikely]]
+        {
+            m_sweepTimer = m_owner.StartTimer("reply-timeouts", m_timeoutGrain, [this] { SweepTimeouts(); });
+        }
+
+        request->m_slots = this;
+        request->m_slotIndex = slotIndex;
+        request->m_generation = generation;
+        request->m_replyTx = m_owner.m_tx;
+
+        target.TransmitEvent(std::move(request));
+        return true;
+    }
+
+    // co_await-able variant of Request. Resumes on the owner's loop
+    template<typename Req> Awaiter RequestAsync(Thread& target, std::unique_ptr<Req> request, const TimeMS& timeout)
+    {
+        static_assert(std::is_base_of_v<RequestEvent<Resp>, Req>, "requests must derive from RequestEvent<Resp>");
+        return Awaiter{ *this, target, std::move(request), timeout };
+    }
+
+private:
+    ReplySlotPool(const ReplySlotPool&) = delete;
+    ReplySlotPool(ReplySlotPool&&) = delete;
+    ReplySlotPool& operator=(const ReplySlotPool&) = delete;
+    ReplySlotPool& operator=(ReplySlotPool&&) = delete;
+
+    enum class SlotState : uint64_t
+    {
+        Free,
+        Pending,
+        Filling,
+        Filled
+    };
+
+    struct Slot
+    {
+        // generation and state packed together so a stale reply can never claim a reused slot
+        std::atomic<uint64_t> m_state{ 0 };
+        std::optional<Result> m_result{};
+        ReplyCb m_cb{};
+        Clock::time_point m_deadline{};
+    };
+
+    static constexpr uint64_t PackState(uint32_t generation, SlotState state) noexcept
+    {
+        return (static_cast<uint64_t>(generation) << 2) | static_cast<uint64_t>(state);
+    }
+
+    static constexpr uint32_t Generation(uint64_t packed) noexcept { return static_cast<uint32_t>(packed >> 2); }
+
+    bool Fulfil(uint32_t slotIndex, uint32_t generation, Result&& result) override
+    {
+        LOG_RETURN_FALSE_IF(slotIndex >= CAPACITY, LOG_CRITICAL);
+
+        Slot& slot{ m_slots[slotIndex] };
+        uint64_t expected{ PackState(generation, SlotState::Pending) };
+        if (not slot.m_state.compare_exchange_strong(
+                expected, PackState(generation, SlotState::Filling), std::memory_order_acquire
+            ))
+        {
+            return false;
+        }
+
+        slot.m_result = std::move(result);
+        slot.m_state.store(PackState(generation, SlotState::Filled), std::memory_order_release);
+        return true;
+    }
+
+    void CompleteReply(uint32_t slotIndex, uint32_t generation) override
+    {
+        LOG_RETURN_IF(slotIndex >= CAPACITY, LOG_CRITICAL);
+
+        Slot& slot{ m_slots[slotIndex] };
+        if (slot.m_state.load(std::memory_order_acquire) != PackState(generation, SlotState::Filled))
+        {
+            LOG_WARNING("stale reply for slot:{} generation:{}", slotIndex, generation);
+            return;
+        }
+
+        Result result{ std::move(*slot.m_result) };
+        ReplyCb cb{ Release(slotIndex, generation) };
+        cb(std::move(result));
+    }
+
+    // Times out every pending request past its deadline
+    void SweepTimeouts()
+    {
+        if (m_nFree == CAPACITY)
+        {
+            return;
+        }
+
+        const auto now{ Clock::now() };
+        for (uint32_t slotIndex{ 0 }; slotIndex < CAPACITY; slotIndex++)
+        {
+            Slot& slot{ m_slots[slotIndex] };
+            uint64_t expected{ slot.m_state.load(std::memory_order_relaxed) };
+            const uint32_t generation{ Generation(expected) };
+            if (expected != PackState(generation, SlotState::Pending) or slot.m_deadline > now)
+            {
+                continue;
+            }
+
+            // a reply that wins the race has its completion on the way
+            if (not slot.m_state.compare_exchange_strong(
+                    expected, PackState(generation, SlotState::Free), std::memory_order_acquire
+                ))
+            {
+                continue;
+            }
+
+            LOG_DEBUG("{} request timed out slot:{} generation:{}", m_owner.Name(), slotIndex, generation);
+            ReplyCb cb{ Release(slotIndex, generation) };
+            cb(std::unexpected(ReplyError::TimedOut));
+        }
+    }
+
+    // Returns the slot to the free list, handing back the callback to invoke
+    ReplyCb Release(uint32_t slotIndex, uint32_t generation)
+    {
+        Slot& slot{ m_slots[slotIndex] };
+        ReplyCb cb{ std::move(slot.m_cb) };
+        slot.m_result.reset();
+        slot.m_state.store(PackState(generation, SlotState::Free), std::memory_order_release);
+        m_freeSlots[m_nFree++] = slotIndex;
+        return cb;
+    }
+
+private:
+    Thread& m_owner;
+    const TimeMS m_timeoutGrain;
+    TimerEventId m_sweepTimer{ 0 };
+    std::array<Slot, CAPACITY> m_slots{};
+    std::array<uint32_t, CAPACITY> m_freeSlots{};
+    size_t m_nFree{ CAPACITY };
+};
+
+template<typename Resp, size_t CAPACITY> class ReplySlotPool<Resp, CAPACITY>::Awaiter
+{
+public:
+    Awaiter(
+        ReplySlotPool& pool, Thread& target, std::unique_ptr<RequestEvent<Resp>> request, const TimeMS& timeout
+    ) :
+        m_pool{ pool },
+        m_target{ target },
+        m_request{ std::move(request) },
+        m_timeout{ timeout }
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        const bool sent{ m_pool.Request(
+            m_target,
+            std::move(m_request),
+            m_timeout,
+            [this, handle](Result result)
+            {
+                m_result = std::move(result);
+                handle.resume();
+            }
+        ) };
+
+        if (not sent)
+        {
+            m_result = std::unexpected(ReplyError::PoolExhausted);
+        }
+
+        // resume straight away if there is nothing to wait for
+        return sent;
+    }
+
+    Result await_resume() { return std::move(*m_result); }
+
+private:
+    ReplySlotPool& m_pool;
+    Thread& m_target;
+    std::unique_ptr<RequestEvent<Resp>> m_request;
+    const TimeMS m_timeout;
+    std::optional<Result> m_result{};
+};
+
+// Minimal eagerly started coroutine for co_await'ing replies from a thread's handlers
+
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() const noexcept { return {}; }
+
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+
+        std::suspend_never final_suspend() const noexcept { return {}; }
+
+        void return_void() const noexcept {}
+
+        void unhandled_exception() const noexcept
+        {
+            LOG_CRITICAL("unhandled exception in detached task");
+            std::terminate();
+        }
+    };
+};
+
+} // namespace Sage
@@ -1,26 +1,41 @@
 #include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <cstring>
 #include <memory>
+#include <span>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <utility>
 
 #include "channel/channel.hpp"
 #include "log/logger.hpp"
 #include "threading/events.hpp"
+#include "threading/request_reply.hpp"
 #include "threading/thread.hpp"
 #include "timers/scoped_deadline.hpp"
 #include "timers/timer_thread.hpp"
+#include "timers/virtual_scheduler.hpp"
+#include "uring/io_uring.hpp"
 
 namespace Sage
 {
 
 Thread::Thread(
-    const std::string& threadName, TimerThread& timerThread, const TimeMS& handleEventThreshold,
+    const std::string& threadName, TimerService& timerService, const TimeMS& handleEventThreshold, ThreadMode mode,
     Channel::ChannelPair<ThreadEvent> channel
 ) :
     m_threadName{ threadName },
     m_tx{ std::move(channel.tx) },
     m_handleEventThreshold{ handleEventThreshold },
-    m_timerThread{ timerThread },
+    m_timerService{ timerService },
+    m_timerShard{ &timerService.LocalShard() },
+    // claimed by the thread itself once it runs
+    m_uring{ mode == ThreadMode::Reactor
+                 ? std::make_unique<IOURing>(
+                       REACTOR_QUEUE_SIZE, IOURing::SubmitMode::Deferred, URingSetup{ .m_singleIssuer = true }
+                   )
+                 : nullptr },
     m_thread{ &Thread::Enter, this, std::move(channel.rx) }
 {
     LOG_DEBUG("{} c'tor", Name());
@@ -48,36 +63,159 @@ void Thread::Stop()
     m_stopping = true;
 
     // Clear anything in the queue so we get a faster exit
-    m_tx->flushAndSend(std::make_unique<ExitEvent>());
+    ForgetQueued(m_tx->flushAndSend(std::make_unique<ExitEvent>()));
 }
 
 void Thread::TransmitEvent(UniqueThreadEvent event)
 {
     LOG_RETURN_IF(m_stopping.load(std::memory_order_relaxed), LOG_CRITICAL);
-    m_tx->send(std::move(event));
+    m_queueDepth->fetch_add(1, std::memory_order_relaxed);
+    if (not m_tx->send(std::move(event)))
+    {
+        m_queueDepth->fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+TimerEventId Thread::TransmitEventAfter(const TimeNS& delay, UniqueThreadEvent event)
+{
+    if (m_stopping.load(std::memory_order_relaxed)) [[unlikely]]
+    {
+        LOG_CRITICAL("{} deferred transmit requested when stopping", Name());
+        return 0;
+    }
+
+    // the sender's local shard, the receiver's is only safe to read from its own thread
+    return m_timerService.LocalShard().RequestSendAfter(
+        delay, m_tx, [event = std::move(event)]() mutable { return std::move(event); }, m_queueDepth
+    );
+}
+
+TimerEventId Thread::TransmitEventEvery(const TimeNS& period, ThreadEventFactory makeEvent)
+{
+    if (m_stopping.load(std::memory_order_relaxed)) [[unlikely]]
+    {
+        LOG_CRITICAL("{} deferred transmit requested when stopping", Name());
+        return 0;
+    }
+
+    return m_timerService.LocalShard().RequestSendEvery(period, m_tx, std::move(makeEvent), m_queueDepth);
+}
+
+void Thread::CancelTransmit(TimerEventId id)
+{
+    LOG_DEBUG("{} cancel-transmit timer-event-id:{}", Name(), id);
+    m_timerService.RequestTimerStop(id, false, true);
+}
+
+TimerEventId Thread::StartTimer(const std::string& name, const TimeMS& timeout, TimerExpiredCb cb, const TimeNS& slack)
+{
+    TimerEventId eId{ m_timerShard->RequestTimerAdd(timeout, m_tx, slack) };
+    m_timers[eId] = { .name = name, .cb = std::move(cb), .oneShot = false };
+    LOG_DEBUG("{} start-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
 }
 
-TimerEventId Thread::StartTimer(const std::string& name, const TimeMS& timeout, TimerExpiredCb cb)
+TimerEventId Thread::StartTimer(
+    const std::string& name, const TimeMS& timeout, TimerOverrunPolicy policy, TimerOverrunCb cb, const TimeNS& slack
+)
 {
-    TimerEventId eId{ m_timerThread.RequestTimerAdd(timeout, m_tx) };
-    m_timers[eId] = { .name = name, .cb = std::move(cb) };
+    TimerEventId eId{ m_timerShard->RequestTimerAdd(timeout, m_tx, slack) };
+    m_timers[eId] = {
+        .name = name, .cb = {}, .oneShot = false, .overrunCb = std::move(cb), .policy = policy, .period = timeout
+    };
     LOG_DEBUG("{} start-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
     return eId;
 }
 
+TimerEventId Thread::StartCadenceTimer(
+    const std::string& name, const TimeNS& period, CadenceTimerCb cb, TimerOverrunPolicy policy,
+    Clock::time_point anchor
+)
+{
+    TimerEventId eId{ m_timerShard->RequestCadenceTimerAdd(period, m_tx, anchor) };
+    m_timers[eId] = { .name = name,
+                      .cb = {},
+                      .oneShot = false,
+                      .policy = policy,
+                      .period = period,
+                      .cadenceCb = std::move(cb),
+                      .anchor = anchor };
+    LOG_DEBUG("{} start-cadence-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
+}
+
+TimerEventId Thread::StartInlineTimer(
+    const std::string& name, const TimeNS& timeout, InlineTimerCb cb, const TimeNS& budget
+)
+{
+    TimerEventId eId{ m_timerShard->RequestInlineTimerAdd(timeout, m_tx, std::move(cb), budget) };
+    m_timers[eId] = { .name = name, .cb = {}, .oneShot = false, .inlined = true };
+    LOG_DEBUG("{} start-inline-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
+}
+
+TimerEventId Thread::StartOneShotTimer(
+    const std::string& name, const TimeNS& timeout, TimerExpiredCb cb, const TimeNS& slack
+)
+{
+    TimerEventId eId{ m_timerShard->RequestOneShotTimerAdd(timeout, m_tx, slack) };
+    m_timers[eId] = { .name = name, .cb = std::move(cb), .oneShot = true };
+    LOG_DEBUG("{} start-one-shot-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
+}
+
+TimerEventId Thread::StartDeadlineTimer(
+    const std::string& name, Clock::time_point deadline, TimerExpiredCb cb, const TimeNS& slack
+)
+{
+    TimerEventId eId{ m_timerShard->RequestDeadlineTimerAdd(deadline, m_tx, slack) };
+    m_timers[eId] = { .name = name, .cb = std::move(cb), .oneShot = true };
+    LOG_DEBUG("{} start-deadline-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
+}
+
+TimerEventId Thread::StartHighResTimer(
+    const std::string& name, const TimeNS& period, TimerExpiredCb cb, const TimeNS& spinWindow
+)
+{
+    // timer threads only hand out positive ids, so negating keeps these apart from all of theirs
+    const TimerEventId eId{ -TimerEvent::NextId() };
+    auto postExpiry = [tx = m_tx, eId](RealClock::time_point deadline)
+    { tx->send(std::make_unique<TimerTickEvent>(TimerExpiry{ .m_id = eId, .m_scheduled = deadline })); };
+
+    auto timer{ std::make_unique<HighResTimer>(name, period, std::move(postExpiry), spinWindow) };
+    timer->Start();
+    m_highResTimers.emplace(eId, std::move(timer));
+    m_timers[eId] = { .name = name, .cb = std::move(cb), .oneShot = false };
+    LOG_DEBUG("{} start-high-res-timer timer-event-id:{} timer-name:{}", Name(), eId, name);
+    return eId;
+}
+
 void Thread::StopTimer(TimerEventId timerEventId)
 {
     auto itr = m_timers.find(timerEventId);
     LOG_RETURN_IF(itr == m_timers.end(), LOG_ERROR);
 
     LOG_DEBUG("{} stop-timer timer-event-id:{} timer-name:{}", Name(), timerEventId, itr->second.name);
+    const bool oneShot{ itr->second.oneShot };
     m_timers.erase(itr);
 
-    m_timerThread.RequestTimerStop(timerEventId);
+    // joins its thread. expiries it already posted are dropped as unknown
+    if (m_highResTimers.erase(timerEventId) > 0)
+    {
+        return;
+    }
+
+    m_timerService.RequestTimerStop(timerEventId, false, oneShot);
 }
 
-int Thread::Execute(std::unique_ptr<Channel::Rx<ThreadEvent>> rx)
+int Thread::Execute(Channel::Rx<ThreadEvent>& rx)
 {
+    if (m_uring != nullptr)
+    {
+        return ExecuteReactor(rx);
+    }
+
     std::stop_token stopToken{ m_thread.get_stop_token() };
     // Will be execute on this thread via exit event handling
     std::stop_callback stopCb(
@@ -86,26 +224,213 @@ int Thread::Execute(std::unique_ptr<Channel::Rx<ThreadEvent>> rx)
         {
             LOG_DEBUG("{} stop callback triggered", Name());
             // notify ourselves to wake up
-            rx->wakeImmediately();
+            rx.wakeImmediately();
         }
     );
 
     while (not stopToken.stop_requested())
     {
-        ProcessEvents(*rx);
+        ProcessEvents(rx, PROCESS_EVENTS_WAIT_TIMEOUT);
     }
 
     return 0;
 }
 
-void Thread::ProcessEvents(Channel::Rx<ThreadEvent>& rx)
+int Thread::ExecuteReactor(Channel::Rx<ThreadEvent>& rx)
 {
-    auto [events, eventLeftInQueue]{ rx.tryReceiveLimitedMany(PROCESS_EVENTS_WAIT_TIMEOUT, MAX_EVENTS_PER_LOOP) };
-    if (events.empty())
+    // blocking, so the ring parks the read until there's a wakeup rather than failing it
+    m_wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (m_wakeFd < 0)
+    {
+        // still works, events are just only picked up between ring waits
+        LOG_CRITICAL("{} failed to create reactor wakeup. {}", Name(), strerror(errno));
+    }
+    else
+    {
+        rx.wakeThrough(m_wakeFd);
+        ArmWakeup();
+    }
+
+    // scoped so the stop callback is gone before the wakeup is closed
+    {
+        std::stop_token stopToken{ m_thread.get_stop_token() };
+        std::stop_callback stopCb(
+            stopToken,
+            [this, &rx]
+            {
+                LOG_DEBUG("{} stop callback triggered", Name());
+                rx.wakeImmediately();
+                if (m_wakeFd >= 0)
+                {
+                    eventfd_write(m_wakeFd, 1);
+                }
+            }
+        );
+
+        while (not stopToken.stop_requested())
+        {
+            // anything sent from here on wakes the ring, so nothing is left waiting on the channel
+            rx.park();
+            const size_t nEventsLeft{ ProcessEvents(rx, 0ns) };
+
+            // with events still queued only take the completions already in
+            ReapCompletions(nEventsLeft > 0 ? 0ns : TimeNS{ PROCESS_EVENTS_WAIT_TIMEOUT });
+            rx.unpark();
+        }
+    }
+
+    rx.wakeThrough(-1);
+
+    // the kernel may still be using memory the callbacks own, so cancel what's left and let it finish
+    if (m_ioInFlight > 0)
+    {
+        m_uring->QueueCancelAll(IGNORED_USER_DATA);
+    }
+
+    const auto drainDeadline{ RealClock::now() + REACTOR_DRAIN_TIMEOUT };
+    while (m_ioInFlight > 0 and RealClock::now() < drainDeadline)
+    {
+        ReapCompletions(PROCESS_EVENTS_WAIT_TIMEOUT);
+    }
+
+    if (m_ioInFlight > 0)
+    {
+        LOG_CRITICAL("{} stopped with {} ops still in flight", Name(), m_ioInFlight);
+    }
+
+    // events other threads posted straight into the ring before seeing the stop, released unhandled
+    ReapCompletions(0ns);
+
+    if (m_wakeFd >= 0)
+    {
+        close(m_wakeFd);
+        m_wakeFd = -1;
+    }
+
+    return 0;
+}
+
+void Thread::ArmWakeup()
+{
+    m_uring->QueueRead(WAKEUP_USER_DATA, m_wakeFd, std::as_writable_bytes(std::span{ &m_wakeCount, 1 }), 0);
+}
+
+void Thread::ReapCompletions(const TimeNS& timeout)
+{
+    for (auto batch{ m_uring->WaitForEvents(timeout) }; not batch.empty(); batch = m_uring->PeekEvents())
+    {
+        for (const io_uring_cqe* uringEvent : batch)
+        {
+            switch (uringEvent->user_data)
+            {
+                case WAKEUP_USER_DATA:
+                    // only cancelled once stopping
+                    if (uringEvent->res != -ECANCELED)
+                    {
+                        ArmWakeup();
+                    }
+                    break;
+
+                case IGNORED_USER_DATA:
+                    break;
+
+                default:
+                    if ((uringEvent->user_data & RING_MESSAGE_TAG) != 0)
+                    {
+                        OnRingMessage(*uringEvent);
+                    }
+                    else
+                    {
+                        OnCompleteIO(*uringEvent);
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+void Thread::OnCompleteIO(const io_uring_cqe& cEvent)
+{
+    auto& cb{ *reinterpret_cast<IOCompleteCb*>(cEvent.user_data) };
+    if (cb)
+    {
+        cb(cEvent.res);
+    }
+
+    // multishot ops keep their callback until the last completion
+    if ((cEvent.flags & IORING_CQE_F_MORE) == 0)
+    {
+        std::unique_ptr<IOCompleteCb> done{ &cb };
+        m_ioInFlight--;
+    }
+}
+
+void Thread::TransmitEventDirect(Thread& target, UniqueThreadEvent event)
+{
+    if (m_uring == nullptr or target.m_uring == nullptr) [[unlikely]]
+    {
+        LOG_ERROR("{} direct transmit to {} needs both to be reactor threads", Name(), target.Name());
+        target.TransmitEvent(std::move(event));
+        return;
+    }
+
+    LOG_RETURN_IF(target.m_stopping.load(std::memory_order_relaxed), LOG_CRITICAL);
+    target.m_queueDepth->fetch_add(1, std::memory_order_relaxed);
+    VirtualScheduler::WorkQueued();
+
+    auto message{ std::make_unique<RingMessage>(RingMessage{ .m_event = std::move(event), .m_target = &target }) };
+    const auto data{ reinterpret_cast<IOURing::UserData>(message.get()) | RING_MESSAGE_TAG };
+    if (not m_uring->QueueMsgRing(data, target.m_uring->RingFd(), data, 0))
+    {
+        target.m_queueDepth->fetch_sub(1, std::memory_order_relaxed);
+        VirtualScheduler::WorkDone();
+        target.TransmitEvent(std::move(message->m_event));
+        return;
+    }
+
+    // whichever ring completes it hands it back as the user data
+    static_cast<void>(message.release());
+}
+
+void Thread::OnRingMessage(const io_uring_cqe& cEvent)
+{
+    std::unique_ptr<RingMessage> message{ reinterpret_cast<RingMessage*>(cEvent.user_data & ~RING_MESSAGE_TAG) };
+    Thread& target{ *message->m_target };
+
+    // the target always sees the 0 it was sent, failures only come back to the sender
+    if (cEvent.res < 0)
+    {
+        LOG_WARNING(
+            "{} direct transmit to {} failed, using its channel. {}", Name(), target.Name(), strerror(-cEvent.res)
+        );
+        // counted back in by the channel send
+        target.m_queueDepth->fetch_sub(1, std::memory_order_relaxed);
+        VirtualScheduler::WorkDone();
+        target.TransmitEvent(std::move(message->m_event));
+        return;
+    }
+
+    // dropped like anything left on the channel once stopping
+    if (m_thread.get_stop_token().stop_requested())
     {
+        LOG_DEBUG("{} dropping direct event, stopping", Name());
+        m_queueDepth->fetch_sub(1, std::memory_order_relaxed);
+        VirtualScheduler::WorkDone();
         return;
     }
 
+    DispatchEvent(std::move(message->m_event));
+    VirtualScheduler::WorkDone();
+}
+
+size_t Thread::ProcessEvents(Channel::Rx<ThreadEvent>& rx, const TimeNS& timeout)
+{
+    auto [events, eventLeftInQueue]{ rx.tryReceiveLimitedMany(timeout, MAX_EVENTS_PER_LOOP) };
+    if (events.empty())
+    {
+        return 0;
+    }
+
     // Only start the deadline if there are events to process
     ScopedDeadline processDeadline{ m_threadName + "@ProcessEvents", PROCESS_EVENTS_THRESHOLD };
 
@@ -117,39 +442,12 @@ void Thread::ProcessEvents(Channel::Rx<ThreadEvent>& rx)
             continue;
         }
 
-        switch (threadEvent->Receiver())
-        {
-            case EventReceiver::Self:
-            {
-                ScopedDeadline handleDeadline{ m_threadName + "@ProcessEvents::HandleSelfEvent",
-                                               m_handleEventThreshold };
-                HandleSelfEvent(std::move(threadEvent));
-                break;
-            }
-
-            case EventReceiver::TimerExpired:
-            {
-                const auto& e{ static_cast<const TimerExpiredEvent&>(*threadEvent) };
-                if (auto itr{ m_timers.find(e.m_timerId) }; itr != m_timers.end())
-                {
-                    (itr->second.cb)();
-                }
-                else
-                {
-                    LOG_WARNING("got timer expiry for unknown timer-id:{}", e.m_timerId);
-                }
-                break;
-            }
-
-            default:
-            {
-                ScopedDeadline handleDeadline{ m_threadName + "@ProcessEvents::HandleTimer", m_handleEventThreshold };
-                HandleEvent(std::move(threadEvent));
-                break;
-            }
-        }
+        DispatchEvent(std::move(threadEvent));
     }
 
+    // everything dequeued this pass has now been handled
+    VirtualScheduler::WorkDone(events.size());
+
     // too many events ?
     if (eventLeftInQueue > 0)
     {
@@ -166,13 +464,187 @@ void Thread::ProcessEvents(Channel::Rx<ThreadEvent>& rx)
     {
         LOG_TRACE("{} process-events n-received-events:{}", Name(), events.size());
     }
+
+    return eventLeftInQueue;
+}
+
+void Thread::ForgetQueued(const std::deque<UniqueThreadEvent>& events)
+{
+    // the same events DispatchEvent takes off the depth once handled
+    const auto counted{ std::ranges::count_if(
+        events,
+        [](const UniqueThreadEvent& event)
+        {
+            switch (event->Receiver())
+            {
+                case EventReceiver::Self:
+                case EventReceiver::TimerExpired:
+                case EventReceiver::TimerTick:
+                case EventReceiver::Reply:
+                case EventReceiver::IOComplete:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+    ) };
+
+    m_queueDepth->fetch_sub(static_cast<size_t>(counted), std::memory_order_relaxed);
+}
+
+void Thread::DispatchEvent(UniqueThreadEvent threadEvent)
+{
+    switch (threadEvent->Receiver())
+    {
+        case EventReceiver::Self:
+        {
+            ScopedDeadline handleDeadline{ m_threadName + "@ProcessEvents::HandleSelfEvent", m_handleEventThreshold };
+            HandleSelfEvent(std::move(threadEvent));
+            break;
+        }
+
+        case EventReceiver::TimerExpired:
+        {
+            // all of this thread's expiries from one timer thread pass
+            for (const auto& expiry : static_cast<const TimerExpiredEvent&>(*threadEvent).m_expiries)
+            {
+                HandleTimerExpiry(expiry);
+            }
+            break;
+        }
+
+        case EventReceiver::TimerTick:
+        {
+            HandleTimerExpiry(static_cast<const TimerTickEvent&>(*threadEvent).m_expiry);
+            break;
+        }
+
+        case EventReceiver::Reply:
+        {
+            static_cast<const ReplyEvent&>(*threadEvent).Complete();
+            break;
+        }
+
+        case EventReceiver::IOComplete:
+        {
+            static_cast<IOCompleteEvent&>(*threadEvent).Complete();
+            break;
+        }
+
+        default:
+        {
+            const auto handleStart{ RealClock::now() };
+            {
+                ScopedDeadline handleDeadline{ m_threadName + "@ProcessEvents::HandleTimer", m_handleEventThreshold };
+                HandleEvent(std::move(threadEvent));
+            }
+            RecordHandleTime(RealClock::now() - handleStart);
+            m_queueDepth->fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+void Thread::HandleTimerExpiry(const TimerExpiry& expiry)
+{
+    auto itr{ m_timers.find(expiry.m_id) };
+    if (itr == m_timers.end())
+    {
+        LOG_WARNING("got timer expiry for unknown timer-id:{}", expiry.m_id);
+        return;
+    }
+
+    // runs on the timer thread, which only sends expiries once it's demoted
+    LOG_RETURN_IF(itr->second.inlined, LOG_ERROR);
+
+    const auto now{ Clock::now() };
+    if (m_timerLateness != nullptr)
+    {
+        m_timerLateness->Record(now - expiry.m_scheduled);
+    }
+
+    if (itr->second.oneShot)
+    {
+        // already gone from the timer thread too
+        auto node{ m_timers.extract(itr) };
+        node.mapped().cb();
+        return;
+    }
+
+    auto& timer{ itr->second };
+    size_t nMissed{ expiry.m_missed };
+    if (timer.policy != TimerOverrunPolicy::FireAll)
+    {
+        if (expiry.m_scheduled <= timer.caughtUpTo)
+        {
+            LOG_TRACE("{} folded backlogged expiry timer-id:{}", Name(), expiry.m_id);
+            return;
+        }
+
+        // Ticks that came due while this one sat in the queue are right behind it. Catch up to now
+        // so they're dropped as they arrive. Counted from the newest tick the timer thread folded,
+        // which already reported the ones before it. Timer threads keep ticks on their exact schedule,
+        // so only time spent queued or running late here counts as being behind
+        const auto newest{ expiry.m_scheduled + (timer.period * expiry.m_missed) };
+        const auto behind{ timer.period > 0ns ? (now - newest) / timer.period : 0 };
+        if (behind > 0)
+        {
+            timer.caughtUpTo = now;
+            nMissed += static_cast<size_t>(behind);
+            if (timer.policy == TimerOverrunPolicy::Skip)
+            {
+                LOG_DEBUG("{} skipping overrun timer-id:{} n-missed:{}", Name(), expiry.m_id, nMissed);
+                return;
+            }
+        }
+    }
+
+    // fire all replays whatever the timer thread folded, the other policies report it
+    const bool fireAll{ timer.policy == TimerOverrunPolicy::FireAll };
+    const size_t nCalls{ fireAll ? nMissed + 1 : 1 };
+    const size_t nReported{ fireAll ? 0 : nMissed };
+
+    // The callback is free to stop its own timer, so don't run it from inside the map
+    TimerExpiredCb cb{ std::move(timer.cb) };
+    TimerOverrunCb overrunCb{ std::move(timer.overrunCb) };
+    CadenceTimerCb cadenceCb{ std::move(timer.cadenceCb) };
+    // folded ticks report the phase now falls in on the grid
+    const auto nowPhase{ timer.period > 0ns and now > timer.anchor ? (now - timer.anchor) / timer.period : 0 };
+    const uint64_t foldedPhase{ std::max(expiry.m_phase, static_cast<uint64_t>(nowPhase)) };
+    bool running{ true };
+    for (size_t i{ 0 }; i < nCalls and running; i++)
+    {
+        if (cadenceCb)
+        {
+            // replays walk through each phase
+            const uint64_t phase{ std::max(fireAll ? expiry.m_phase + i : foldedPhase, timer.nextPhase) };
+            timer.nextPhase = phase + 1;
+            cadenceCb(phase);
+        }
+        else if (overrunCb)
+        {
+            overrunCb(nReported);
+        }
+        else
+        {
+            cb();
+        }
+        running = m_timers.contains(expiry.m_id);
+    }
+
+    if (itr = m_timers.find(expiry.m_id); itr != m_timers.end())
+    {
+        itr->second.cb = std::move(cb);
+        itr->second.overrunCb = std::move(overrunCb);
+        itr->second.cadenceCb = std::move(cadenceCb);
+    }
 }
 
 void Thread::HandleSelfEvent(UniqueThreadEvent threadEvent)
 {
     LOG_RETURN_IF(threadEvent->Receiver() != EventReceiver::Self, LOG_CRITICAL);
 
-    const auto& event = static_cast<const SelfEvent&>(*threadEvent);
+    auto& event = static_cast<SelfEvent&>(*threadEvent);
     switch (event.Type())
     {
         case SelfEvent::Exit:
@@ -190,6 +662,22 @@ void Thread::HandleSelfEvent(UniqueThreadEvent threadEvent)
             break;
         }
 
+        case SelfEvent::TimerDemoted:
+        {
+            auto& demoted = static_cast<TimerDemotedEvent&>(event);
+            auto itr{ m_timers.find(demoted.m_id) };
+            if (itr == m_timers.end())
+            {
+                LOG_DEBUG("{} demoted timer-id:{} already stopped", Name(), demoted.m_id);
+                break;
+            }
+
+            LOG_WARNING("{} inline timer-id:{} timer-name:{} demoted", Name(), demoted.m_id, itr->second.name);
+            itr->second.cb = std::move(demoted.m_cb);
+            itr->second.inlined = false;
+            break;
+        }
+
         default:
         {
             LOG_ERROR("{} handle-event unknown event:{}", Name(), (int)event.Type());
@@ -198,6 +686,14 @@ void Thread::HandleSelfEvent(UniqueThreadEvent threadEvent)
     }
 }
 
+void Thread::RecordHandleTime(const TimeNS& handleTime) noexcept
+{
+    // only ever written from this thread, so a plain load/store is enough
+    const TimeNS::rep avg{ m_avgHandleTimeNs.load(std::memory_order_relaxed) };
+    const TimeNS::rep next{ avg + ((handleTime.count() - avg) >> HANDLE_TIME_SMOOTHING_SHIFT) };
+    m_avgHandleTimeNs.store(next, std::memory_order_relaxed);
+}
+
 void Thread::Enter(std::unique_ptr<Channel::Rx<ThreadEvent>> rx)
 {
     pthread_setname_np(pthread_self(), Name().c_str());
@@ -205,22 +701,37 @@ void Thread::Enter(std::unique_ptr<Channel::Rx<ThreadEvent>> rx)
     // For for start trigger
     m_startLatch.wait();
 
+    // now on the cpu we'll actually run on
+    m_timerShard = &m_timerService.LocalShard();
+
     m_running = true;
 
+    // Starting may already queue io, and a single issuer ring belongs to whoever enables it
+    if (m_uring != nullptr)
+    {
+        m_uring->Enable();
+    }
+
     LOG_INFO("{} starting", Name());
     Starting();
 
     LOG_INFO("{} executing ", Name());
-    m_exitCode = Execute(std ::move(rx));
+    m_exitCode = Execute(*rx);
+    // anything still queued, or sent from here on, is never handled
+    ForgetQueued(rx->disconnect());
 
     LOG_INFO("{} stopping", Name());
     Stopping();
 
     // stop all timers
-    for (const auto& [timerId, _] : m_timers)
+    for (const auto& [timerId, timer] : m_timers)
     {
-        m_timerThread.RequestTimerStop(timerId, false);
+        if (not m_highResTimers.contains(timerId))
+        {
+            m_timerService.RequestTimerStop(timerId, false, timer.oneShot);
+        }
     }
+    m_highResTimers.clear();
 
     m_running = false;
 }
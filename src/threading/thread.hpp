@@ -1,17 +1,24 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <latch>
 #include <memory>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 
 #include "channel/channel.hpp"
 #include "threading/events.hpp"
+#include "timers/high_res_timer.hpp"
+#include "timers/latency_histogram.hpp"
 #include "timers/time_utils.hpp"
+#include "timers/timer_service.hpp"
 #include "timers/timer_thread.hpp"
+#include "uring/io_uring.hpp"
 
 namespace Sage
 {
@@ -20,19 +27,64 @@ namespace Sage
 
 using UniqueThreadEvent = std::unique_ptr<ThreadEvent>;
 
+// forward decls
+
+template<typename Resp, size_t CAPACITY> class ReplySlotPool;
+
+// What a periodic timer does with ticks that came due while its thread was busy, or that the
+// timer thread itself was too late to deliver
+enum class TimerOverrunPolicy
+{
+    // run the callback once per tick, however late
+    FireAll,
+    // run the callback once, with how many ticks were folded into it
+    Coalesce,
+    // drop late ticks and wait for the next one that's on time
+    Skip
+};
+
+// How a thread waits for its events
+enum class ThreadMode
+{
+    // blocks on its channel
+    Channel,
+    // owns an io_uring and only ever blocks on that, so it waits on events and its own io at once
+    Reactor
+};
+
 class Thread
 {
 public:
     using TimerExpiredCb = std::move_only_function<void()>;
+    // nMissed is how many ticks were folded into this callback
+    using TimerOverrunCb = std::move_only_function<void(size_t nMissed)>;
+    // phase is k in anchor + k * period, shared by every cadence on the same grid
+    using CadenceTimerCb = std::move_only_function<void(uint64_t phase)>;
 
     struct TimerData
     {
         std::string name;
         TimerExpiredCb cb;
+        // forgotten once fired
+        bool oneShot;
+        // set instead of cb for timers started with an overrun policy
+        TimerOverrunCb overrunCb{};
+        TimerOverrunPolicy policy{ TimerOverrunPolicy::FireAll };
+        TimeNS period{ 0 };
+        // expiries due by then were folded into an earlier callback
+        Clock::time_point caughtUpTo{};
+        // the callback lives on the timer thread until it's demoted
+        bool inlined{ false };
+        // set instead of cb for cadence timers
+        CadenceTimerCb cadenceCb{};
+        Clock::time_point anchor{};
+        // phases only ever go forward, so none below this is reported
+        uint64_t nextPhase{ 0 };
     };
 
     Thread(
-        const std::string& threadName, TimerThread& timerThread, const TimeMS& handleEventThreshold = 20ms,
+        const std::string& threadName, TimerService& timerService, const TimeMS& handleEventThreshold = 20ms,
+        ThreadMode mode = ThreadMode::Channel,
         // must always be last
         Channel::ChannelPair<ThreadEvent> channel = Channel::MakeChannel<ThreadEvent>()
     );
@@ -47,10 +99,36 @@ public:
 
     void TransmitEvent(UniqueThreadEvent event);
 
+    // Deferred sends go from the timer thread straight to this thread, with no hop through the sender.
+    // The returned id cancels them
+
+    // Sends event to this thread once delay has passed
+    TimerEventId TransmitEventAfter(const TimeNS& delay, UniqueThreadEvent event);
+
+    // Sends a fresh event from makeEvent every period until cancelled. makeEvent runs on the
+    // timer thread. Cancel before this thread stops, later sends are only dropped
+    TimerEventId TransmitEventEvery(const TimeNS& period, ThreadEventFactory makeEvent);
+
+    // Harmless if a one off send has already gone
+    void CancelTransmit(TimerEventId id);
+
     int ExitCode() const noexcept { return m_exitCode; }
 
     bool IsRunning() const noexcept { return m_running; }
 
+    // Events transmitted to this thread that have not finished being handled
+    size_t QueueDepth() const noexcept { return m_queueDepth->load(std::memory_order_relaxed); }
+
+    // Running average of the time taken by HandleEvent
+    TimeNS AverageHandleTime() const noexcept { return TimeNS{ m_avgHandleTimeNs.load(std::memory_order_relaxed) }; }
+
+    // Estimated time to drain the current queue. Published for load aware dispatching
+    TimeNS LoadEstimate() const noexcept { return AverageHandleTime() * static_cast<TimeNS::rep>(QueueDepth()); }
+
+    // Records how late each timer callback runs against its schedule. Set before Start and only
+    // read the histogram once the thread has exited
+    void RecordTimerLateness(LatencyHistogram* histogram) noexcept { m_timerLateness = histogram; }
+
 protected:
     virtual void Starting() {}
 
@@ -58,11 +136,112 @@ protected:
 
     virtual void HandleEvent(UniqueThreadEvent event) = 0;
 
-    TimerEventId StartTimer(const std::string& name, const TimeMS& timeout, TimerExpiredCb cb);
+    // Slack lets the timer fire up to that much late, to share a wakeup with other timers
+
+    // Fires every timeout until stopped
+    TimerEventId StartTimer(
+        const std::string& name, const TimeMS& timeout, TimerExpiredCb cb, const TimeNS& slack = 0ns
+    );
+
+    // Fires every timeout until stopped, with the policy deciding what happens to ticks that come due
+    // while this thread is too busy to run them
+    TimerEventId StartTimer(
+        const std::string& name, const TimeMS& timeout, TimerOverrunPolicy policy, TimerOverrunCb cb,
+        const TimeNS& slack = 0ns
+    );
+
+    // Fires on the absolute grid anchor + k * period and never drifts. The default anchor lines every
+    // cadence with the same period up on the same boundaries, across threads, so their work coalesces.
+    // Skipped ticks show up as jumps in phase
+    TimerEventId StartCadenceTimer(
+        const std::string& name, const TimeNS& period, CadenceTimerCb cb,
+        TimerOverrunPolicy policy = TimerOverrunPolicy::Coalesce, Clock::time_point anchor = {}
+    );
+
+    // Fires every timeout, running cb on the timer thread itself with no hop through this thread.
+    // For trivial work like setting a flag. Overrunning budget demotes it to a normal timer on this thread.
+    // May still run shortly after StopTimer, so cb must not touch this thread's state directly.
+    // Capture what it needs by shared_ptr
+    TimerEventId StartInlineTimer(
+        const std::string& name, const TimeNS& timeout, InlineTimerCb cb,
+        const TimeNS& budget = TimerThread::DEFAULT_INLINE_BUDGET
+    );
+
+    // Fires once. Only needs stopping if it hasn't fired yet
+    TimerEventId StartOneShotTimer(
+        const std::string& name, const TimeNS& timeout, TimerExpiredCb cb, const TimeNS& slack = 0ns
+    );
+
+    // Fires once at deadline. Only needs stopping if it hasn't fired yet
+    TimerEventId StartDeadlineTimer(
+        const std::string& name, Clock::time_point deadline, TimerExpiredCb cb, const TimeNS& slack = 0ns
+    );
+
+    // Fires every period, down to tens of microseconds, with cb on this thread. A HighResTimer of its own
+    // sleeps and spins out each deadline and posts the expiry here, so lateness is mostly this thread's
+    // wakeup. Ticks missed while the callback overran are skipped. Real time only, even under virtual time
+    TimerEventId StartHighResTimer(
+        const std::string& name, const TimeNS& period, TimerExpiredCb cb,
+        const TimeNS& spinWindow = HighResTimer::DEFAULT_SPIN_WINDOW
+    );
 
     void StopTimer(TimerEventId timerEventId);
 
+    // Where async services like IOThread send completions for this thread
+    const std::shared_ptr<Channel::Tx<ThreadEvent>>& Tx() const noexcept { return m_tx; }
+
+    // Reactor threads only, and only from this thread once started. Ops are submitted the next
+    // time the thread waits
+    IOURing& Ring() noexcept { return *m_uring; }
+
+    // Reactor threads only. queueOp(ring, userData) queues one op on the ring, and cb runs on this thread
+    // with each of its completions, until the last. False if it couldn't be queued, in which case cb is dropped.
+    // Ops still in flight when the thread stops are cancelled before Stopping, and no more are taken.
+    // Several go into one chain between Ring().BeginChain and EndChain
+    template<typename QueueOp> bool QueueIO(QueueOp&& queueOp, IOCompleteCb cb)
+    {
+        if (m_thread.get_stop_token().stop_requested())
+        {
+            return false;
+        }
+
+        auto pending{ std::make_unique<IOCompleteCb>(std::move(cb)) };
+        if (not std::forward<QueueOp>(queueOp)(*m_uring, reinterpret_cast<IOURing::UserData>(pending.get())))
+        {
+            return false;
+        }
+
+        // the ring hands it back as the user data on completion
+        static_cast<void>(pending.release());
+        m_ioInFlight++;
+        return true;
+    }
+
+    // As above, but the kernel cancels the op if it hasn't completed within timeout, and cb sees -ECANCELED.
+    // Costs a linked timeout op in the same submit, and nothing else. Should only the timeout fail to queue,
+    // the op still goes, without a deadline, and cb is kept for it
+    template<typename QueueOp> bool QueueIO(QueueOp&& queueOp, IOCompleteCb cb, const TimeNS& timeout)
+    {
+        return QueueIO(
+            [&queueOp, &timeout](IOURing& ring, IOURing::UserData data)
+            {
+                return ring.QueueWithTimeout(
+                    IGNORED_USER_DATA, timeout, [&] { return std::forward<QueueOp>(queueOp)(ring, data); }
+                );
+            },
+            std::move(cb)
+        );
+    }
+
+    // Reactor threads only, to another reactor thread. Posts event straight into target's ring with
+    // IORING_OP_MSG_RING, so neither side touches a lock or semaphore. Goes out with this thread's next
+    // wait, together with anything else queued. Falls back to target's channel if its ring can't take it
+    void TransmitEventDirect(Thread& target, UniqueThreadEvent event);
+
 private:
+    // Reply slots start timeouts and hand out our tx on behalf of the thread
+    template<typename, size_t> friend class ReplySlotPool;
+
     // Not copyable or movable
     Thread(const Thread&) = delete;
     Thread(Thread&&) = delete;
@@ -73,23 +252,68 @@ private:
     void Enter(std::unique_ptr<Channel::Rx<ThreadEvent>> rx);
 
     // main thread loop
-    int Execute(std::unique_ptr<Channel::Rx<ThreadEvent>> rx);
+    int Execute(Channel::Rx<ThreadEvent>& rx);
+
+    // reactor thread loop
+    int ExecuteReactor(Channel::Rx<ThreadEvent>& rx);
+
+    // Returns how many events were left for the next pass
+    size_t ProcessEvents(Channel::Rx<ThreadEvent>& rx, const TimeNS& timeout);
 
-    void ProcessEvents(Channel::Rx<ThreadEvent>& rx);
+    void DispatchEvent(UniqueThreadEvent threadEvent);
+
+    // Takes events that will never be handled off the queue depth
+    void ForgetQueued(const std::deque<UniqueThreadEvent>& events);
+
+    void ArmWakeup();
+
+    void ReapCompletions(const TimeNS& timeout);
+
+    void OnCompleteIO(const io_uring_cqe& cEvent);
+
+    // Delivered on the target's ring, or handed back on the sender's when that failed
+    void OnRingMessage(const io_uring_cqe& cEvent);
 
     // For loop back events for managing this thread
     void HandleSelfEvent(UniqueThreadEvent event);
 
+    void HandleTimerExpiry(const TimerExpiry& expiry);
+
+    void RecordHandleTime(const TimeNS& handleTime) noexcept;
+
 private:
+    // an event posted straight into a reactor thread's ring. The sender keeps hold of the target
+    // in case it has to fall back to the channel
+    struct RingMessage
+    {
+        UniqueThreadEvent m_event;
+        Thread* m_target;
+    };
+
     const std::string m_threadName;
     std::shared_ptr<Channel::Tx<ThreadEvent>> m_tx;
     const TimeMS m_handleEventThreshold;
     std::unordered_map<TimerEventId, TimerData> m_timers{};
+    // their callbacks sit in m_timers like any other
+    std::unordered_map<TimerEventId, std::unique_ptr<HighResTimer>> m_highResTimers{};
     std::atomic<int> m_exitCode{ 0 };
     std::latch m_startLatch{ 1 };
     std::atomic<bool> m_running{ false };
     std::atomic<bool> m_stopping{ false };
-    TimerThread& m_timerThread;
+    // shared with deferred sends, which count themselves in when the timer thread delivers them
+    const SharedQueueDepth m_queueDepth{ std::make_shared<std::atomic<size_t>>(0) };
+    std::atomic<TimeNS::rep> m_avgHandleTimeNs{ 0 };
+    TimerService& m_timerService;
+    // shard near the cpu this thread runs on. new timers go here, stops are routed by id
+    TimerThread* m_timerShard;
+    LatencyHistogram* m_timerLateness{ nullptr };
+    // reactor threads only. readable whenever events were sent while the thread waited on the ring
+    int m_wakeFd{ -1 };
+    uint64_t m_wakeCount{ 0 };
+    // ops queued through QueueIO the ring still holds
+    size_t m_ioInFlight{ 0 };
+    // submitted once per loop, together with the wait
+    const std::unique_ptr<IOURing> m_uring;
 
     // must always be last
     std::jthread m_thread;
@@ -98,6 +322,20 @@ private:
     static constexpr size_t MAX_EVENTS_PER_LOOP{ 10 };
     static constexpr TimeMS PROCESS_EVENTS_THRESHOLD{ 1000ms };
     static constexpr TimeMS PROCESS_EVENTS_WAIT_TIMEOUT{ 100ms };
+    static constexpr uint REACTOR_QUEUE_SIZE{ 256 };
+    static constexpr TimeMS REACTOR_DRAIN_TIMEOUT{ 1000ms };
+
+    // user data that isn't an op queued through QueueIO
+    enum : IOURing::UserData
+    {
+        WAKEUP_USER_DATA,
+        IGNORED_USER_DATA
+    };
+
+    // set on RingMessage pointers, which are never odd, to tell them apart from QueueIO callbacks
+    static constexpr IOURing::UserData RING_MESSAGE_TAG{ 1 };
+    // weight of the newest sample in the average handle time is 1 / 2^N
+    static constexpr TimeNS::rep HANDLE_TIME_SMOOTHING_SHIFT{ 3 };
 };
 
 } // namespace Sage
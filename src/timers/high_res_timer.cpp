@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+#include <sys/prctl.h>
+
+#include "log/logger.hpp"
+#include "timers/high_res_timer.hpp"
+
+namespace Sage
+{
+
+namespace
+{
+
+// Eases off the core while spinning, without giving it up
+inline void CpuRelax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+HighResTimer::HighResTimer(const std::string& name, const TimeNS& period, ExpiredCb cb, const TimeNS& spinWindow) :
+    m_name{ name },
+    m_period{ std::max(period, TimeNS{ 1 }) },
+    m_spinWindow{ std::clamp(spinWindow, TimeNS{ 0 }, m_period) },
+    m_cb{ std::move(cb) }
+{
+    LOG_DEBUG("[{}] high res timer c'tor period:{} spin-window:{}", Name(), m_period, m_spinWindow);
+}
+
+HighResTimer::~HighResTimer()
+{
+    Stop();
+    LOG_DEBUG("[{}] high res timer d'tor", Name());
+}
+
+void HighResTimer::Start()
+{
+    LOG_RETURN_IF(m_thread.joinable(), LOG_ERROR);
+    m_thread = std::jthread{ [this](std::stop_token stopToken) { Run(stopToken); } };
+}
+
+void HighResTimer::Stop()
+{
+    if (m_thread.joinable())
+    {
+        // wakes the parked sleep too
+        m_thread.request_stop();
+        m_thread.join();
+    }
+}
+
+void HighResTimer::Run(std::stop_token stopToken)
+{
+    // thread names are capped at 15 characters
+    pthread_setname_np(pthread_self(), m_name.substr(0, 15).c_str());
+
+    // the default 50us timer slack would swamp the spin window
+    if (prctl(PR_SET_TIMERSLACK, 1UL) != 0)
+    {
+        LOG_WARNING("[{}] failed to set timer slack. {}", Name(), strerror(errno));
+    }
+
+    if (m_affinity.has_value())
+    {
+        if (int res = pthread_setaffinity_np(pthread_self(), sizeof(*m_affinity), &*m_affinity); res != 0)
+        {
+            LOG_ERROR("[{}] failed to set affinity. {}", Name(), strerror(res));
+        }
+    }
+
+    LOG_INFO("[{}] high res timer started period:{} spin-window:{}", Name(), m_period, m_spinWindow);
+
+    RealClock::time_point deadline{ RealClock::now() + m_period };
+    while (WaitUntil(stopToken, deadline))
+    {
+        m_cb(deadline);
+        m_nExpiries.fetch_add(1, std::memory_order_relaxed);
+
+        // overran whole periods, skip them instead of firing a burst to catch up
+        deadline += m_period;
+        if (const auto now{ RealClock::now() }; deadline <= now)
+        {
+            const auto nMissed{ ((now - deadline) / m_period) + 1 };
+            deadline += m_period * nMissed;
+            m_nMissed.fetch_add(static_cast<size_t>(nMissed), std::memory_order_relaxed);
+        }
+    }
+
+    LOG_INFO("[{}] high res timer stopped", Name());
+}
+
+bool HighResTimer::WaitUntil(std::stop_token& stopToken, RealClock::time_point deadline)
+{
+    if (const auto wakeAt{ deadline - m_spinWindow }; RealClock::now() < wakeAt)
+    {
+        std::unique_lock lock{ m_parkMtx };
+        m_parkCv.wait_until(lock, stopToken, wakeAt, [] { return false; });
+    }
+
+    while (RealClock::now() < deadline)
+    {
+        if (stopToken.stop_requested())
+        {
+            return false;
+        }
+        CpuRelax();
+    }
+
+    return not stopToken.stop_requested();
+}
+
+} // namespace Sage
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <sched.h>
+#include <string>
+#include <thread>
+
+#include "timers/time_utils.hpp"
+
+namespace Sage
+{
+
+// Periodic timer for sub-millisecond pacing, on its own thread.
+// Parks in the kernel until the spin window before each deadline, then spins on the clock for
+// the rest so wakeup latency doesn't show up as jitter. Deadlines sit on a fixed grid from
+// Start, so lateness never accumulates into drift. Runs on real time, even under virtual time.
+// The callback runs on the timer's thread with the deadline it fired for, keep it short.
+// Thread::StartHighResTimer runs it on a Thread instead
+
+class HighResTimer
+{
+public:
+    using ExpiredCb = std::move_only_function<void(RealClock::time_point deadline)>;
+
+    static constexpr TimeNS DEFAULT_SPIN_WINDOW{ 50us };
+
+    HighResTimer(
+        const std::string& name, const TimeNS& period, ExpiredCb cb, const TimeNS& spinWindow = DEFAULT_SPIN_WINDOW
+    );
+
+    ~HighResTimer();
+
+    const std::string& Name() const noexcept { return m_name; }
+
+    void Start();
+
+    void Stop();
+
+    // Takes effect from the next start. Spinning burns a core, so pin busy timers away from other work
+    void SetAffinity(const cpu_set_t& cpus) { m_affinity = cpus; }
+
+    struct Stats
+    {
+        size_t m_expiries;
+        // deadlines that had already passed by the time the callback returned, and were dropped
+        size_t m_missed;
+    };
+
+    Stats GetStats() const noexcept
+    {
+        return Stats{ .m_expiries = m_nExpiries.load(std::memory_order_relaxed),
+                      .m_missed = m_nMissed.load(std::memory_order_relaxed) };
+    }
+
+private:
+    HighResTimer(const HighResTimer&) = delete;
+    HighResTimer(HighResTimer&&) = delete;
+    HighResTimer& operator=(const HighResTimer&) = delete;
+    HighResTimer& operator=(HighResTimer&&) = delete;
+
+    void Run(std::stop_token stopToken);
+
+    // Sleeps until the spin window, then spins out the rest. False if stopped on the way
+    bool WaitUntil(std::stop_token& stopToken, RealClock::time_point deadline);
+
+private:
+    const std::string m_name;
+    const TimeNS m_period;
+    const TimeNS m_spinWindow;
+    ExpiredCb m_cb;
+    std::optional<cpu_set_t> m_affinity{ std::nullopt };
+    std::atomic<size_t> m_nExpiries{ 0 };
+    std::atomic<size_t> m_nMissed{ 0 };
+    // only there to park on, so a stop can wake the sleep early
+    std::mutex m_parkMtx;
+    std::condition_variable_any m_parkCv;
+    std::jthread m_thread;
+};
+
+} // namespace Sage
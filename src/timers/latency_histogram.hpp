@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "timers/time_utils.hpp"
+
+namespace Sage
+{
+
+// Log-linear histogram of durations, good to ~1.5% across nanoseconds to minutes.
+// Each power of two range is split into 64 linear sub-buckets. Not thread safe, keep one per
+// recording thread and merge them afterwards
+
+class LatencyHistogram
+{
+public:
+    void Record(const TimeNS& value) noexcept
+    {
+        const uint64_t ns{ static_cast<uint64_t>(std::max(value.count(), TimeNS::rep{ 0 })) };
+        m_counts[BucketOf(ns)]++;
+        m_count++;
+        m_max = std::max(m_max, ns);
+    }
+
+    void Merge(const LatencyHistogram& other) noexcept
+    {
+        for (size_t i{ 0 }; i < BUCKETS; i++)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    size_t Count() const noexcept { return m_count; }
+
+    TimeNS Max() const noexcept { return TimeNS{ static_cast<TimeNS::rep>(m_max) }; }
+
+    // Upper bound of the bucket holding the given percentile, e.g. 99.9
+    TimeNS Percentile(double percentile) const noexcept
+    {
+        if (m_count == 0)
+        {
+            return TimeNS{ 0 };
+        }
+
+        const double fraction{ std::clamp(percentile, 0.0, 100.0) / 100.0 };
+        const auto rank{ static_cast<size_t>(fraction * static_cast<double>(m_count)) };
+        size_t seen{ 0 };
+        for (size_t i{ 0 }; i < BUCKETS; i++)
+        {
+            seen += m_counts[i];
+            if (seen > rank)
+            {
+                return TimeNS{ static_cast<TimeNS::rep>(std::min(UpperBoundOf(i), m_max)) };
+            }
+        }
+
+        return Max();
+    }
+
+    // The bucket a value is counted in
+    static constexpr size_t BucketOf(uint64_t ns) noexcept
+    {
+        // exact below the first power of two range
+        if (ns < SUB_BUCKETS)
+        {
+            return ns;
+        }
+
+        // shifted down into [SUB_BUCKETS, 2 * SUB_BUCKETS), so the top bit is implied and the rest pick the sub-bucket
+        const size_t magnitude{ static_cast<size_t>(std::bit_width(ns)) - SUB_BUCKET_BITS - 1 };
+        const size_t subBucket{ static_cast<size_t>(ns >> magnitude) - SUB_BUCKETS };
+        return std::min(((magnitude + 1) * SUB_BUCKETS) + subBucket, BUCKETS - 1);
+    }
+
+    // The largest value counted in a bucket
+    static constexpr uint64_t UpperBoundOf(size_t bucket) noexcept
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+
+        const size_t magnitude{ (bucket / SUB_BUCKETS) - 1 };
+        const uint64_t subBucket{ (bucket % SUB_BUCKETS) + SUB_BUCKETS };
+        return ((subBucket + 1) << magnitude) - 1;
+    }
+
+private:
+    static constexpr size_t SUB_BUCKET_BITS{ 6 };
+    static constexpr size_t SUB_BUCKETS{ 1 << SUB_BUCKET_BITS };
+    // ~18 minutes in nanoseconds, anything longer lands in the last bucket
+    static constexpr size_t MAX_BITS{ 40 };
+    static constexpr size_t BUCKETS{ (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS };
+
+private:
+    std::array<size_t, BUCKETS> m_counts{};
+    size_t m_count{ 0 };
+    uint64_t m_max{ 0 };
+};
+
+// Values on and around octave boundaries decode to the top of their own bucket, at most 1/64 above them
+static_assert(
+    []
+    {
+        for (const uint64_t ns : { 63, 64, 65, 127, 128, 129, 1000, 991'000, (1 << 20) - 1, 1 << 20, (1 << 20) + 1 })
+        {
+            const size_t bucket{ LatencyHistogram::BucketOf(ns) };
+            const uint64_t upper{ LatencyHistogram::UpperBoundOf(bucket) };
+            if (upper < ns or upper - ns > ns / 64 or LatencyHistogram::BucketOf(upper) != bucket or
+                LatencyHistogram::BucketOf(upper + 1) != bucket + 1)
+            {
+                return false;
+            }
+        }
+        return true;
+    }()
+);
+
+} // namespace Sage
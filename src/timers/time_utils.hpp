@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <linux/time_types.h>
 
@@ -10,12 +11,60 @@ using namespace std::chrono_literals;
 
 // Useful aliases
 
-using Clock = std::chrono::steady_clock;
+// Wall time, for anything measured against real sleeps and waits
+using RealClock = std::chrono::steady_clock;
 using TimeNS = std::chrono::nanoseconds;
 using TimeUS = std::chrono::microseconds;
 using TimeMS = std::chrono::milliseconds;
 using TimeS = std::chrono::seconds;
 
+// Steady clock that can be switched over to virtual time for deterministic runs.
+// Virtual time only ever moves when the timer thread advances it to the next deadline.
+// Must be switched before any threads are started
+
+struct Clock
+{
+    using rep = RealClock::rep;
+    using period = RealClock::period;
+    using duration = RealClock::duration;
+    using time_point = RealClock::time_point;
+
+    static constexpr bool is_steady{ true };
+
+    static time_point now() noexcept
+    {
+        if (IsVirtual()) [[unlikely]]
+        {
+            return time_point{ duration{ s_virtualNow.load(std::memory_order_acquire) } };
+        }
+
+        return RealClock::now();
+    }
+
+    static bool IsVirtual() noexcept { return s_virtual.load(std::memory_order_relaxed); }
+
+    static void EnableVirtualTime(time_point start = RealClock::now()) noexcept
+    {
+        s_virtualNow.store(start.time_since_epoch().count(), std::memory_order_release);
+        s_virtual.store(true, std::memory_order_relaxed);
+    }
+
+    // Virtual time never goes backwards
+    static void AdvanceTo(time_point target) noexcept
+    {
+        const rep targetCount{ target.time_since_epoch().count() };
+        rep current{ s_virtualNow.load(std::memory_order_relaxed) };
+        while (current < targetCount and
+               not s_virtualNow.compare_exchange_weak(current, targetCount, std::memory_order_acq_rel))
+        {
+        }
+    }
+
+private:
+    static inline std::atomic<bool> s_virtual{ false };
+    static inline std::atomic<rep> s_virtualNow{ 0 };
+};
+
 // Helpers
 
 constexpr timespec ChronoTimeToTimeSpec(const TimeNS& duration) noexcept
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <sched.h>
+
+#include "log/logger.hpp"
+#include "timers/timer_service.hpp"
+
+namespace Sage
+{
+
+TimerService::TimerService(size_t nShards, TimerBackend backend, const URingSetup& ringSetup) :
+    m_nCpus{ std::max<size_t>(std::thread::hardware_concurrency(), 1) }
+{
+    // virtual time is advanced by whichever timer thread goes idle first, so only one may exist
+    if (Clock::IsVirtual() and nShards > 1)
+    {
+        LOG_WARNING("virtual time only supports a single timer shard. requested:{}", nShards);
+        nShards = 1;
+    }
+
+    nShards = std::clamp<size_t>(nShards, 1, std::min(m_nCpus, TimerThread::MAX_SHARDS));
+    m_shards.reserve(nShards);
+
+    for (size_t shard{ 0 }; shard < nShards; shard++)
+    {
+        auto& timerThread{ m_shards.emplace_back(std::make_unique<TimerThread>(backend, shard, ringSetup)) };
+        if (nShards == 1)
+        {
+            // free to run anywhere, as before sharding
+            continue;
+        }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (size_t cpu{ shard * m_nCpus / nShards }; cpu < (shard + 1) * m_nCpus / nShards; cpu++)
+        {
+            CPU_SET(cpu, &cpus);
+        }
+        timerThread->SetAffinity(cpus);
+    }
+
+    LOG_INFO("timer service c'tor n-shards:{} n-cpus:{}", nShards, m_nCpus);
+}
+
+TimerService::~TimerService() { LOG_DEBUG("timer service d'tor"); }
+
+void TimerService::Start()
+{
+    for (auto& shard : m_shards)
+    {
+        shard->Start();
+    }
+}
+
+void TimerService::Stop()
+{
+    for (auto& shard : m_shards)
+    {
+        shard->Stop();
+    }
+}
+
+TimerThread& TimerService::ShardForCpu(int cpu) noexcept
+{
+    if (cpu < 0)
+    {
+        return *m_shards.front();
+    }
+
+    const size_t shard{ static_cast<size_t>(cpu) * m_shards.size() / m_nCpus };
+    return *m_shards[std::min(shard, m_shards.size() - 1)];
+}
+
+TimerThread& TimerService::LocalShard() noexcept { return ShardForCpu(sched_getcpu()); }
+
+TimerThread& TimerService::ShardOf(TimerEventId id) noexcept
+{
+    const size_t shard{ TimerThread::ShardOf(id) };
+    if (shard >= m_shards.size()) [[unlikely]]
+    {
+        LOG_CRITICAL("timer-id:{} has unknown shard:{}", id, shard);
+        return *m_shards.front();
+    }
+
+    return *m_shards[shard];
+}
+
+void TimerService::RequestTimerUpdate(TimerEventId id, const TimeNS& timeout)
+{
+    ShardOf(id).RequestTimerUpdate(id, timeout);
+}
+
+void TimerService::RequestTimerStop(TimerEventId id, bool logOnDrop, bool oneShot)
+{
+    ShardOf(id).RequestTimerStop(id, logOnDrop, oneShot);
+}
+
+TimerThread::Stats TimerService::GetStats() const noexcept
+{
+    TimerThread::Stats total{ .m_expiries = 0, .m_wakeups = 0, .m_ringEnters = 0 };
+    for (const auto& shard : m_shards)
+    {
+        const auto stats{ shard->GetStats() };
+        total.m_expiries += stats.m_expiries;
+        total.m_wakeups += stats.m_wakeups;
+        total.m_ringEnters += stats.m_ringEnters;
+    }
+
+    return total;
+}
+
+} // namespace Sage
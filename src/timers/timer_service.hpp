@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "threading/events.hpp"
+#include "timers/time_utils.hpp"
+#include "timers/timer_thread.hpp"
+
+namespace Sage
+{
+
+// Shards timers over several timer threads, each with its own ring.
+// CPUs are split into contiguous ranges, one per shard, so neighbouring cores share a shard
+// and each shard's thread is pinned to its range. Timer ids carry their shard, so updates
+// and stops can be routed from anywhere
+
+class TimerService
+{
+public:
+    explicit TimerService(
+        size_t nShards = std::thread::hardware_concurrency(), TimerBackend backend = TimerBackend::URing,
+        const URingSetup& ringSetup = {}
+    );
+
+    ~TimerService();
+
+    void Start();
+
+    void Stop();
+
+    size_t Shards() const noexcept { return m_shards.size(); }
+
+    TimerThread& Shard(size_t index) noexcept { return *m_shards[index]; }
+
+    // The shard serving a cpu, e.g. from sched_getcpu()
+    TimerThread& ShardForCpu(int cpu) noexcept;
+
+    // The shard serving whichever cpu the caller is running on
+    TimerThread& LocalShard() noexcept;
+
+    // The shard that owns the timer
+    TimerThread& ShardOf(TimerEventId id) noexcept;
+
+    void RequestTimerUpdate(TimerEventId id, const TimeNS& timeout);
+
+    void RequestTimerStop(TimerEventId id, bool logOnDrop = false, bool oneShot = false);
+
+    // Summed over all shards
+    TimerThread::Stats GetStats() const noexcept;
+
+private:
+    TimerService(const TimerService&) = delete;
+    TimerService(TimerService&&) = delete;
+    TimerService& operator=(const TimerService&) = delete;
+    TimerService& operator=(TimerService&&) = delete;
+
+private:
+    const size_t m_nCpus;
+    std::vector<std::unique_ptr<TimerThread>> m_shards;
+};
+
+} // namespace Sage
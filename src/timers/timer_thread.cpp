@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <bit>
 #include <cstring>
+#include <format>
+#include <limits>
 #include <memory>
 #include <pthread.h>
 #include <stop_token>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <utility>
@@ -11,12 +16,34 @@
 #include "threading/events.hpp"
 #include "timers/scoped_deadline.hpp"
 #include "timers/timer_thread.hpp"
+#include "timers/virtual_scheduler.hpp"
 #include "uring/io_uring.hpp"
 
 namespace Sage
 {
 
-TimerThread::TimerThread(Channel::ChannelPair<TimerEvent> channel) :
+TimerThread::TimerThread(
+    TimerBackend backend, size_t shard, const URingSetup& ringSetup, Channel::ChannelPair<TimerEvent> channel
+) :
+    m_backend{ backend },
+    m_shard{ shard },
+    m_uring{ URING_QUEUE_SIZE, IOURing::SubmitMode::Deferred, ringSetup },
+    m_onWheelExpired{ [this](const TimerWheel::Record& record)
+                      {
+                          LOG_DEBUG("triggering wheel handler eventId({})", record.m_id);
+                          const auto scheduled{ m_wheelEpoch +
+                                                (WHEEL_TICK * static_cast<TimeNS::rep>(record.m_expiry)) };
+                          QueueExpiry(
+                              m_txs.Shared(record.m_userIndex),
+                              TimerExpiry{ .m_id = record.m_id, .m_scheduled = scheduled }
+                          );
+
+                          // the wheel releases one-shot records itself
+                          if (record.m_periodTicks == 0)
+                          {
+                              m_txs.Release(record.m_userIndex);
+                          }
+                      } },
     m_tx{ std::move(channel.tx) },
     m_thread{ &TimerThread::Run, this, std::move(channel.rx) }
 {
@@ -25,15 +52,104 @@ TimerThread::TimerThread(Channel::ChannelPair<TimerEvent> channel) :
 
 TimerThread::~TimerThread() { LOG_DEBUG("timer thread d'tor"); }
 
-TimerEventId TimerThread::RequestTimerAdd(const TimeNS& timeout, SharedThreadTx tx)
+bool TimerThread::SetAffinity(const cpu_set_t& cpus)
+{
+    if (int res = pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus); res != 0)
+    {
+        LOG_ERROR("failed to set timer thread shard:{} affinity. {}", m_shard, strerror(res));
+        return false;
+    }
+
+    return true;
+}
+
+TimerEventId TimerThread::RequestTimerAdd(const TimeNS& timeout, SharedThreadTx tx, const TimeNS& slack)
 {
     auto e{ std::make_unique<TimerAddEvent>() };
-    TimerEventId id{ e->m_id };
     e->m_timeout = timeout;
+    e->m_slack = slack;
     e->m_tx = std::move(tx);
-    LOG_DEBUG("requesting to add timer:{} with timeout:{}", id, timeout);
+    return RequestTimerAdd(std::move(e));
+}
 
-    m_tx->send(std::move(e));
+TimerEventId TimerThread::RequestInlineTimerAdd(
+    const TimeNS& timeout, SharedThreadTx tx, InlineTimerCb cb, const TimeNS& budget
+)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_timeout = timeout;
+    e->m_tx = std::move(tx);
+    e->m_inlineCb = std::move(cb);
+    e->m_inlineBudget = budget;
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestSendAfter(
+    const TimeNS& delay, SharedThreadTx tx, ThreadEventFactory makeEvent, SharedQueueDepth queueDepth
+)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_mode = TimerMode::OneShot;
+    e->m_timeout = delay;
+    e->m_tx = std::move(tx);
+    e->m_makeEvent = std::move(makeEvent);
+    e->m_queueDepth = std::move(queueDepth);
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestSendEvery(
+    const TimeNS& period, SharedThreadTx tx, ThreadEventFactory makeEvent, SharedQueueDepth queueDepth
+)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_timeout = period;
+    e->m_tx = std::move(tx);
+    e->m_makeEvent = std::move(makeEvent);
+    e->m_queueDepth = std::move(queueDepth);
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestCadenceTimerAdd(const TimeNS& period, SharedThreadTx tx, Clock::time_point anchor)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_mode = TimerMode::Cadence;
+    e->m_timeout = period;
+    e->m_deadline = anchor;
+    e->m_tx = std::move(tx);
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestOneShotTimerAdd(const TimeNS& timeout, SharedThreadTx tx, const TimeNS& slack)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_mode = TimerMode::OneShot;
+    e->m_timeout = timeout;
+    e->m_slack = slack;
+    e->m_tx = std::move(tx);
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestDeadlineTimerAdd(Clock::time_point deadline, SharedThreadTx tx, const TimeNS& slack)
+{
+    auto e{ std::make_unique<TimerAddEvent>() };
+    e->m_mode = TimerMode::Deadline;
+    e->m_timeout = std::max(TimeNS{ deadline - Clock::now() }, TimeNS{ 0 });
+    e->m_deadline = deadline;
+    e->m_slack = slack;
+    e->m_tx = std::move(tx);
+    return RequestTimerAdd(std::move(e));
+}
+
+TimerEventId TimerThread::RequestTimerAdd(std::unique_ptr<TimerAddEvent> event)
+{
+    // tag the id with this shard, so stops and updates can be routed back here
+    event->m_id = static_cast<TimerEventId>((static_cast<size_t>(event->m_id) << SHARD_BITS) | m_shard);
+    TimerEventId id{ event->m_id };
+    LOG_DEBUG(
+        "requesting to add timer:{} with timeout:{} mode:{}", id, event->m_timeout, static_cast<int>(event->m_mode)
+    );
+
+    m_tx->send(std::move(event));
     return id;
 }
 
@@ -47,151 +163,336 @@ void TimerThread::RequestTimerUpdate(TimerEventId id, const TimeNS& timeout)
     m_tx->send(std::move(e));
 }
 
-void TimerThread::RequestTimerStop(TimerEventId id, bool logOnDrop)
+void TimerThread::RequestTimerStop(TimerEventId id, bool logOnDrop, bool oneShot)
 {
     LOG_DEBUG("requesting to stop timer:{}", id);
 
     auto e{ std::make_unique<TimerStopEvent>() };
     e->m_timerToStop = id;
+    e->m_oneShot = oneShot;
     m_tx->send(std::move(e), logOnDrop);
 }
 
 void TimerThread::Run(std::unique_ptr<Channel::Rx<TimerEvent>> rx)
 {
-    pthread_setname_np(pthread_self(), "TimerThread");
+    const std::string threadName{ m_shard == 0 ? "TimerThread" : std::format("TimerThread-{}", m_shard) };
+    pthread_setname_np(pthread_self(), threadName.c_str());
 
     // For for start trigger
     m_startLatch.wait();
 
     LOG_INFO("timer thread started");
 
+    // claims a single issuer ring for this thread
+    m_uring.Enable();
+
     std::stop_token stopToken{ m_thread.get_stop_token() };
+    m_wheelEpoch = Clock::now();
 
-    while (not stopToken.stop_requested())
+    if (Clock::IsVirtual())
     {
-        if (auto uringEvent{ m_uring.WaitForEvent(20ms) }; uringEvent != nullptr)
+        LOG_INFO("timer thread running on virtual time");
+
+        while (not stopToken.stop_requested())
         {
-            URingEventId userData{ uringEvent->user_data };
-            auto itr{ m_pendingUringEvents.find(userData) };
-            if (itr == m_pendingUringEvents.end())
+            if (VirtualScheduler::Idle() and not m_virtualDeadlines.empty())
             {
-                LOG_ERROR("failed to find event for user-data={}", userData);
-                continue;
+                FireNextVirtualDeadline();
+                FlushExpiries();
+                HandleTimerEvents(*rx, 0ns);
             }
+            else
+            {
+                HandleTimerEvents(*rx, m_virtualDeadlines.empty() ? TimeNS{ URING_WAIT_TIMEOUT } : VIRTUAL_BUSY_POLL);
+            }
+        }
+    }
 
-            auto& event{ itr->second };
-
-            event->m_onCompleteCb(*event, *uringEvent);
-
-            // dont remove the continuously firing timer
-            if (event->m_removeOnComplete)
+    while (not stopToken.stop_requested())
+    {
+        // drain everything that's ready before going back to the channel
+        const size_t expiriesBefore{ m_nExpiries.load(std::memory_order_relaxed) };
+        for (auto batch{ m_uring.WaitForEvents(URING_WAIT_TIMEOUT) }; not batch.empty(); batch = m_uring.PeekEvents())
+        {
+            for (const io_uring_cqe* uringEvent : batch)
             {
-                m_pendingUringEvents.erase(itr);
+                OnCompleteURingOp(*uringEvent);
             }
         }
 
+        if (m_nExpiries.load(std::memory_order_relaxed) != expiriesBefore)
+        {
+            m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        FlushExpiries();
+
         // for update ops
-        auto channelEvents{ rx->tryReceiveMany(10ns) };
-        for (const auto& e : channelEvents)
+        HandleTimerEvents(*rx, 10ns);
+
+        // adding and updating wheel timers can catch the wheel up
+        FlushExpiries();
+    }
+
+    LOG_INFO("timer thread stopped");
+
+    m_stopLatch.count_down();
+}
+
+void TimerThread::HandleTimerEvents(Channel::Rx<TimerEvent>& rx, const TimeNS& timeout)
+{
+    auto channelEvents{ rx.tryReceiveMany(timeout) };
+    for (const auto& e : channelEvents)
+    {
+        switch (e->Type())
         {
-            switch (e->Type())
+            case TimerEvent::Add:
             {
-                case TimerEvent::Add:
+                // registered only once the timer is armed, so a failed add leaves nothing behind
+                auto& tEvent{ static_cast<TimerAddEvent&>(*e) };
+                if (not AddTimer(tEvent))
                 {
-                    const auto& tEvent{ static_cast<const TimerAddEvent&>(*e) };
-                    AddTimer(tEvent);
                     break;
                 }
 
-                case TimerEvent::Update:
+                if (tEvent.m_inlineCb)
                 {
-                    const auto& tEvent{ static_cast<const TimerUpdateEvent&>(*e) };
-                    UpdateTimer(tEvent);
-                    break;
+                    m_inlineTimers.emplace(
+                        tEvent.m_id,
+                        InlineTimer{ .m_cb = std::move(tEvent.m_inlineCb), .m_budget = tEvent.m_inlineBudget }
+                    );
                 }
-
-                case TimerEvent::Stop:
+                else if (tEvent.m_makeEvent)
                 {
-                    const auto& tEvent{ static_cast<const TimerStopEvent&>(*e) };
-                    CancelTimer(tEvent);
-                    break;
+                    m_sendTimers.emplace(
+                        tEvent.m_id,
+                        SendTimer{ .m_makeEvent = std::move(tEvent.m_makeEvent),
+                                   .m_queueDepth = std::move(tEvent.m_queueDepth),
+                                   .m_periodic = tEvent.m_mode == TimerMode::Periodic }
+                    );
                 }
+                break;
+            }
+
+            case TimerEvent::Update:
+            {
+                const auto& tEvent{ static_cast<const TimerUpdateEvent&>(*e) };
+                UpdateTimer(tEvent);
+                break;
+            }
+
+            case TimerEvent::Stop:
+            {
+                const auto& tEvent{ static_cast<const TimerStopEvent&>(*e) };
+                m_inlineTimers.erase(tEvent.m_timerToStop);
+                m_sendTimers.erase(tEvent.m_timerToStop);
+                CancelTimer(tEvent);
+                break;
             }
         }
     }
 
-    LOG_INFO("timer thread stopped");
-
-    m_stopLatch.count_down();
+    VirtualScheduler::WorkDone(channelEvents.size());
+    m_handledRequests.fetch_add(channelEvents.size(), std::memory_order_release);
 }
 
 // Queuing
 
-void TimerThread::AddTimer(const TimerAddEvent& event)
+bool TimerThread::AddTimer(const TimerAddEvent& event)
 {
-    auto uringEvent{ std::make_unique<URingTimerExpiredEvent>(
-        event.m_id,
-        [this](URingTimerEvent& event, const io_uring_cqe& cEvent) { OnCompleteTimerExpired(event, cEvent); }
-    ) };
-    auto urId{ uringEvent->m_uringId };
-    LOG_RETURN_IF(not m_uring.QueueTimeoutEvent(urId, event.m_timeout), LOG_CRITICAL);
+    if (Clock::IsVirtual())
+    {
+        AddVirtualTimer(event);
+        return true;
+    }
 
-    m_pendingUringEvents[urId] = std::move(uringEvent);
-    m_txs[event.m_id] = event.m_tx;
+    // the wheel would round cadences to its ticks, so they go on the exact grid on either backend
+    if (m_backend == TimerBackend::Wheel and event.m_mode != TimerMode::Cadence)
+    {
+        return AddWheelTimer(event);
+    }
+
+    if (event.m_slack > 0ns or event.m_mode == TimerMode::Cadence)
+    {
+        AddCoalescedTimer(event);
+        return true;
+    }
+
+    // every expiry is a one shot on the absolute grid, and periodic timers are re-armed as they fire.
+    // Multishot timeouts re-arm relative to each firing, so they drift further off the grid every period
+    const auto due{ event.m_mode == TimerMode::Deadline ? event.m_deadline : Clock::now() + event.m_timeout };
+    const TxTable::Index txIndex{ m_txs.Acquire(event.m_tx) };
+    const auto opData{ m_uringOps.Acquire(URingTimerOp::Expiry, event.m_id, txIndex) };
+    if (not m_uring.QueueDeadlineEvent(opData, due))
+    {
+        LOG_CRITICAL("failed to queue timer id:{}", event.m_id);
+        m_uringOps.Release(opData);
+        m_txs.Release(txIndex);
+        return false;
+    }
+
+    m_uringTimers[event.m_id] = URingTimer{ .m_op = opData,
+                                            .m_period = std::max(event.m_timeout, TimeNS{ 1ns }),
+                                            .m_due = due,
+                                            .m_periodic = event.m_mode == TimerMode::Periodic };
     LOG_DEBUG("added timer id:{} timeout:{}", event.m_id, event.m_timeout);
+    return true;
 }
 
 void TimerThread::UpdateTimer(const TimerUpdateEvent& event)
 {
-    auto pendingEvent{ FindUringPendingEvent<URingTimerExpiredEvent>(event.m_timerToUpdate) };
-    LOG_RETURN_IF(pendingEvent == nullptr, LOG_CRITICAL);
+    if (Clock::IsVirtual())
+    {
+        UpdateVirtualTimer(event);
+        return;
+    }
 
-    auto uringEvent{ std::make_unique<URingTimerUpdateEvent>(
-        event.m_id, [this](URingTimerEvent& event, const io_uring_cqe& cEvent) { OnCompleteTimerUpdate(event, cEvent); }
-    ) };
-    auto urId{ uringEvent->m_uringId };
-    LOG_RETURN_IF(not m_uring.UpdateTimeoutEvent(urId, pendingEvent->m_uringId, event.m_newTimeout), LOG_CRITICAL);
+    if (m_coalescedTimers.contains(event.m_timerToUpdate))
+    {
+        UpdateCoalescedTimer(event);
+        return;
+    }
+
+    if (m_backend == TimerBackend::Wheel)
+    {
+        UpdateWheelTimer(event);
+        return;
+    }
+
+    auto itr{ m_uringTimers.find(event.m_timerToUpdate) };
+    LOG_RETURN_IF(itr == m_uringTimers.end(), LOG_CRITICAL);
 
-    m_pendingUringEvents[urId] = std::move(uringEvent);
-    LOG_DEBUG("updated timer id:{} timeout:{}", event.m_id, event.m_newTimeout);
+    auto& timer{ itr->second };
+    const auto due{ Clock::now() + event.m_newTimeout };
+    const auto opData{ m_uringOps.Acquire(URingTimerOp::Update, event.m_timerToUpdate) };
+    if (not m_uring.UpdateDeadlineEvent(opData, timer.m_op, due))
+    {
+        LOG_CRITICAL("failed to queue update for timer id:{}", event.m_timerToUpdate);
+        m_uringOps.Release(opData);
+        return;
+    }
+
+    timer.m_period = std::max(event.m_newTimeout, TimeNS{ 1ns });
+    timer.m_due = due;
+
+    LOG_DEBUG("updated timer id:{} timeout:{}", event.m_timerToUpdate, event.m_newTimeout);
 }
 
 void TimerThread::CancelTimer(const TimerStopEvent& event)
 {
-    auto pendingEvent{ FindUringPendingEvent<URingTimerExpiredEvent>(event.m_timerToStop) };
-    LOG_RETURN_IF(pendingEvent == nullptr, LOG_CRITICAL);
+    if (Clock::IsVirtual())
+    {
+        CancelVirtualTimer(event);
+        return;
+    }
 
-    auto uringEvent{ std::make_unique<URingTimerCancelEvent>(
-        event.m_id, [this](URingTimerEvent& event, const io_uring_cqe& cEvent) { OnCompleteTimerCancel(event, cEvent); }
-    ) };
-    auto urId{ uringEvent->m_uringId };
-    LOG_RETURN_IF(not m_uring.CancelTimeoutEvent(urId, pendingEvent->m_uringId), LOG_CRITICAL);
+    if (m_coalescedTimers.contains(event.m_timerToStop))
+    {
+        CancelCoalescedTimer(event);
+        return;
+    }
+
+    if (m_backend == TimerBackend::Wheel)
+    {
+        CancelWheelTimer(event);
+        return;
+    }
+
+    auto itr{ m_uringTimers.find(event.m_timerToStop) };
+    LOG_RETURN_IF(itr == m_uringTimers.end() and not event.m_oneShot, LOG_CRITICAL);
+    if (itr == m_uringTimers.end())
+    {
+        LOG_DEBUG("one-shot timer id:{} already fired", event.m_timerToStop);
+        return;
+    }
+
+    const auto opData{ m_uringOps.Acquire(URingTimerOp::Cancel, event.m_timerToStop) };
+    if (not m_uring.CancelTimeoutEvent(opData, itr->second.m_op))
+    {
+        LOG_CRITICAL("failed to queue cancel for timer id:{}", event.m_timerToStop);
+        m_uringOps.Release(opData);
+        return;
+    }
 
-    m_pendingUringEvents[urId] = std::move(uringEvent);
-    LOG_DEBUG("cancelled timer id:{}", event.m_id);
+    // the expiry op itself is released once its final completion comes back
+    m_uringTimers.erase(itr);
+    LOG_DEBUG("cancelled timer id:{}", event.m_timerToStop);
 }
 
 // Callbacks
 
-void TimerThread::OnCompleteTimerExpired(URingTimerEvent& event, const io_uring_cqe& cEvent)
+void TimerThread::OnCompleteURingOp(const io_uring_cqe& cEvent)
 {
-    int eventRes{ cEvent.res };
+    const URingOpTable::Record* found{ m_uringOps.Find(cEvent.user_data) };
+    if (found == nullptr)
+    {
+        LOG_ERROR("no in flight op for user-data={}", cEvent.user_data);
+        return;
+    }
+
+    // completions may queue new ops and grow the table, so work off a copy
+    const URingOpTable::Record op{ *found };
+
+    // multishot timeouts flag every completion but their last
+    if ((cEvent.flags & IORING_CQE_F_MORE) == 0)
+    {
+        m_uringOps.Release(cEvent.user_data);
+    }
+
+    switch (op.m_op)
+    {
+        case URingTimerOp::Expiry:
+        {
+            OnCompleteTimerExpired(op, cEvent);
+            break;
+        }
+
+        case URingTimerOp::Update:
+        {
+            OnCompleteTimerUpdate(op, cEvent);
+            break;
+        }
+
+        case URingTimerOp::Cancel:
+        {
+            OnCompleteTimerCancel(op, cEvent);
+            break;
+        }
+
+        case URingTimerOp::WheelTick:
+        {
+            OnCompleteWheelTick(cEvent);
+            break;
+        }
 
-    auto itr{ m_txs.find(event.m_timerEventId) };
-    LOG_RETURN_IF(itr == m_txs.end(), LOG_CRITICAL);
+        case URingTimerOp::CoalescedTick:
+        {
+            OnCompleteCoalescedTick(cEvent);
+            break;
+        }
+
+        case URingTimerOp::WheelUpdate:
+        case URingTimerOp::CoalescedUpdate:
+        {
+            // the tick may already have fired, its completion re-arms anyway
+            LOG_IF(cEvent.res != 0 and cEvent.res != -ENOENT, LOG_ERROR);
+            break;
+        }
+    }
+}
+
+void TimerThread::OnCompleteTimerExpired(const URingOpTable::Record& op, const io_uring_cqe& cEvent)
+{
+    int eventRes{ cEvent.res };
 
     switch (eventRes)
     {
         // timer expired
         case -ETIME:
         {
-            LOG_DEBUG("triggering handler eventId({})", event.m_timerEventId);
-
-            {
-                ScopedDeadline dl{ "CompleteTimerExpiredEvent:" + std::to_string(event.m_timerEventId), 20ms };
-                auto& tx{ itr->second };
-                tx->send(std::make_unique<TimerExpiredEvent>(event.m_timerEventId));
-            }
+            LOG_DEBUG("triggering handler eventId({})", op.m_timerId);
+            const TimerExpiry expiry{ NextURingExpiry(op, cEvent) };
+            QueueExpiry(m_txs.Shared(op.m_txIndex), expiry);
 
             break;
         }
@@ -199,20 +500,76 @@ void TimerThread::OnCompleteTimerExpired(URingTimerEvent& event, const io_uring_
         // timer cancelled
         case -ECANCELED:
         {
-            LOG_DEBUG("timer cancelled eventId({})", event.m_timerEventId);
-            m_txs.erase(itr);
+            LOG_DEBUG("timer cancelled eventId({})", op.m_timerId);
             break;
         }
 
         default:
         {
-            LOG_ERROR("failed eventId({}) res({}) {}", event.m_timerEventId, eventRes, strerror(-eventRes));
+            LOG_ERROR("failed eventId({}) res({}) {}", op.m_timerId, eventRes, strerror(-eventRes));
             break;
         }
     }
+
+    if ((cEvent.flags & IORING_CQE_F_MORE) == 0)
+    {
+        // no longer armed, whether fired once, cancelled or failed
+        m_txs.Release(op.m_txIndex);
+        auto itr{ m_uringTimers.find(op.m_timerId) };
+        if (itr != m_uringTimers.end() and itr->second.m_op == cEvent.user_data)
+        {
+            m_uringTimers.erase(itr);
+        }
+    }
+}
+
+TimerExpiry TimerThread::NextURingExpiry(const URingOpTable::Record& op, const io_uring_cqe& cEvent)
+{
+    const auto now{ Clock::now() };
+    auto itr{ m_uringTimers.find(op.m_timerId) };
+    if (itr == m_uringTimers.end() or itr->second.m_op != cEvent.user_data)
+    {
+        return TimerExpiry{ .m_id = op.m_timerId, .m_scheduled = now };
+    }
+
+    auto& timer{ itr->second };
+    TimerExpiry expiry{ .m_id = op.m_timerId, .m_scheduled = timer.m_due };
+    if (not timer.m_periodic)
+    {
+        return expiry;
+    }
+
+    if (timer.m_due > now)
+    {
+        // fired on the deadline an update replaced, before the update reached the ring
+        expiry.m_scheduled = now;
+    }
+    else
+    {
+        // nothing is armed between a firing and its re-arm, so the periods that passed meanwhile never fired
+        expiry.m_missed = static_cast<uint32_t>(
+            std::min<TimeNS::rep>((now - timer.m_due) / timer.m_period, std::numeric_limits<uint32_t>::max())
+        );
+        timer.m_due += timer.m_period * (expiry.m_missed + 1);
+    }
+
+    // the next one shot holds the destination too, the completed one lets go of it once handled
+    const auto opData{
+        m_uringOps.Acquire(URingTimerOp::Expiry, op.m_timerId, m_txs.Acquire(m_txs.Shared(op.m_txIndex)))
+    };
+    if (not m_uring.QueueDeadlineEvent(opData, timer.m_due))
+    {
+        LOG_CRITICAL("failed to re-arm timer id:{}", op.m_timerId);
+        m_uringOps.Release(opData);
+        m_txs.Release(op.m_txIndex);
+        return expiry;
+    }
+
+    timer.m_op = opData;
+    return expiry;
 }
 
-void TimerThread::OnCompleteTimerUpdate(URingTimerEvent& event, const io_uring_cqe& cEvent)
+void TimerThread::OnCompleteTimerUpdate(const URingOpTable::Record& op, const io_uring_cqe& cEvent)
 {
     int eventRes{ cEvent.res };
     switch (eventRes)
@@ -220,19 +577,26 @@ void TimerThread::OnCompleteTimerUpdate(URingTimerEvent& event, const io_uring_c
         // timer update acknowledged
         case 0:
         {
-            LOG_DEBUG("timer update acknowledged eventId({})", event.m_timerEventId);
+            LOG_DEBUG("timer update acknowledged eventId({})", op.m_timerId);
+            break;
+        }
+
+        // fired before the update got there. its completion re-arms on the new schedule
+        case -ENOENT:
+        {
+            LOG_DEBUG("timer update raced an expiry eventId({})", op.m_timerId);
             break;
         }
 
         default:
         {
-            LOG_ERROR("failed eventId({}) res({}) {}", event.m_timerEventId, eventRes, strerror(-eventRes));
+            LOG_ERROR("failed eventId({}) res({}) {}", op.m_timerId, eventRes, strerror(-eventRes));
             break;
         }
     }
 }
 
-void TimerThread::OnCompleteTimerCancel(URingTimerEvent& event, const io_uring_cqe& cEvent)
+void TimerThread::OnCompleteTimerCancel(const URingOpTable::Record& op, const io_uring_cqe& cEvent)
 {
     int eventRes{ cEvent.res };
     switch (eventRes)
@@ -240,16 +604,517 @@ void TimerThread::OnCompleteTimerCancel(URingTimerEvent& event, const io_uring_c
         // timer cancellation acknowledged
         case 0:
         {
-            LOG_DEBUG("timer cancellation acknowledged eventId({})", event.m_timerEventId);
+            LOG_DEBUG("timer cancellation acknowledged eventId({})", op.m_timerId);
+            break;
+        }
+
+        // fired before the cancel got there. its completion finds the timer gone and doesn't re-arm
+        case -ENOENT:
+        {
+            LOG_DEBUG("timer cancellation raced an expiry eventId({})", op.m_timerId);
             break;
         }
 
         default:
         {
-            LOG_ERROR("failed eventId({}) res({}) {}", event.m_timerEventId, eventRes, strerror(-eventRes));
+            LOG_ERROR("failed eventId({}) res({}) {}", op.m_timerId, eventRes, strerror(-eventRes));
             break;
         }
     }
 }
 
+// Expiry delivery
+
+void TimerThread::QueueExpiry(const SharedThreadTx& tx, const TimerExpiry& expiry)
+{
+    // these act right here on the timer thread, there's no expiry to deliver
+    if ((not m_inlineTimers.empty() and RunInlineTimer(tx, expiry)) or
+        (not m_sendTimers.empty() and RunSendTimer(tx, expiry)))
+    {
+        CountExpiries(1);
+        return;
+    }
+
+    auto [itr, inserted]{ m_pendingExpiries.try_emplace(tx.get()) };
+    if (inserted)
+    {
+        // keeps the destination alive, even if its last timer is released before the flush
+        itr->second.m_tx = tx;
+    }
+
+    itr->second.m_expiries.emplace_back(expiry);
+    m_expiriesPending = true;
+    CountExpiries(1);
+}
+
+bool TimerThread::RunInlineTimer(const SharedThreadTx& tx, const TimerExpiry& expiry)
+{
+    auto itr{ m_inlineTimers.find(expiry.m_id) };
+    if (itr == m_inlineTimers.end())
+    {
+        return false;
+    }
+
+    auto& timer{ itr->second };
+    const auto start{ RealClock::now() };
+    timer.m_cb();
+    const TimeNS took{ RealClock::now() - start };
+    if (took <= timer.m_budget) [[likely]]
+    {
+        return true;
+    }
+
+    // sent ahead of this pass' expiries, so the thread has the callback before they arrive
+    LOG_WARNING("inline timer id:{} took:{} budget:{}. demoting", expiry.m_id, took, timer.m_budget);
+    tx->send(std::make_unique<TimerDemotedEvent>(expiry.m_id, std::move(timer.m_cb)));
+    m_inlineTimers.erase(itr);
+    return true;
+}
+
+bool TimerThread::RunSendTimer(const SharedThreadTx& tx, const TimerExpiry& expiry)
+{
+    auto itr{ m_sendTimers.find(expiry.m_id) };
+    if (itr == m_sendTimers.end())
+    {
+        return false;
+    }
+
+    // counted before the send, so the receiver never takes the count below zero. A receiver that's gone
+    // just drops it, uncounted, until whoever started the timer stops it
+    const SharedQueueDepth& queueDepth{ itr->second.m_queueDepth };
+    if (queueDepth != nullptr)
+    {
+        queueDepth->fetch_add(1, std::memory_order_relaxed);
+    }
+    if (not tx->send(itr->second.m_makeEvent(), false) and queueDepth != nullptr)
+    {
+        queueDepth->fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    if (not itr->second.m_periodic)
+    {
+        m_sendTimers.erase(itr);
+    }
+
+    return true;
+}
+
+void TimerThread::FlushExpiries()
+{
+    if (not m_expiriesPending)
+    {
+        return;
+    }
+
+    ScopedDeadline dl{ "FlushExpiries", 20ms };
+    for (auto itr{ m_pendingExpiries.begin() }; itr != m_pendingExpiries.end();)
+    {
+        auto& pending{ itr->second };
+        if (not pending.m_expiries.empty())
+        {
+            LOG_TRACE("delivering n-expiries:{}", pending.m_expiries.size());
+
+            // the event takes the batch, the next one starts out as big
+            std::vector<TimerExpiry> expiries;
+            expiries.reserve(pending.m_expiries.size());
+            expiries.swap(pending.m_expiries);
+            pending.m_tx->send(std::make_unique<TimerExpiredEvent>(std::move(expiries)));
+        }
+
+        // only dropped, along with the destination it keeps alive, once no timer sends to it
+        itr = m_txs.Contains(itr->first) ? std::next(itr) : m_pendingExpiries.erase(itr);
+    }
+
+    m_expiriesPending = false;
+}
+
+// Timing wheel
+
+bool TimerThread::AddWheelTimer(const TimerAddEvent& event)
+{
+    // catch the wheel up, so the new expiry is placed relative to now
+    const auto now{ Clock::now() };
+    m_wheel.Advance(WheelTickAt(now), m_onWheelExpired);
+
+    // rounded up, so nothing fires early. every timer due in a tick already fires together,
+    // slack only moves the first expiry onto a shared tick
+    const auto expiresAt{ CoalesceDeadline(
+        event.m_mode == TimerMode::Deadline ? event.m_deadline : now + event.m_timeout, event.m_slack
+    ) };
+    const TimerWheel::Tick expiry{ WheelTickAt(expiresAt + WHEEL_TICK - 1ns) };
+    const auto periodTicks{
+        event.m_mode != TimerMode::Periodic
+            ? 0
+            : static_cast<uint32_t>(std::clamp<TimeNS::rep>(
+                  (event.m_timeout + WHEEL_TICK - 1ns) / WHEEL_TICK, 1, std::numeric_limits<uint32_t>::max()
+              ))
+    };
+
+    const TxTable::Index txIndex{ m_txs.Acquire(event.m_tx) };
+    const TimerWheel::RecordIndex record{ m_wheel.Add(event.m_id, expiry, periodTicks, txIndex) };
+    if (record == TimerWheel::INVALID_RECORD)
+    {
+        m_txs.Release(txIndex);
+        return false;
+    }
+
+    ArmWheel();
+    LOG_DEBUG("added wheel timer id:{} timeout:{} n-timers:{}", event.m_id, event.m_timeout, m_wheel.Size());
+    return true;
+}
+
+void TimerThread::UpdateWheelTimer(const TimerUpdateEvent& event)
+{
+    // catch up first, which may fire a one-shot timer that's being updated
+    const auto now{ Clock::now() };
+    m_wheel.Advance(WheelTickAt(now), m_onWheelExpired);
+
+    const TimerWheel::RecordIndex current{ m_wheel.Find(event.m_timerToUpdate) };
+    LOG_RETURN_IF(current == TimerWheel::INVALID_RECORD, LOG_CRITICAL);
+
+    // keep the interned tx and the mode, only the timing changes
+    const TxTable::Index txIndex{ m_wheel.Get(current).m_userIndex };
+    const bool periodic{ m_wheel.Get(current).m_periodTicks > 0 };
+    m_wheel.Cancel(current);
+
+    const TimerWheel::Tick expiry{ WheelTickAt(now + event.m_newTimeout + WHEEL_TICK - 1ns) };
+    const auto periodTicks{
+        not periodic ? 0
+                     : static_cast<uint32_t>(std::clamp<TimeNS::rep>(
+                           (event.m_newTimeout + WHEEL_TICK - 1ns) / WHEEL_TICK, 1, std::numeric_limits<uint32_t>::max()
+                       ))
+    };
+
+    const TimerWheel::RecordIndex record{ m_wheel.Add(event.m_timerToUpdate, expiry, periodTicks, txIndex) };
+    if (record == TimerWheel::INVALID_RECORD)
+    {
+        m_txs.Release(txIndex);
+        return;
+    }
+
+    ArmWheel();
+    LOG_DEBUG("updated wheel timer id:{} timeout:{}", event.m_timerToUpdate, event.m_newTimeout);
+}
+
+void TimerThread::CancelWheelTimer(const TimerStopEvent& event)
+{
+    const TimerWheel::RecordIndex record{ m_wheel.Find(event.m_timerToStop) };
+    LOG_RETURN_IF(record == TimerWheel::INVALID_RECORD and not event.m_oneShot, LOG_CRITICAL);
+    if (record == TimerWheel::INVALID_RECORD)
+    {
+        LOG_DEBUG("one-shot wheel timer id:{} already fired", event.m_timerToStop);
+        return;
+    }
+
+    const TxTable::Index txIndex{ m_wheel.Get(record).m_userIndex };
+    m_wheel.Cancel(record);
+    m_txs.Release(txIndex);
+
+    LOG_DEBUG("cancelled wheel timer id:{} n-timers:{}", event.m_timerToStop, m_wheel.Size());
+}
+
+void TimerThread::AdvanceWheel() { m_wheel.Advance(WheelTickAt(Clock::now()), m_onWheelExpired); }
+
+void TimerThread::ArmWheel()
+{
+    const auto nextTick{ m_wheel.NextWakeTick() };
+    if (nextTick.has_value())
+    {
+        ArmOneShotTimeout(m_wheelTimeout, m_wheelEpoch + (WHEEL_TICK * static_cast<TimeNS::rep>(*nextTick)));
+    }
+}
+
+void TimerThread::OnCompleteWheelTick(const io_uring_cqe& cEvent)
+{
+    if (OneShotTimeoutDue(m_wheelTimeout, cEvent))
+    {
+        AdvanceWheel();
+    }
+
+    ArmWheel();
+}
+
+TimerWheel::Tick TimerThread::WheelTickAt(Clock::time_point timePoint) const noexcept
+{
+    if (timePoint <= m_wheelEpoch)
+    {
+        return 0;
+    }
+
+    return static_cast<TimerWheel::Tick>((timePoint - m_wheelEpoch) / WHEEL_TICK);
+}
+
+// Coalesced ring timers
+
+void TimerThread::AddCoalescedTimer(const TimerAddEvent& event)
+{
+    const TimeNS period{ std::max(event.m_timeout, TimeNS{ 1ns }) };
+    const bool cadence{ event.m_mode == TimerMode::Cadence };
+    const auto nominal{ cadence ? NextCadenceDeadline(event.m_deadline, period, Clock::now())
+                        : event.m_mode == TimerMode::Deadline ? event.m_deadline
+                                                              : Clock::now() + event.m_timeout };
+    auto deadline{ m_coalescedDeadlines.emplace(CoalesceDeadline(nominal, event.m_slack), event.m_id) };
+    m_coalescedTimers[event.m_id] = CoalescedTimer{ .m_period = period,
+                                                    .m_slack = event.m_slack,
+                                                    .m_nominal = nominal,
+                                                    .m_anchor = event.m_deadline,
+                                                    .m_deadline = deadline,
+                                                    .m_txIndex = m_txs.Acquire(event.m_tx),
+                                                    .m_periodic = event.m_mode == TimerMode::Periodic or cadence,
+                                                    .m_cadence = cadence };
+
+    ArmCoalesced();
+    LOG_DEBUG("added coalesced timer id:{} timeout:{} slack:{}", event.m_id, event.m_timeout, event.m_slack);
+}
+
+void TimerThread::UpdateCoalescedTimer(const TimerUpdateEvent& event)
+{
+    auto itr{ m_coalescedTimers.find(event.m_timerToUpdate) };
+    LOG_RETURN_IF(itr == m_coalescedTimers.end(), LOG_CRITICAL);
+
+    auto& timer{ itr->second };
+    auto node{ m_coalescedDeadlines.extract(timer.m_deadline) };
+    timer.m_period = std::max(event.m_newTimeout, TimeNS{ 1ns });
+    // cadences keep their anchor
+    timer.m_nominal = timer.m_cadence ? NextCadenceDeadline(timer.m_anchor, timer.m_period, Clock::now())
+                                      : Clock::now() + timer.m_period;
+    node.key() = CoalesceDeadline(timer.m_nominal, timer.m_slack);
+    timer.m_deadline = m_coalescedDeadlines.insert(std::move(node));
+
+    ArmCoalesced();
+    LOG_DEBUG("updated coalesced timer id:{} timeout:{}", event.m_timerToUpdate, event.m_newTimeout);
+}
+
+void TimerThread::CancelCoalescedTimer(const TimerStopEvent& event)
+{
+    auto itr{ m_coalescedTimers.find(event.m_timerToStop) };
+    LOG_RETURN_IF(itr == m_coalescedTimers.end(), LOG_CRITICAL);
+
+    m_coalescedDeadlines.erase(itr->second.m_deadline);
+    m_txs.Release(itr->second.m_txIndex);
+    m_coalescedTimers.erase(itr);
+
+    LOG_DEBUG("cancelled coalesced timer id:{}", event.m_timerToStop);
+}
+
+void TimerThread::FireCoalescedTimers()
+{
+    const auto now{ Clock::now() };
+    while (not m_coalescedDeadlines.empty() and m_coalescedDeadlines.begin()->first <= now)
+    {
+        auto node{ m_coalescedDeadlines.extract(m_coalescedDeadlines.begin()) };
+        const TimerEventId id{ node.mapped() };
+        auto& timer{ m_coalescedTimers.at(id) };
+
+        LOG_DEBUG("triggering coalesced handler eventId({})", id);
+        // ran late enough for later periods to be due too. they're skipped, but reported
+        const bool periodic{ timer.m_periodic and timer.m_period > 0ns };
+        const TimeNS::rep missed{ periodic ? (now - timer.m_nominal) / timer.m_period : 0 };
+        const TimerExpiry expiry{
+            .m_id = id,
+            .m_scheduled = timer.m_nominal,
+            .m_missed = static_cast<uint32_t>(missed),
+            .m_phase = timer.m_cadence ? CadencePhase(timer.m_anchor, timer.m_period, timer.m_nominal) : 0
+        };
+        QueueExpiry(m_txs.Shared(timer.m_txIndex), expiry);
+
+        if (not timer.m_periodic)
+        {
+            m_txs.Release(timer.m_txIndex);
+            m_coalescedTimers.erase(id);
+            continue;
+        }
+
+        // re-bucket, reusing the node
+        timer.m_nominal += timer.m_period * (missed + 1);
+        node.key() = CoalesceDeadline(timer.m_nominal, timer.m_slack);
+        timer.m_deadline = m_coalescedDeadlines.insert(std::move(node));
+    }
+}
+
+void TimerThread::ArmCoalesced()
+{
+    if (not m_coalescedDeadlines.empty())
+    {
+        ArmOneShotTimeout(m_coalescedTimeout, m_coalescedDeadlines.begin()->first);
+    }
+}
+
+void TimerThread::OnCompleteCoalescedTick(const io_uring_cqe& cEvent)
+{
+    if (OneShotTimeoutDue(m_coalescedTimeout, cEvent))
+    {
+        FireCoalescedTimers();
+    }
+
+    ArmCoalesced();
+}
+
+// Shared one-shot timeouts
+
+void TimerThread::ArmOneShotTimeout(OneShotTimeout& timeout, Clock::time_point deadline)
+{
+    if (timeout.m_armed.has_value() and timeout.m_armedAt <= deadline)
+    {
+        return;
+    }
+
+    if (timeout.m_armed.has_value())
+    {
+        // pull the armed timeout in. if it has already fired, its completion re-arms anyway
+        const auto opData{ m_uringOps.Acquire(timeout.m_updateOp, 0) };
+        if (not m_uring.UpdateDeadlineEvent(opData, *timeout.m_armed, deadline))
+        {
+            LOG_CRITICAL("failed to queue {} tick update", timeout.m_name);
+            m_uringOps.Release(opData);
+            return;
+        }
+    }
+    else
+    {
+        const auto opData{ m_uringOps.Acquire(timeout.m_tickOp, 0) };
+        if (not m_uring.QueueDeadlineEvent(opData, deadline))
+        {
+            LOG_CRITICAL("failed to queue {} tick", timeout.m_name);
+            m_uringOps.Release(opData);
+            return;
+        }
+        timeout.m_armed = opData;
+    }
+
+    timeout.m_armedAt = deadline;
+    LOG_TRACE("{} tick armed for:{}", timeout.m_name, deadline.time_since_epoch());
+}
+
+bool TimerThread::OneShotTimeoutDue(OneShotTimeout& timeout, const io_uring_cqe& cEvent)
+{
+    // one shot, so nothing is armed any more
+    timeout.m_armed.reset();
+
+    int eventRes{ cEvent.res };
+    switch (eventRes)
+    {
+        case -ETIME:
+        {
+            return true;
+        }
+
+        default:
+        {
+            LOG_ERROR("{} tick failed res({}) {}", timeout.m_name, eventRes, strerror(-eventRes));
+            return false;
+        }
+    }
+}
+
+Clock::time_point TimerThread::CoalesceDeadline(Clock::time_point deadline, const TimeNS& slack) noexcept
+{
+    if (slack <= 0ns)
+    {
+        return deadline;
+    }
+
+    const auto grain{ static_cast<TimeNS::rep>(std::bit_floor(static_cast<uint64_t>(slack.count()))) };
+    const TimeNS::rep sinceEpoch{ TimeNS{ deadline.time_since_epoch() }.count() };
+    const TimeNS::rep aligned{ ((sinceEpoch + grain - 1) / grain) * grain };
+    return Clock::time_point{ std::chrono::duration_cast<Clock::duration>(TimeNS{ aligned }) };
+}
+
+Clock::time_point TimerThread::NextCadenceDeadline(
+    Clock::time_point anchor, const TimeNS& period, Clock::time_point now
+) noexcept
+{
+    if (now < anchor)
+    {
+        return anchor;
+    }
+
+    return anchor + (period * (((now - anchor) / period) + 1));
+}
+
+// Virtual time
+
+void TimerThread::AddVirtualTimer(const TimerAddEvent& event)
+{
+    // a zero period would keep firing at the same instant forever
+    const TimeNS period{ std::max(event.m_timeout, TimeNS{ 1ns }) };
+    const bool cadence{ event.m_mode == TimerMode::Cadence };
+    const auto nominal{ cadence ? NextCadenceDeadline(event.m_deadline, period, Clock::now())
+                        : event.m_mode == TimerMode::Deadline ? event.m_deadline
+                                                              : Clock::now() + period };
+    auto deadline{ m_virtualDeadlines.emplace(CoalesceDeadline(nominal, event.m_slack), event.m_id) };
+    m_virtualTimers[event.m_id] = VirtualTimer{ .m_period = period,
+                                                .m_slack = event.m_slack,
+                                                .m_nominal = nominal,
+                                                .m_anchor = event.m_deadline,
+                                                .m_tx = event.m_tx,
+                                                .m_deadline = deadline,
+                                                .m_periodic = event.m_mode == TimerMode::Periodic or cadence,
+                                                .m_cadence = cadence };
+    LOG_DEBUG("added virtual timer id:{} timeout:{}", event.m_id, event.m_timeout);
+}
+
+void TimerThread::UpdateVirtualTimer(const TimerUpdateEvent& event)
+{
+    auto itr{ m_virtualTimers.find(event.m_timerToUpdate) };
+    LOG_RETURN_IF(itr == m_virtualTimers.end(), LOG_CRITICAL);
+
+    auto& timer{ itr->second };
+    auto node{ m_virtualDeadlines.extract(timer.m_deadline) };
+    timer.m_period = std::max(event.m_newTimeout, TimeNS{ 1ns });
+    timer.m_nominal = timer.m_cadence ? NextCadenceDeadline(timer.m_anchor, timer.m_period, Clock::now())
+                                      : Clock::now() + timer.m_period;
+    node.key() = CoalesceDeadline(timer.m_nominal, timer.m_slack);
+    timer.m_deadline = m_virtualDeadlines.insert(std::move(node));
+    LOG_DEBUG("updated virtual timer id:{} timeout:{}", event.m_timerToUpdate, event.m_newTimeout);
+}
+
+void TimerThread::CancelVirtualTimer(const TimerStopEvent& event)
+{
+    auto itr{ m_virtualTimers.find(event.m_timerToStop) };
+    LOG_RETURN_IF(itr == m_virtualTimers.end() and not event.m_oneShot, LOG_CRITICAL);
+    if (itr == m_virtualTimers.end())
+    {
+        LOG_DEBUG("one-shot virtual timer id:{} already fired", event.m_timerToStop);
+        return;
+    }
+
+    m_virtualDeadlines.erase(itr->second.m_deadline);
+    m_virtualTimers.erase(itr);
+    LOG_DEBUG("cancelled virtual timer id:{}", event.m_timerToStop);
+}
+
+void TimerThread::FireNextVirtualDeadline()
+{
+    const Clock::time_point deadline{ m_virtualDeadlines.begin()->first };
+    Clock::AdvanceTo(deadline);
+    m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+
+    while (not m_virtualDeadlines.empty() and m_virtualDeadlines.begin()->first == deadline)
+    {
+        auto node{ m_virtualDeadlines.extract(m_virtualDeadlines.begin()) };
+        auto& timer{ m_virtualTimers.at(node.mapped()) };
+
+        LOG_DEBUG("triggering virtual handler eventId({})", node.mapped());
+        QueueExpiry(
+            timer.m_tx,
+            TimerExpiry{
+                .m_id = node.mapped(),
+                .m_scheduled = timer.m_nominal,
+                .m_phase = timer.m_cadence ? CadencePhase(timer.m_anchor, timer.m_period, timer.m_nominal) : 0 }
+        );
+
+        if (not timer.m_periodic)
+        {
+            m_virtualTimers.erase(node.mapped());
+            continue;
+        }
+
+        // re-arm, reusing the node
+        timer.m_nominal += timer.m_period;
+        node.key() = std::max(CoalesceDeadline(timer.m_nominal, timer.m_slack), deadline + 1ns);
+        timer.m_deadline = m_virtualDeadlines.insert(std::move(node));
+    }
+}
+
 } // namespace Sage
@@ -2,72 +2,31 @@
 
 #include <atomic>
 #include <latch>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <sched.h>
 #include <thread>
 #include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
 #include "channel/channel.hpp"
 #include "threading/events.hpp"
 #include "timers/time_utils.hpp"
+#include "timers/timer_wheel.hpp"
+#include "timers/tx_table.hpp"
+#include "timers/uring_op_table.hpp"
 #include "uring/io_uring.hpp"
 
 namespace Sage
 {
 
-using URingEventId = size_t;
-
-class URingTimerEvent
+enum class TimerBackend
 {
-public:
-    using OnCompleteFunc = std::move_only_function<void(URingTimerEvent&, const io_uring_cqe&)>;
-
-    virtual ~URingTimerEvent() noexcept = default;
-
-    const URingEventId m_uringId{ s_nextId.fetch_add(1) };
-    const TimerEventId m_timerEventId;
-    OnCompleteFunc m_onCompleteCb;
-    bool m_removeOnComplete{ true };
-
-protected:
-    URingTimerEvent(TimerEventId timerId, OnCompleteFunc&& onComplete) :
-        m_timerEventId{ timerId },
-        m_onCompleteCb{ std::move(onComplete) }
-    {
-    }
-
-private:
-    URingTimerEvent() = delete;
-
-    static inline std::atomic<URingEventId> s_nextId{ 0 };
-};
-
-class URingTimerExpiredEvent final : public URingTimerEvent
-{
-public:
-    URingTimerExpiredEvent(TimerEventId timerId, OnCompleteFunc&& onComplete) :
-        URingTimerEvent{ timerId, std::move(onComplete) }
-    {
-        m_removeOnComplete = false;
-    }
-};
-
-class URingTimerUpdateEvent final : public URingTimerEvent
-{
-public:
-    URingTimerUpdateEvent(TimerEventId timerId, OnCompleteFunc&& onComplete) :
-        URingTimerEvent{ timerId, std::move(onComplete) }
-    {
-    }
-};
-
-class URingTimerCancelEvent final : public URingTimerEvent
-{
-public:
-    URingTimerCancelEvent(TimerEventId timerId, OnCompleteFunc&& onComplete) :
-        URingTimerEvent{ timerId, std::move(onComplete) }
-    {
-    }
+    URing, // one io_uring timeout per timer
+    Wheel  // timers live in a timing wheel, the ring only carries the next wheel tick
 };
 
 class TimerThread
@@ -75,7 +34,19 @@ class TimerThread
 public:
     using SharedThreadTx = std::shared_ptr<Channel::Tx<ThreadEvent>>;
 
-    explicit TimerThread(Channel::ChannelPair<TimerEvent> channel = Channel::MakeChannel<TimerEvent>());
+    // Timer ids carry the shard that owns them in their low bits
+    static constexpr size_t SHARD_BITS{ 8 };
+    static constexpr size_t MAX_SHARDS{ 1 << SHARD_BITS };
+
+    static constexpr TimeNS DEFAULT_INLINE_BUDGET{ 10us };
+
+    explicit TimerThread(
+        TimerBackend backend = TimerBackend::URing,
+        size_t shard = 0,
+        const URingSetup& ringSetup = {},
+        // must always be last
+        Channel::ChannelPair<TimerEvent> channel = Channel::MakeChannel<TimerEvent>()
+    );
 
     ~TimerThread();
 
@@ -87,11 +58,81 @@ public:
         m_stopLatch.wait();
     };
 
-    TimerEventId RequestTimerAdd(const TimeNS& timeout, SharedThreadTx tx);
+    size_t Shard() const noexcept { return m_shard; }
+
+    static size_t ShardOf(TimerEventId id) noexcept { return static_cast<size_t>(id) & (MAX_SHARDS - 1); }
+
+    bool SetAffinity(const cpu_set_t& cpus);
+
+    // IORING_SETUP_* flags the ring ended up with
+    unsigned RingSetupFlags() const noexcept { return m_uring.SetupFlags(); }
+
+    // Counters since start. Expiries per wakeup is the achieved coalescing ratio
+    struct Stats
+    {
+        size_t m_expiries;
+        size_t m_wakeups;
+        // calls the ring made into the kernel
+        size_t m_ringEnters;
+
+        double CoalescingRatio() const noexcept
+        {
+            return m_wakeups == 0 ? 0.0 : static_cast<double>(m_expiries) / static_cast<double>(m_wakeups);
+        }
+    };
+
+    // A non zero slack lets a timer fire up to that much late, so timers with overlapping
+    // windows can share a deadline and fire together
+
+    // Fires every timeout until stopped
+    TimerEventId RequestTimerAdd(const TimeNS& timeout, SharedThreadTx tx, const TimeNS& slack = 0ns);
+
+    // Fires every timeout, running cb right on the timer thread instead of sending an expiry.
+    // A run over budget demotes it to a normal timer: cb is sent back to tx's thread, and expiries follow it.
+    // cb is owned by the timer thread and may still run shortly after a stop request,
+    // so it should only touch what it owns or shares, e.g. a captured shared_ptr to an atomic
+    TimerEventId RequestInlineTimerAdd(
+        const TimeNS& timeout, SharedThreadTx tx, InlineTimerCb cb, const TimeNS& budget = DEFAULT_INLINE_BUDGET
+    );
+
+    // Send timers deliver an event built by makeEvent straight to tx on expiry, instead of an expiry.
+    // makeEvent runs on the timer thread. queueDepth, if given, is counted up for every event tx takes
+
+    // Sends once after delay and then drops itself
+    TimerEventId RequestSendAfter(
+        const TimeNS& delay, SharedThreadTx tx, ThreadEventFactory makeEvent, SharedQueueDepth queueDepth = nullptr
+    );
 
+    // Sends every period until stopped
+    TimerEventId RequestSendEvery(
+        const TimeNS& period, SharedThreadTx tx, ThreadEventFactory makeEvent, SharedQueueDepth queueDepth = nullptr
+    );
+
+    // Fires on the absolute grid anchor + k * period, with k as each expiry's phase. Never drifts.
+    // The default anchor is the steady clock's epoch, so every cadence with the same period ticks
+    // on the same boundaries, whichever thread or shard it's on. Late ticks are skipped, keeping the grid
+    TimerEventId RequestCadenceTimerAdd(const TimeNS& period, SharedThreadTx tx, Clock::time_point anchor = {});
+
+    // Fires once and then drops itself
+    TimerEventId RequestOneShotTimerAdd(const TimeNS& timeout, SharedThreadTx tx, const TimeNS& slack = 0ns);
+
+    // Fires once at deadline and then drops itself
+    TimerEventId RequestDeadlineTimerAdd(Clock::time_point deadline, SharedThreadTx tx, const TimeNS& slack = 0ns);
+
+    // Re-arms relative to now, keeping the timer's mode
     void RequestTimerUpdate(TimerEventId, const TimeNS& timeout);
 
-    void RequestTimerStop(TimerEventId, bool logOnDrop = false);
+    void RequestTimerStop(TimerEventId, bool logOnDrop = false, bool oneShot = false);
+
+    // Add, update and stop requests the timer thread has worked through so far
+    size_t HandledRequests() const noexcept { return m_handledRequests.load(std::memory_order_acquire); }
+
+    Stats GetStats() const noexcept
+    {
+        return Stats{ .m_expiries = m_nExpiries.load(std::memory_order_relaxed),
+                      .m_wakeups = m_nWakeups.load(std::memory_order_relaxed),
+                      .m_ringEnters = m_uring.Enters() };
+    }
 
 private:
     TimerThread(const TimerThread&) = delete;
@@ -99,47 +140,224 @@ private:
     TimerThread& operator=(const TimerThread&) = delete;
     TimerThread& operator=(TimerThread&&) = delete;
 
+    TimerEventId RequestTimerAdd(std::unique_ptr<TimerAddEvent> event);
+
     void Run(std::unique_ptr<Channel::Rx<TimerEvent>> rx);
 
-    template<typename ET> auto FindUringPendingEvent(TimerEventId id)
+    void HandleTimerEvents(Channel::Rx<TimerEvent>& rx, const TimeNS& timeout);
+
+    // false if the timer couldn't be armed
+    bool AddTimer(const TimerAddEvent&);
+    void UpdateTimer(const TimerUpdateEvent&);
+    void CancelTimer(const TimerStopEvent&);
+
+    // Looks the op up by its user data and releases it once the ring is done with it
+    void OnCompleteURingOp(const io_uring_cqe& cEvent);
+
+    void OnCompleteTimerExpired(const URingOpTable::Record& op, const io_uring_cqe& cEvent);
+
+    // The completed expiry, with when it was due and how many periods went missing before it.
+    // Moves a periodic timer on to its next period and arms it there
+    TimerExpiry NextURingExpiry(const URingOpTable::Record& op, const io_uring_cqe& cEvent);
+
+    void OnCompleteTimerUpdate(const URingOpTable::Record& op, const io_uring_cqe& cEvent);
+    void OnCompleteTimerCancel(const URingOpTable::Record& op, const io_uring_cqe& cEvent);
+
+    // Timing wheel
+
+    bool AddWheelTimer(const TimerAddEvent&);
+    void UpdateWheelTimer(const TimerUpdateEvent&);
+    void CancelWheelTimer(const TimerStopEvent&);
+
+    void AdvanceWheel();
+
+    // Makes sure the ring's single timeout is due no later than the wheel's next tick
+    void ArmWheel();
+
+    void OnCompleteWheelTick(const io_uring_cqe& cEvent);
+
+    TimerWheel::Tick WheelTickAt(Clock::time_point timePoint) const noexcept;
+
+    // Coalesced ring timers. Timers with slack, and cadences on either backend, are bucketed by
+    // their shared deadline, with a single ring timeout armed for the earliest bucket
+
+    void AddCoalescedTimer(const TimerAddEvent&);
+    void UpdateCoalescedTimer(const TimerUpdateEvent&);
+    void CancelCoalescedTimer(const TimerStopEvent&);
+
+    // Fires every bucket that's due, re-bucketing periodic timers
+    void FireCoalescedTimers();
+
+    void ArmCoalesced();
+
+    void OnCompleteCoalescedTick(const io_uring_cqe& cEvent);
+
+    // The wheel and the coalesced timers each keep one ring timeout armed for their earliest deadline.
+    // Cancelling a timer never touches the ring, at worst the armed timeout finds nothing due
+
+    struct OneShotTimeout;
+
+    // Queues the timeout, or pulls the armed one in, so it fires no later than deadline
+    void ArmOneShotTimeout(OneShotTimeout& timeout, Clock::time_point deadline);
+
+    // Clears the armed timeout on its completion. true if it came due, rather than failed
+    bool OneShotTimeoutDue(OneShotTimeout& timeout, const io_uring_cqe& cEvent);
+
+    // Earliest grid point at or after deadline, which is within slack of it. The grid is the largest power
+    // of two nanoseconds within slack, so timers with overlapping windows tend to land on the same point
+    static Clock::time_point CoalesceDeadline(Clock::time_point deadline, const TimeNS& slack) noexcept;
+
+    // The first point on a cadence's grid after now, or the anchor if that's still to come
+    static Clock::time_point NextCadenceDeadline(
+        Clock::time_point anchor, const TimeNS& period, Clock::time_point now
+    ) noexcept;
+
+    static uint64_t CadencePhase(Clock::time_point anchor, const TimeNS& period, Clock::time_point deadline) noexcept
     {
-        ET* res{ nullptr };
-        for (auto& [_, pending] : m_pendingUringEvents)
-        {
-            auto child{ dynamic_cast<ET*>(pending.get()) };
-            if (child == nullptr)
-            {
-                continue;
-            }
-
-            if (pending->m_timerEventId != id)
-            {
-                continue;
-            }
-
-            res = child;
-            break;
-        }
+        return static_cast<uint64_t>((deadline - anchor) / period);
+    }
+
+    // Expiries are collected per destination and sent as one event each at the end of a pass.
+    // Inline timers run here instead
+    void QueueExpiry(const SharedThreadTx& tx, const TimerExpiry& expiry);
+
+    // False if the timer isn't inline. Demotes it if it overruns its budget
+    bool RunInlineTimer(const SharedThreadTx& tx, const TimerExpiry& expiry);
+
+    // False if the timer isn't a send timer
+    bool RunSendTimer(const SharedThreadTx& tx, const TimerExpiry& expiry);
 
-        return res;
+    void FlushExpiries();
+
+    void CountExpiries(size_t nExpiries) noexcept
+    {
+        m_nExpiries.fetch_add(nExpiries, std::memory_order_relaxed);
     }
 
-    void AddTimer(const TimerAddEvent&);
-    void UpdateTimer(const TimerUpdateEvent&);
-    void CancelTimer(const TimerStopEvent&);
+    // Virtual time. Deadlines are kept in order here instead of on the ring
+
+    void AddVirtualTimer(const TimerAddEvent&);
+    void UpdateVirtualTimer(const TimerUpdateEvent&);
+    void CancelVirtualTimer(const TimerStopEvent&);
+
+    // Advances the clock straight to the earliest deadline and fires everything due then
+    void FireNextVirtualDeadline();
+
+private:
+    using VirtualDeadlines = std::multimap<Clock::time_point, TimerEventId>;
+
+    struct VirtualTimer
+    {
+        TimeNS m_period;
+        TimeNS m_slack;
+        // uncoalesced deadline, so slack never accumulates as drift
+        Clock::time_point m_nominal;
+        // cadences only
+        Clock::time_point m_anchor;
+        SharedThreadTx m_tx;
+        VirtualDeadlines::iterator m_deadline;
+        bool m_periodic;
+        bool m_cadence;
+    };
+
+    using CoalescedDeadlines = std::multimap<Clock::time_point, TimerEventId>;
+
+    struct PendingExpiries
+    {
+        SharedThreadTx m_tx;
+        std::vector<TimerExpiry> m_expiries;
+    };
+
+    struct InlineTimer
+    {
+        InlineTimerCb m_cb;
+        TimeNS m_budget;
+    };
+
+    struct SendTimer
+    {
+        ThreadEventFactory m_makeEvent;
+        SharedQueueDepth m_queueDepth;
+        bool m_periodic;
+    };
+
+    struct URingTimer
+    {
+        // user data of the armed expiry op
+        IOURing::UserData m_op;
+        TimeNS m_period;
+        // what the armed one shot fires at. armed time + n * period, never reset by a reap
+        Clock::time_point m_due;
+        bool m_periodic;
+    };
 
-    void OnCompleteTimerExpired(URingTimerEvent& event, const io_uring_cqe& cEvent);
-    void OnCompleteTimerUpdate(URingTimerEvent& event, const io_uring_cqe& cEvent);
-    void OnCompleteTimerCancel(URingTimerEvent& event, const io_uring_cqe& cEvent);
+    struct OneShotTimeout
+    {
+        const std::string_view m_name;
+        const URingTimerOp m_tickOp;
+        const URingTimerOp m_updateOp;
+        // user data of the armed timeout
+        std::optional<IOURing::UserData> m_armed{ std::nullopt };
+        Clock::time_point m_armedAt{};
+    };
+
+    struct CoalescedTimer
+    {
+        TimeNS m_period;
+        TimeNS m_slack;
+        // uncoalesced deadline, so slack never accumulates as drift
+        Clock::time_point m_nominal;
+        // cadences only
+        Clock::time_point m_anchor;
+        CoalescedDeadlines::iterator m_deadline;
+        TxTable::Index m_txIndex;
+        bool m_periodic;
+        bool m_cadence;
+    };
 
 private:
-    IOURing m_uring{ 10'000 };
-    std::unordered_map<URingEventId, std::unique_ptr<URingTimerEvent>> m_pendingUringEvents;
-    std::unordered_map<TimerEventId, SharedThreadTx> m_txs;
+    const TimerBackend m_backend;
+    const size_t m_shard;
+    // submitted once per loop, together with the wait
+    IOURing m_uring;
+    URingOpTable m_uringOps;
+    std::unordered_map<TimerEventId, URingTimer> m_uringTimers;
+    // kept across passes for as long as a timer sends to the destination, so a pass allocates no nodes
+    std::unordered_map<const Channel::Tx<ThreadEvent>*, PendingExpiries> m_pendingExpiries;
+    bool m_expiriesPending{ false };
+    std::unordered_map<TimerEventId, InlineTimer> m_inlineTimers;
+    std::unordered_map<TimerEventId, SendTimer> m_sendTimers;
+    TxTable m_txs;
+    TimerWheel m_wheel{ MAX_WHEEL_TIMERS };
+    TimerWheel::OnExpiredFunc m_onWheelExpired;
+    Clock::time_point m_wheelEpoch{};
+    OneShotTimeout m_wheelTimeout{ .m_name = "wheel",
+                                   .m_tickOp = URingTimerOp::WheelTick,
+                                   .m_updateOp = URingTimerOp::WheelUpdate };
+    CoalescedDeadlines m_coalescedDeadlines;
+    std::unordered_map<TimerEventId, CoalescedTimer> m_coalescedTimers;
+    OneShotTimeout m_coalescedTimeout{ .m_name = "coalesced",
+                                       .m_tickOp = URingTimerOp::CoalescedTick,
+                                       .m_updateOp = URingTimerOp::CoalescedUpdate };
+    // equal deadlines keep the order they were armed in, so firing order is reproducible
+    VirtualDeadlines m_virtualDeadlines;
+    std::unordered_map<TimerEventId, VirtualTimer> m_virtualTimers;
     std::shared_ptr<Channel::Tx<TimerEvent>> m_tx;
+    std::atomic<size_t> m_handledRequests{ 0 };
+    std::atomic<size_t> m_nExpiries{ 0 };
+    // passes that delivered at least one expiry
+    std::atomic<size_t> m_nWakeups{ 0 };
     std::latch m_startLatch{ 1 };
     std::latch m_stopLatch{ 1 };
     std::jthread m_thread;
+
+private:
+    static constexpr TimeMS URING_WAIT_TIMEOUT{ 20ms };
+    static constexpr uint URING_QUEUE_SIZE{ 10'000 };
+    static constexpr TimeNS WHEEL_TICK{ 1ms };
+    static constexpr size_t MAX_WHEEL_TIMERS{ 1 << 21 };
+    // how long to wait on other threads to go idle before checking again
+    static constexpr TimeUS VIRTUAL_BUSY_POLL{ 50us };
 };
 
 } // namespace Sage
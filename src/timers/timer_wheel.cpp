@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+#include "log/logger.hpp"
+#include "timers/timer_wheel.hpp"
+
+namespace Sage
+{
+
+TimerWheel::TimerWheel(size_t maxTimers) : m_maxTimers{ std::min<size_t>(maxTimers, INVALID_RECORD) }
+{
+    m_slotHeads.fill(INVALID_RECORD);
+}
+
+TimerWheel::RecordIndex TimerWheel::Add(TimerEventId id, Tick expiry, uint32_t periodTicks, uint32_t userIndex)
+{
+    const RecordIndex index{ AllocateRecord() };
+    if (index == INVALID_RECORD)
+    {
+        LOG_ERROR("timer wheel full. max-timers:{} dropping timer-id:{}", m_maxTimers, id);
+        return INVALID_RECORD;
+    }
+
+    Record& record{ m_records[index] };
+    record.m_id = id;
+    record.m_expiry = std::max(expiry, m_now + 1);
+    record.m_periodTicks = periodTicks;
+    record.m_userIndex = userIndex;
+    Insert(index);
+    IndexInsert(index);
+    m_size++;
+
+    return index;
+}
+
+void TimerWheel::Cancel(RecordIndex index)
+{
+    LOG_RETURN_IF(index >= m_records.size(), LOG_CRITICAL);
+
+    // already unlinked. FireSlot sees it's gone and leaves it alone
+    if (index == m_firing)
+    {
+        m_firing = INVALID_RECORD;
+    }
+
+    Unlink(index);
+    IndexErase(index);
+    FreeRecord(index);
+    m_size--;
+}
+
+TimerWheel::RecordIndex TimerWheel::Find(TimerEventId id) const noexcept
+{
+    if (m_idSlots.empty())
+    {
+        return INVALID_RECORD;
+    }
+
+    const size_t mask{ m_idSlots.size() - 1 };
+    for (size_t slot{ IdHome(id) };; slot = (slot + 1) & mask)
+    {
+        const RecordIndex index{ m_idSlots[slot] };
+        if (index == INVALID_RECORD or m_records[index].m_id == id)
+        {
+            return index;
+        }
+    }
+}
+
+void TimerWheel::Advance(Tick now, OnExpiredFunc& onExpired)
+{
+    while (m_now < now)
+    {
+        // nothing fires or cascades on the ticks in between, so skip straight over them
+        const auto next{ NextEventTick() };
+        if (not next.has_value() or *next > now)
+        {
+            m_now = now;
+            return;
+        }
+
+        m_now = *next;
+        Cascade();
+        FireSlot(m_now & SLOT_MASK, onExpired);
+    }
+}
+
+std::optional<TimerWheel::Tick> TimerWheel::NextWakeTick() const noexcept
+{
+    std::optional<Tick> next{ std::nullopt };
+
+    for (size_t level{ 0 }; level < LEVELS; level++)
+    {
+        const auto offset{ m_levelSizes[level] > 0 ? NextOccupiedOffset(level) : std::nullopt };
+        if (not offset.has_value())
+        {
+            continue;
+        }
+
+        // nothing in a slot expires before the slot is reached
+        const size_t shift{ level * SLOT_BITS };
+        const Tick slotTick{ ((m_now >> shift) + *offset) << shift };
+        if (next.has_value() and slotTick >= *next)
+        {
+            continue;
+        }
+
+        // every level 0 entry in a slot expires on its tick
+        if (level == 0)
+        {
+            next = slotTick;
+            continue;
+        }
+
+        // an upper level's earliest slot holds its earliest entries, but they only share the slot's upper bits
+        const size_t slot{ (level * SLOTS_PER_LEVEL) + (((m_now >> shift) + *offset) & SLOT_MASK) };
+        for (RecordIndex index{ m_slotHeads[slot] }; index != INVALID_RECORD; index = m_records[index].m_next)
+        {
+            next = std::min(m_records[index].m_expiry, next.value_or(m_records[index].m_expiry));
+        }
+    }
+
+    return next;
+}
+
+TimerWheel::RecordIndex TimerWheel::AllocateRecord()
+{
+    if (m_freeHead != INVALID_RECORD)
+    {
+        const RecordIndex index{ m_freeHead };
+        m_freeHead = m_records[index].m_next;
+        return index;
+    }
+
+    if (m_records.size() >= m_maxTimers)
+    {
+        return INVALID_RECORD;
+    }
+
+    m_records.emplace_back();
+    return static_cast<RecordIndex>(m_records.size() - 1);
+}
+
+void TimerWheel::FreeRecord(RecordIndex index) noexcept
+{
+    m_records[index].m_next = m_freeHead;
+    m_freeHead = index;
+}
+
+void TimerWheel::Insert(RecordIndex index) noexcept
+{
+    Record& record{ m_records[index] };
+
+    // may be due right now when moving down from an upper level
+    const Tick delta{ std::min(record.m_expiry > m_now ? record.m_expiry - m_now : 0, MAX_DELTA) };
+    record.m_expiry = m_now + delta;
+
+    size_t level{ 0 };
+    while (level < LEVELS - 1 and delta >= (Tick{ 1 } << ((level + 1) * SLOT_BITS)))
+    {
+        level++;
+    }
+
+    const size_t slot{ (level * SLOTS_PER_LEVEL) + ((record.m_expiry >> (level * SLOT_BITS)) & SLOT_MASK) };
+    record.m_slot = static_cast<uint16_t>(slot);
+    record.m_prev = INVALID_RECORD;
+    record.m_next = m_slotHeads[slot];
+    if (record.m_next != INVALID_RECORD)
+    {
+        m_records[record.m_next].m_prev = index;
+    }
+    m_slotHeads[slot] = index;
+    SetOccupied(slot, true);
+    m_levelSizes[level]++;
+}
+
+void TimerWheel::Unlink(RecordIndex index) noexcept
+{
+    Record& record{ m_records[index] };
+    if (record.m_slot == NO_SLOT)
+    {
+        return;
+    }
+
+    if (record.m_prev != INVALID_RECORD)
+    {
+        m_records[record.m_prev].m_next = record.m_next;
+    }
+    else
+    {
+        m_slotHeads[record.m_slot] = record.m_next;
+        SetOccupied(record.m_slot, record.m_next != INVALID_RECORD);
+    }
+
+    if (record.m_next != INVALID_RECORD)
+    {
+        m_records[record.m_next].m_prev = record.m_prev;
+    }
+
+    m_levelSizes[record.m_slot / SLOTS_PER_LEVEL]--;
+    record.m_next = INVALID_RECORD;
+    record.m_prev = INVALID_RECORD;
+    record.m_slot = NO_SLOT;
+}
+
+TimerWheel::RecordIndex TimerWheel::TakeSlot(size_t slot) noexcept
+{
+    const RecordIndex head{ m_slotHeads[slot] };
+    m_slotHeads[slot] = INVALID_RECORD;
+    SetOccupied(slot, false);
+
+    for (RecordIndex index{ head }; index != INVALID_RECORD; index = m_records[index].m_next)
+    {
+        m_levelSizes[slot / SLOTS_PER_LEVEL]--;
+    }
+
+    return head;
+}
+
+void TimerWheel::SetOccupied(size_t slot, bool occupied) noexcept
+{
+    const uint64_t bit{ uint64_t{ 1 } << (slot % OCCUPANCY_WORD_BITS) };
+    uint64_t& word{ m_occupied[slot / OCCUPANCY_WORD_BITS] };
+    word = occupied ? (word | bit) : (word & ~bit);
+}
+
+std::optional<size_t> TimerWheel::NextOccupiedOffset(size_t level) const noexcept
+{
+    const size_t position{ static_cast<size_t>((m_now >> (level * SLOT_BITS)) & SLOT_MASK) };
+
+    // a word at a time, from just after the current slot round to the current slot itself
+    size_t offset{ 1 };
+    while (offset <= SLOTS_PER_LEVEL)
+    {
+        const size_t slot{ (position + offset) & SLOT_MASK };
+        const size_t bit{ slot % OCCUPANCY_WORD_BITS };
+        const uint64_t word{ m_occupied[((level * SLOTS_PER_LEVEL) + slot) / OCCUPANCY_WORD_BITS] >> bit };
+        if (word != 0)
+        {
+            // anything before offset has been seen empty, so a hit here can't be a wrapped earlier slot
+            return offset + static_cast<size_t>(std::countr_zero(word));
+        }
+
+        offset += OCCUPANCY_WORD_BITS - bit;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<TimerWheel::Tick> TimerWheel::NextEventTick() const noexcept
+{
+    std::optional<Tick> next{ std::nullopt };
+
+    for (size_t level{ 0 }; level < LEVELS; level++)
+    {
+        const auto offset{ m_levelSizes[level] > 0 ? NextOccupiedOffset(level) : std::nullopt };
+        if (offset.has_value())
+        {
+            const size_t shift{ level * SLOT_BITS };
+            const Tick tick{ ((m_now >> shift) + *offset) << shift };
+            next = std::min(tick, next.value_or(tick));
+        }
+    }
+
+    return next;
+}
+
+void TimerWheel::Cascade() noexcept
+{
+    // highest level whose lower bits have all wrapped on this tick
+    size_t topLevel{ 0 };
+    while (topLevel < LEVELS - 1 and (m_now & ((Tick{ 1 } << ((topLevel + 1) * SLOT_BITS)) - 1)) == 0)
+    {
+        topLevel++;
+    }
+
+    // top down, so entries can trickle through several levels in one go
+    for (size_t level{ topLevel }; level > 0; level--)
+    {
+        const size_t slot{ (level * SLOTS_PER_LEVEL) + ((m_now >> (level * SLOT_BITS)) & SLOT_MASK) };
+        RecordIndex index{ TakeSlot(slot) };
+        while (index != INVALID_RECORD)
+        {
+            const RecordIndex next{ m_records[index].m_next };
+            Insert(index);
+            index = next;
+        }
+    }
+}
+
+void TimerWheel::FireSlot(size_t slot, OnExpiredFunc& onExpired)
+{
+    // one record at a time off the live list, so a callback can cancel any record, this one included.
+    // nothing a callback adds, or a periodic re-arm, lands back in this slot
+    for (RecordIndex index{ m_slotHeads[slot] }; index != INVALID_RECORD; index = m_slotHeads[slot])
+    {
+        Unlink(index);
+
+        // a copy, since callbacks may add timers and grow the slab
+        const Record fired{ m_records[index] };
+        m_firing = index;
+        onExpired(fired);
+        if (std::exchange(m_firing, INVALID_RECORD) == INVALID_RECORD)
+        {
+            continue;
+        }
+
+        Record& record{ m_records[index] };
+        if (record.m_periodTicks > 0)
+        {
+            record.m_expiry = std::max(record.m_expiry + record.m_periodTicks, m_now + 1);
+            Insert(index);
+        }
+        else
+        {
+            IndexErase(index);
+            FreeRecord(index);
+            m_size--;
+        }
+    }
+}
+
+size_t TimerWheel::IdHome(TimerEventId id) const noexcept
+{
+    // fibonacci hashing, the top bits are the best mixed
+    const uint64_t hash{ static_cast<uint64_t>(id) * 0x9E37'79B9'7F4A'7C15ULL };
+    return static_cast<size_t>(hash >> (64 - std::countr_zero(m_idSlots.size())));
+}
+
+void TimerWheel::IndexInsert(RecordIndex index)
+{
+    if ((m_size + 1) * 2 > m_idSlots.size())
+    {
+        IndexGrow();
+    }
+
+    const size_t mask{ m_idSlots.size() - 1 };
+    size_t slot{ IdHome(m_records[index].m_id) };
+    while (m_idSlots[slot] != INVALID_RECORD)
+    {
+        slot = (slot + 1) & mask;
+    }
+    m_idSlots[slot] = index;
+}
+
+void TimerWheel::IndexErase(RecordIndex index) noexcept
+{
+    const size_t mask{ m_idSlots.size() - 1 };
+    size_t hole{ IdHome(m_records[index].m_id) };
+    while (m_idSlots[hole] != index)
+    {
+        hole = (hole + 1) & mask;
+    }
+
+    // pull later entries of the run back over the hole, unless that would put them before their home
+    for (size_t slot{ (hole + 1) & mask }; m_idSlots[slot] != INVALID_RECORD; slot = (slot + 1) & mask)
+    {
+        const size_t home{ IdHome(m_records[m_idSlots[slot]].m_id) };
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            m_idSlots[hole] = m_idSlots[slot];
+            hole = slot;
+        }
+    }
+
+    m_idSlots[hole] = INVALID_RECORD;
+}
+
+void TimerWheel::IndexGrow()
+{
+    std::vector<RecordIndex> previous{ std::move(m_idSlots) };
+    m_idSlots.assign(std::max(previous.size() * 2, MIN_ID_SLOTS), INVALID_RECORD);
+
+    const size_t mask{ m_idSlots.size() - 1 };
+    for (const RecordIndex index : previous)
+    {
+        if (index == INVALID_RECORD)
+        {
+            continue;
+        }
+
+        size_t slot{ IdHome(m_records[index].m_id) };
+        while (m_idSlots[slot] != INVALID_RECORD)
+        {
+            slot = (slot + 1) & mask;
+        }
+        m_idSlots[slot] = index;
+    }
+}
+
+} // namespace Sage
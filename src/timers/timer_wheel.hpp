@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "threading/events.hpp"
+
+namespace Sage
+{
+
+// Hierarchical timing wheel (4 levels of 256 slots) over an abstract tick.
+// Timers live in compact slab records linked into their slot, so add and cancel are O(1)
+// and memory is bounded by the number of live timers. Records are also indexed by timer id in an
+// open addressed table of record indices. Advancing skips straight to the next tick with anything to
+// fire or cascade. Not thread safe.
+
+class TimerWheel
+{
+public:
+    using Tick = uint64_t;
+    using RecordIndex = uint32_t;
+
+    static constexpr RecordIndex INVALID_RECORD{ std::numeric_limits<RecordIndex>::max() };
+    // slot of a record that isn't linked into the wheel, e.g. while it fires
+    static constexpr uint16_t NO_SLOT{ std::numeric_limits<uint16_t>::max() };
+
+    struct Record
+    {
+        TimerEventId m_id;
+        Tick m_expiry;
+        // 0 for one-shot timers
+        uint32_t m_periodTicks;
+        // caller defined, e.g. an index into a destination table
+        uint32_t m_userIndex;
+        RecordIndex m_next;
+        RecordIndex m_prev;
+        uint16_t m_slot;
+    };
+
+    using OnExpiredFunc = std::move_only_function<void(const Record&)>;
+
+    explicit TimerWheel(size_t maxTimers);
+
+    size_t Size() const noexcept { return m_size; }
+
+    Tick Now() const noexcept { return m_now; }
+
+    // INVALID_RECORD once max timers are live. Expiries in the past fire on the next tick
+    RecordIndex Add(TimerEventId id, Tick expiry, uint32_t periodTicks, uint32_t userIndex);
+
+    // May be called from a callback, including for the record that's firing
+    void Cancel(RecordIndex index);
+
+    // INVALID_RECORD if no live timer has the id
+    RecordIndex Find(TimerEventId id) const noexcept;
+
+    const Record& Get(RecordIndex index) const noexcept { return m_records[index]; }
+
+    // Moves the wheel up to now, firing everything that expires on the way.
+    // Periodic timers are re-armed, one-shot timers are released after their callback.
+    // Callbacks get a copy of the record, and may add and cancel timers
+    void Advance(Tick now, OnExpiredFunc& onExpired);
+
+    // Earliest tick a timer expires at
+    std::optional<Tick> NextWakeTick() const noexcept;
+
+private:
+    static constexpr size_t LEVELS{ 4 };
+    static constexpr size_t SLOT_BITS{ 8 };
+    static constexpr size_t SLOTS_PER_LEVEL{ 1 << SLOT_BITS };
+    static constexpr Tick SLOT_MASK{ SLOTS_PER_LEVEL - 1 };
+    static constexpr Tick MAX_DELTA{ (Tick{ 1 } << (LEVELS * SLOT_BITS)) - 1 };
+    static constexpr size_t OCCUPANCY_WORD_BITS{ 64 };
+    static constexpr size_t MIN_ID_SLOTS{ 64 };
+
+    RecordIndex AllocateRecord();
+
+    void FreeRecord(RecordIndex index) noexcept;
+
+    void Insert(RecordIndex index) noexcept;
+
+    // No-op for a record that isn't linked
+    void Unlink(RecordIndex index) noexcept;
+
+    // Detaches the whole slot list, returning its head
+    RecordIndex TakeSlot(size_t slot) noexcept;
+
+    void SetOccupied(size_t slot, bool occupied) noexcept;
+
+    // Ticks from the level's current slot to the next occupied one, 1 to SLOTS_PER_LEVEL
+    std::optional<size_t> NextOccupiedOffset(size_t level) const noexcept;
+
+    // Earliest tick with a slot to fire or cascade. Nothing happens on the ticks before it
+    std::optional<Tick> NextEventTick() const noexcept;
+
+    void Cascade() noexcept;
+
+    void FireSlot(size_t slot, OnExpiredFunc& onExpired);
+
+    // Id index, linear probing with backward shift deletion
+
+    size_t IdHome(TimerEventId id) const noexcept;
+
+    void IndexInsert(RecordIndex index);
+
+    void IndexErase(RecordIndex index) noexcept;
+
+    // Doubles the table, keeping it at most half full
+    void IndexGrow();
+
+private:
+    const size_t m_maxTimers;
+    std::vector<Record> m_records{};
+    std::array<RecordIndex, LEVELS * SLOTS_PER_LEVEL> m_slotHeads{};
+    std::array<uint64_t, LEVELS * SLOTS_PER_LEVEL / OCCUPANCY_WORD_BITS> m_occupied{};
+    std::array<size_t, LEVELS> m_levelSizes{};
+    // record indices, INVALID_RECORD where empty. always a power of two in size
+    std::vector<RecordIndex> m_idSlots{};
+    // set while its callback runs, cleared if the callback cancels it
+    RecordIndex m_firing{ INVALID_RECORD };
+    RecordIndex m_freeHead{ INVALID_RECORD };
+    size_t m_size{ 0 };
+    Tick m_now{ 0 };
+};
+
+} // namespace Sage
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "channel/channel.hpp"
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+
+namespace Sage
+{
+
+// Interns destination channels so per timer state only needs a small index
+// instead of its own shared_ptr copy. Not thread safe.
+
+class TxTable
+{
+public:
+    using SharedThreadTx = std::shared_ptr<Channel::Tx<ThreadEvent>>;
+    using Index = uint32_t;
+
+    Index Acquire(const SharedThreadTx& tx)
+    {
+        if (auto itr{ m_indices.find(tx.get()) }; itr != m_indices.end())
+        {
+            m_entries[itr->second].m_refs++;
+            return itr->second;
+        }
+
+        Index index;
+        if (not m_freeIndices.empty())
+        {
+            index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+            m_entries[index] = Entry{ .m_tx = tx, .m_refs = 1 };
+        }
+        else
+        {
+            index = static_cast<Index>(m_entries.size());
+            m_entries.emplace_back(Entry{ .m_tx = tx, .m_refs = 1 });
+        }
+
+        m_indices.emplace(tx.get(), index);
+        return index;
+    }
+
+    void Release(Index index)
+    {
+        LOG_RETURN_IF(index >= m_entries.size(), LOG_CRITICAL);
+
+        Entry& entry{ m_entries[index] };
+        LOG_RETURN_IF(entry.m_refs == 0, LOG_CRITICAL);
+
+        if (--entry.m_refs == 0)
+        {
+            m_indices.erase(entry.m_tx.get());
+            entry.m_tx.reset();
+            m_freeIndices.emplace_back(index);
+        }
+    }
+
+    Channel::Tx<ThreadEvent>& Get(Index index) const noexcept { return *m_entries[index].m_tx; }
+
+    const SharedThreadTx& Shared(Index index) const noexcept { return m_entries[index].m_tx; }
+
+    // Whether any timer still holds tx
+    bool Contains(const Channel::Tx<ThreadEvent>* tx) const noexcept { return m_indices.contains(tx); }
+
+private:
+    struct Entry
+    {
+        SharedThreadTx m_tx;
+        size_t m_refs;
+    };
+
+    std::vector<Entry> m_entries{};
+    std::vector<Index> m_freeIndices{};
+    std::unordered_map<const Channel::Tx<ThreadEvent>*, Index> m_indices{};
+};
+
+} // namespace Sage
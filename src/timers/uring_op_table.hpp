@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "log/logger.hpp"
+#include "threading/events.hpp"
+#include "timers/tx_table.hpp"
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+// What an in flight ring operation was queued for
+enum class URingTimerOp : uint8_t
+{
+    Expiry,
+    Update,
+    Cancel,
+    WheelTick,
+    WheelUpdate,
+    CoalescedTick,
+    CoalescedUpdate
+};
+
+// Slab of in flight ring operations. The user data handed to the ring packs the slot index
+// with a generation, so a completion finds its record directly and stale completions are
+// caught instead of being matched against a reused slot. Not thread safe.
+
+class URingOpTable
+{
+public:
+    using Index = uint32_t;
+    using UserData = IOURing::UserData;
+
+    struct Record
+    {
+        TimerEventId m_timerId;
+        TxTable::Index m_txIndex;
+        uint32_t m_generation;
+        URingTimerOp m_op;
+        bool m_inUse;
+    };
+
+    UserData Acquire(URingTimerOp op, TimerEventId timerId, TxTable::Index txIndex = 0)
+    {
+        Index index;
+        if (not m_freeIndices.empty())
+        {
+            index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+        }
+        else
+        {
+            index = static_cast<Index>(m_records.size());
+            m_records.emplace_back(Record{});
+        }
+
+        Record& record{ m_records[index] };
+        // 0 is never handed out, so zeroed user data can't alias a live record
+        record.m_generation = record.m_generation == UINT32_MAX ? 1 : record.m_generation + 1;
+        record.m_timerId = timerId;
+        record.m_txIndex = txIndex;
+        record.m_op = op;
+        record.m_inUse = true;
+        m_size++;
+
+        return (static_cast<UserData>(record.m_generation) << 32) | index;
+    }
+
+    // nullptr for unknown or stale user data
+    const Record* Find(UserData data) const noexcept
+    {
+        const Index index{ IndexOf(data) };
+        if (index >= m_records.size())
+        {
+            return nullptr;
+        }
+
+        const Record& record{ m_records[index] };
+        if (not record.m_inUse or record.m_generation != GenerationOf(data))
+        {
+            return nullptr;
+        }
+
+        return &record;
+    }
+
+    void Release(UserData data)
+    {
+        LOG_RETURN_IF(Find(data) == nullptr, LOG_CRITICAL);
+
+        const Index index{ IndexOf(data) };
+        m_records[index].m_inUse = false;
+        m_freeIndices.emplace_back(index);
+        m_size--;
+    }
+
+    size_t Size() const noexcept { return m_size; }
+
+private:
+    static constexpr Index IndexOf(UserData data) noexcept { return static_cast<Index>(data & UINT32_MAX); }
+
+    static constexpr uint32_t GenerationOf(UserData data) noexcept { return static_cast<uint32_t>(data >> 32); }
+
+private:
+    std::vector<Record> m_records{};
+    std::vector<Index> m_freeIndices{};
+    size_t m_size{ 0 };
+};
+
+} // namespace Sage
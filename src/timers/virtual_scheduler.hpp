@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "timers/time_utils.hpp"
+
+namespace Sage
+{
+
+// Accounts for events in flight between threads while running on virtual time.
+// Channels count events as they are queued, receivers count them off once handled.
+// The timer thread only advances the virtual clock when nothing is outstanding.
+// Everything is a no-op on real time
+
+class VirtualScheduler
+{
+public:
+    static void WorkQueued(size_t nEvents = 1) noexcept
+    {
+        if (Clock::IsVirtual()) [[unlikely]]
+        {
+            s_outstanding.fetch_add(nEvents, std::memory_order_acq_rel);
+        }
+    }
+
+    static void WorkDone(size_t nEvents = 1) noexcept
+    {
+        if (Clock::IsVirtual() and nEvents > 0) [[unlikely]]
+        {
+            s_outstanding.fetch_sub(nEvents, std::memory_order_acq_rel);
+        }
+    }
+
+    static bool Idle() noexcept { return Outstanding() == 0; }
+
+    static size_t Outstanding() noexcept { return s_outstanding.load(std::memory_order_acquire); }
+
+private:
+    static inline std::atomic<size_t> s_outstanding{ 0 };
+};
+
+} // namespace Sage
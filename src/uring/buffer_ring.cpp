@@ -0,0 +1,54 @@
+#include "log/logger.hpp"
+#include "uring/buffer_ring.hpp"
+
+namespace Sage
+{
+
+URingBufferRing::URingBufferRing(IOURing& uring, uint16_t bufferGroup, unsigned nEntries, size_t entrySize) :
+    m_uring{ uring },
+    m_bufferGroup{ bufferGroup },
+    m_nEntries{ nEntries },
+    m_entrySize{ entrySize },
+    m_storage(static_cast<size_t>(nEntries) * entrySize),
+    m_bufferRing{ m_uring.SetupBufferRing(nEntries, bufferGroup) }
+{
+    LOG_RETURN_IF(m_bufferRing == nullptr, LOG_ERROR);
+
+    // every buffer starts out with the kernel
+    const int mask{ io_uring_buf_ring_mask(m_nEntries) };
+    for (unsigned i{ 0 }; i < m_nEntries; i++)
+    {
+        io_uring_buf_ring_add(
+            m_bufferRing,
+            m_storage.data() + (static_cast<size_t>(i) * m_entrySize),
+            static_cast<unsigned>(m_entrySize),
+            static_cast<unsigned short>(i),
+            mask,
+            static_cast<int>(i)
+        );
+    }
+    io_uring_buf_ring_advance(m_bufferRing, static_cast<int>(m_nEntries));
+}
+
+URingBufferRing::~URingBufferRing()
+{
+    if (m_bufferRing != nullptr)
+    {
+        m_uring.FreeBufferRing(m_bufferRing, m_nEntries, m_bufferGroup);
+    }
+}
+
+void URingBufferRing::Recycle(uint16_t bufferId) noexcept
+{
+    io_uring_buf_ring_add(
+        m_bufferRing,
+        m_storage.data() + (static_cast<size_t>(bufferId) * m_entrySize),
+        static_cast<unsigned>(m_entrySize),
+        bufferId,
+        io_uring_buf_ring_mask(m_nEntries),
+        0
+    );
+    io_uring_buf_ring_advance(m_bufferRing, 1);
+}
+
+} // namespace Sage
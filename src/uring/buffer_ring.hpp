@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <liburing.h>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "uring/io_uring.hpp"
+
+namespace Sage
+{
+
+// A group of equally sized buffers the kernel picks from as data arrives, so a multishot recv
+// only takes up memory once there is something to read. Only used from the ring's own thread
+
+class URingBufferRing final
+{
+public:
+    // nEntries must be a power of two
+    URingBufferRing(IOURing& uring, uint16_t bufferGroup, unsigned nEntries, size_t entrySize);
+
+    ~URingBufferRing();
+
+    bool IsValid() const noexcept { return m_bufferRing != nullptr; }
+
+    uint16_t BufferGroup() const noexcept { return m_bufferGroup; }
+
+    // The buffer a completion picked, if it picked one
+    static std::optional<uint16_t> BufferIdOf(const io_uring_cqe& cEvent) noexcept
+    {
+        if ((cEvent.flags & IORING_CQE_F_BUFFER) == 0)
+        {
+            return std::nullopt;
+        }
+
+        return static_cast<uint16_t>(cEvent.flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+
+    std::span<const std::byte> Buffer(uint16_t bufferId, size_t len) const noexcept
+    {
+        return { m_storage.data() + (static_cast<size_t>(bufferId) * m_entrySize), len };
+    }
+
+    // Hands the buffer back to the kernel to be picked again
+    void Recycle(uint16_t bufferId) noexcept;
+
+private:
+    URingBufferRing(const URingBufferRing&) = delete;
+    URingBufferRing(URingBufferRing&&) = delete;
+    URingBufferRing& operator=(const URingBufferRing&) = delete;
+    URingBufferRing& operator=(URingBufferRing&&) = delete;
+
+private:
+    IOURing& m_uring;
+    const uint16_t m_bufferGroup;
+    const unsigned m_nEntries;
+    const size_t m_entrySize;
+    std::vector<std::byte> m_storage;
+    io_uring_buf_ring* m_bufferRing;
+};
+
+} // namespace Sage
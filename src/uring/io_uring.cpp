@@ -3,24 +3,152 @@
 #include <liburing.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
 
 #include "log/logger.hpp"
 #include "uring/io_uring.hpp"
+#include "uring/uring_registry.hpp"
 
 namespace Sage
 {
 
-IOURing::IOURing(uint queueSize) : m_queueSize{ queueSize } { io_uring_queue_init(m_queueSize, &m_rawIOURing, 0); }
+IOURing::IOURing(uint queueSize, SubmitMode submitMode, const URingSetup& setup) :
+    m_queueSize{ queueSize },
+    m_submitMode{ submitMode }
+{
+    if (Init(setup))
+    {
+        URingRegistry::Register(*this);
+    }
+    // the kernel may round the SQ up
+    m_timeSpecs.resize(m_rawIOURing.sq.ring_entries);
+}
+
+IOURing::~IOURing()
+{
+    URingRegistry::Unregister(*this);
+    io_uring_queue_exit(&m_rawIOURing);
+}
+
+bool IOURing::Init(const URingSetup& setup)
+{
+    unsigned flags{ 0 };
+    if (setup.m_sqPoll)
+    {
+        flags |= IORING_SETUP_SQPOLL | (setup.m_sqPollCpu.has_value() ? IORING_SETUP_SQ_AFF : 0);
+    }
+    if (setup.m_singleIssuer)
+    {
+        // disabled until the issuing thread enables it, since that's rarely the one constructing it
+        flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    }
+    if (setup.m_coopTaskrun)
+    {
+        flags |= IORING_SETUP_COOP_TASKRUN;
+    }
+    if (setup.m_cqSize > 0)
+    {
+        flags |= IORING_SETUP_CQSIZE;
+    }
+
+    auto tryInit = [&](unsigned tryFlags)
+    {
+        io_uring_params params{};
+        params.flags = tryFlags;
+        params.sq_thread_idle = static_cast<__u32>(setup.m_sqPollIdle.count());
+        params.sq_thread_cpu = static_cast<__u32>(setup.m_sqPollCpu.value_or(0));
+        params.cq_entries = setup.m_cqSize;
+        return io_uring_queue_init_params(m_queueSize, &m_rawIOURing, &params);
+    };
+
+    // newest first, so an older kernel keeps as much of the setup as it can
+    static constexpr std::array<std::pair<unsigned, const char*>, 6> FALLBACKS{ {
+        { IORING_SETUP_DEFER_TASKRUN, "defer-taskrun" },
+        { IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_R_DISABLED, "single-issuer" },
+        { IORING_SETUP_COOP_TASKRUN, "coop-taskrun" },
+        { IORING_SETUP_SQ_AFF, "sqpoll-affinity" },
+        { IORING_SETUP_SQPOLL, "sqpoll" },
+        { IORING_SETUP_CQSIZE, "cq-size" },
+    } };
+
+    int res{ tryInit(flags) };
+    for (const auto& [fallback, name] : FALLBACKS)
+    {
+        if (res == 0)
+        {
+            break;
+        }
+
+        if ((flags & fallback) == 0)
+        {
+            continue;
+        }
+
+        LOG_WARNING("io_uring setup failed with {}, retrying without it. {}", name, strerror(-res));
+        flags &= ~fallback;
+        res = tryInit(flags);
+    }
+
+    if (res < 0)
+    {
+        LOG_CRITICAL("failed to set up io_uring. {}", strerror(-res));
+        return false;
+    }
+
+    m_disabled = (flags & IORING_SETUP_R_DISABLED) != 0;
+    return true;
+}
+
+bool IOURing::SetMaxWorkers(unsigned bounded, unsigned unbounded)
+{
+    // the kernel hands back the previous limits in place
+    std::array<unsigned, 2> limits{ bounded, unbounded };
+    if (int res = io_uring_register_iowq_max_workers(&m_rawIOURing, limits.data()); res < 0)
+    {
+        LOG_WARNING(
+            "failed to cap io_uring workers bounded:{} unbounded:{}. {}", bounded, unbounded, strerror(-res)
+        );
+        return false;
+    }
 
-IOURing::~IOURing() { io_uring_queue_exit(&m_rawIOURing); }
+    return true;
+}
+
+void IOURing::NoteSubmitter() noexcept
+{
+    static thread_local const pid_t tid{ gettid() };
+    if (m_submitter.load(std::memory_order_relaxed) != tid)
+    {
+        m_submitter.store(tid, std::memory_order_relaxed);
+    }
+}
+
+bool IOURing::Enable()
+{
+    if (not m_disabled)
+    {
+        return true;
+    }
+
+    if (int res = io_uring_enable_rings(&m_rawIOURing); res < 0)
+    {
+        LOG_ERROR("failed to enable io_uring. {}", strerror(-res));
+        return false;
+    }
+
+    m_disabled = false;
+    return true;
+}
 
 UniqueUringCEvent IOURing::WaitForEvent(const TimeNS& timeout)
 {
     LOG_TRACE("Waiting for events to populate");
 
+    CompleteBatch();
+
     io_uring_cqe* rawCEvent{ nullptr };
-    __kernel_timespec ts{ ChronoTimeToKernelTimeSpec(timeout) };
-    if (int res = io_uring_wait_cqe_timeout(&m_rawIOURing, &rawCEvent, &ts); res < 0)
+    if (int res = SubmitAndWait(&rawCEvent, timeout); res < 0)
     {
         switch (res)
         {
@@ -40,32 +168,86 @@ UniqueUringCEvent IOURing::WaitForEvent(const TimeNS& timeout)
         return nullptr;
     }
 
-    return UniqueUringCEvent{ rawCEvent,
-                              [this](io_uring_cqe* event)
-                              {
-                                  if (event != nullptr)
-                                  {
-                                      io_uring_cqe_seen(&m_rawIOURing, event);
-                                  }
-                              } };
+    return UniqueUringCEvent{ rawCEvent, URingCEventSeen{ &m_rawIOURing } };
+}
+
+URingCEventBatch IOURing::WaitForEvents(const TimeNS& timeout)
+{
+    LOG_TRACE("Waiting for events to populate");
+
+    CompleteBatch();
+
+    // only waits, the completion stays queued for the peek below
+    io_uring_cqe* rawCEvent{ nullptr };
+    if (int res = SubmitAndWait(&rawCEvent, timeout); res < 0)
+    {
+        switch (res)
+        {
+            // Ignore interrupts. i.e debugger pause / suspend
+            case -EINTR:
+            // timedout
+            case -ETIME:
+                break;
+
+            default:
+            {
+                LOG_ERROR("failed to waiting for event completion. {}", strerror(-res));
+                break;
+            }
+        }
+
+        return {};
+    }
+
+    return PeekEvents();
+}
+
+URingCEventBatch IOURing::PeekEvents()
+{
+    CompleteBatch();
+
+    m_cEventBatchSize = io_uring_peek_batch_cqe(&m_rawIOURing, m_cEventBatch.data(), MAX_CEVENT_BATCH);
+    return URingCEventBatch{ m_cEventBatch.data(), m_cEventBatchSize };
+}
+
+void IOURing::CompleteBatch() noexcept
+{
+    if (m_cEventBatchSize > 0)
+    {
+        io_uring_cq_advance(&m_rawIOURing, m_cEventBatchSize);
+        m_cEventBatchSize = 0;
+    }
 }
 
-bool IOURing::QueueTimeoutEvent(const UserData& data, const TimeNS& timeout)
+bool IOURing::QueueTimeoutEvent(const UserData& data, const TimeNS& timeout, bool multishot)
 {
     io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
     LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
 
     submissionEvent->user_data = data;
-    __kernel_timespec ts{ ChronoTimeToKernelTimeSpec(timeout) };
     io_uring_prep_timeout(
         submissionEvent,
-        &ts,
+        TimeSpecFor(submissionEvent, timeout),
         0,
         // ensure timeout keeps firing without rearming
-        IORING_TIMEOUT_MULTISHOT | IORING_TIMEOUT_BOOTTIME
+        (multishot ? IORING_TIMEOUT_MULTISHOT : 0) | IORING_TIMEOUT_BOOTTIME
+    );
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueDeadlineEvent(const UserData& data, const RealClock::time_point& deadline)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    submissionEvent->user_data = data;
+    // steady_clock is CLOCK_MONOTONIC, the ring's default clock for absolute timeouts
+    io_uring_prep_timeout(
+        submissionEvent, TimeSpecFor(submissionEvent, deadline.time_since_epoch()), 0, IORING_TIMEOUT_ABS
     );
 
-    return SubmitEvents();
+    return OnEventQueued();
 }
 
 bool IOURing::CancelTimeoutEvent(const UserData& cancelData, const UserData& timeoutData)
@@ -76,7 +258,7 @@ bool IOURing::CancelTimeoutEvent(const UserData& cancelData, const UserData& tim
     submissionEvent->user_data = cancelData;
     io_uring_prep_timeout_remove(submissionEvent, timeoutData, 0);
 
-    return SubmitEvents();
+    return OnEventQueued();
 }
 
 bool IOURing::UpdateTimeoutEvent(const UserData& updateData, const UserData& timeoutData, const TimeNS& timeout)
@@ -85,14 +267,372 @@ bool IOURing::UpdateTimeoutEvent(const UserData& updateData, const UserData& tim
     LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
 
     submissionEvent->user_data = updateData;
-    __kernel_timespec ts{ ChronoTimeToKernelTimeSpec(timeout) };
-    io_uring_prep_timeout_update(submissionEvent, &ts, timeoutData, 0);
+    io_uring_prep_timeout_update(submissionEvent, TimeSpecFor(submissionEvent, timeout), timeoutData, 0);
+
+    return OnEventQueued();
+}
+
+bool IOURing::UpdateDeadlineEvent(
+    const UserData& updateData, const UserData& timeoutData, const RealClock::time_point& deadline
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    submissionEvent->user_data = updateData;
+    io_uring_prep_timeout_update(
+        submissionEvent, TimeSpecFor(submissionEvent, deadline.time_since_epoch()), timeoutData, IORING_TIMEOUT_ABS
+    );
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueRead(const UserData& data, int fd, std::span<std::byte> buffer, uint64_t offset, bool fixedFile)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_read(submissionEvent, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset);
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueWrite(
+    const UserData& data, int fd, std::span<const std::byte> buffer, uint64_t offset, bool fixedFile
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_write(submissionEvent, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset);
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueReadFixed(
+    const UserData& data, int fd, std::span<std::byte> buffer, uint64_t offset, int bufferIndex, bool fixedFile
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_read_fixed(
+        submissionEvent, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset, bufferIndex
+    );
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueWriteFixed(
+    const UserData& data, int fd, std::span<const std::byte> buffer, uint64_t offset, int bufferIndex, bool fixedFile
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_write_fixed(
+        submissionEvent, fd, buffer.data(), static_cast<unsigned>(buffer.size()), offset, bufferIndex
+    );
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueReadv(
+    const UserData& data, int fd, std::span<const iovec> iovecs, uint64_t offset, bool fixedFile
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_readv(submissionEvent, fd, iovecs.data(), static_cast<unsigned>(iovecs.size()), offset);
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueWritev(
+    const UserData& data, int fd, std::span<const iovec> iovecs, uint64_t offset, bool fixedFile
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_writev(submissionEvent, fd, iovecs.data(), static_cast<unsigned>(iovecs.size()), offset);
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueFsync(const UserData& data, int fd, bool dataOnly, bool fixedFile)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_fsync(submissionEvent, fd, dataOnly ? IORING_FSYNC_DATASYNC : 0);
+    PrepareFileEvent(submissionEvent, data, fixedFile);
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueOpenAt(const UserData& data, int dirFd, const char* path, int flags, mode_t mode)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_openat(submissionEvent, dirFd, path, flags, mode);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::RegisterFiles(unsigned nSlots)
+{
+    // -1 leaves a slot empty, ready for UpdateFile
+    const std::vector<int> emptySlots(nSlots, -1);
+    if (int res = io_uring_register_files(&m_rawIOURing, emptySlots.data(), nSlots); res < 0)
+    {
+        LOG_ERROR("failed to register {} file slots. {}", nSlots, strerror(-res));
+        return false;
+    }
+
+    return true;
+}
+
+bool IOURing::UpdateFile(unsigned slot, int fd)
+{
+    if (int res = io_uring_register_files_update(&m_rawIOURing, slot, &fd, 1); res < 0)
+    {
+        LOG_ERROR("failed to update file slot:{} fd:{}. {}", slot, fd, strerror(-res));
+        return false;
+    }
+
+    return true;
+}
+
+bool IOURing::RegisterBuffers(std::span<const iovec> buffers)
+{
+    if (int res = io_uring_register_buffers(&m_rawIOURing, buffers.data(), static_cast<unsigned>(buffers.size()));
+        res < 0)
+    {
+        LOG_ERROR("failed to register {} buffers. {}", buffers.size(), strerror(-res));
+        return false;
+    }
+
+    return true;
+}
+
+bool IOURing::QueueMultishotAccept(const UserData& data, int listenFd)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_multishot_accept(submissionEvent, listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueMultishotRecv(const UserData& data, int fd, uint16_t bufferGroup)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    // the buffer comes from the group, so none is given here
+    io_uring_prep_recv_multishot(submissionEvent, fd, nullptr, 0, 0);
+    submissionEvent->flags |= IOSQE_BUFFER_SELECT;
+    submissionEvent->buf_group = bufferGroup;
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueSend(const UserData& data, int fd, std::span<const std::byte> buffer)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_send(submissionEvent, fd, buffer.data(), buffer.size(), MSG_WAITALL | MSG_NOSIGNAL);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueSendZeroCopy(const UserData& data, int fd, std::span<const std::byte> buffer)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_send_zc(submissionEvent, fd, buffer.data(), buffer.size(), MSG_WAITALL | MSG_NOSIGNAL, 0);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueConnect(const UserData& data, int fd, const sockaddr* addr, socklen_t addrLen)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_connect(submissionEvent, fd, addr, addrLen);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueClose(const UserData& data, int fd)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_close(submissionEvent, fd);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueSplice(
+    const UserData& data, int fdIn, int64_t offsetIn, int fdOut, int64_t offsetOut, unsigned len, unsigned flags
+)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_splice(submissionEvent, fdIn, offsetIn, fdOut, offsetOut, len, flags);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueTee(const UserData& data, int fdIn, int fdOut, unsigned len, unsigned flags)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_tee(submissionEvent, fdIn, fdOut, len, flags);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueCancel(const UserData& cancelData, const UserData& targetData)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_cancel64(submissionEvent, targetData, 0);
+    submissionEvent->user_data = cancelData;
+
+    return OnEventQueued();
+}
 
-    return SubmitEvents();
+bool IOURing::QueueCancelAll(const UserData& cancelData)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_cancel64(submissionEvent, 0, IORING_ASYNC_CANCEL_ANY);
+    submissionEvent->user_data = cancelData;
+
+    return OnEventQueued();
+}
+
+bool IOURing::BeginChain(unsigned nOps)
+{
+    LOG_RETURN_FALSE_IF(m_chainOpen, LOG_ERROR);
+
+    if (io_uring_sq_space_left(&m_rawIOURing) < nOps)
+    {
+        SubmitEvents();
+    }
+
+    if (io_uring_sq_space_left(&m_rawIOURing) < nOps)
+    {
+        LOG_ERROR("no room for a chain of {} ops in a queue of {}", nOps, m_queueSize);
+        return false;
+    }
+
+    m_chainOpen = true;
+    m_lastSubmissionEvent = nullptr;
+    return true;
+}
+
+bool IOURing::EndChain()
+{
+    LOG_RETURN_FALSE_IF(not m_chainOpen, LOG_ERROR);
+
+    m_chainOpen = false;
+    if (m_lastSubmissionEvent != nullptr)
+    {
+        m_lastSubmissionEvent->flags &= static_cast<decltype(m_lastSubmissionEvent->flags)>(~IOSQE_IO_LINK);
+    }
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueLinkTimeout(const UserData& data, const TimeNS& timeout)
+{
+    LOG_RETURN_FALSE_IF(not m_chainOpen or m_lastSubmissionEvent == nullptr, LOG_ERROR);
+
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    io_uring_prep_link_timeout(submissionEvent, TimeSpecFor(submissionEvent, timeout), 0);
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+bool IOURing::QueueMsgRing(const UserData& data, int targetRingFd, const UserData& targetData, int res)
+{
+    io_uring_sqe* submissionEvent{ GetSubmissionEvent() };
+    LOG_RETURN_FALSE_IF(submissionEvent == nullptr, LOG_CRITICAL);
+
+    // the target sees len as its completion's res
+    io_uring_prep_msg_ring(submissionEvent, targetRingFd, static_cast<unsigned>(res), targetData, 0);
+    submissionEvent->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    submissionEvent->user_data = data;
+
+    return OnEventQueued();
+}
+
+io_uring_buf_ring* IOURing::SetupBufferRing(unsigned nEntries, uint16_t bufferGroup)
+{
+    int res{ 0 };
+    io_uring_buf_ring* bufferRing{ io_uring_setup_buf_ring(&m_rawIOURing, nEntries, bufferGroup, 0, &res) };
+    if (bufferRing == nullptr)
+    {
+        LOG_ERROR("failed to set up buffer ring group:{} entries:{}. {}", bufferGroup, nEntries, strerror(-res));
+    }
+
+    return bufferRing;
+}
+
+void IOURing::FreeBufferRing(io_uring_buf_ring* bufferRing, unsigned nEntries, uint16_t bufferGroup)
+{
+    if (int res = io_uring_free_buf_ring(&m_rawIOURing, bufferRing, nEntries, bufferGroup); res < 0)
+    {
+        LOG_ERROR("failed to free buffer ring group:{}. {}", bufferGroup, strerror(-res));
+    }
 }
 
 bool IOURing::SubmitEvents()
 {
+    if (io_uring_sq_ready(&m_rawIOURing) == 0)
+    {
+        return true;
+    }
+
+    NoteSubmitter();
+
+    if (SubmitNeedsEnter())
+    {
+        m_nEnters.fetch_add(1, std::memory_order_relaxed);
+    }
+
     int res{ io_uring_submit(&m_rawIOURing) };
     bool success{ res >= 0 };
 
@@ -108,11 +648,68 @@ bool IOURing::SubmitEvents()
     return success;
 }
 
+bool IOURing::OnEventQueued()
+{
+    if (m_chainOpen)
+    {
+        // prep wipes the flags, so the link goes on once the op is fully queued
+        m_lastSubmissionEvent->flags |= IOSQE_IO_LINK;
+        return true;
+    }
+
+    return m_submitMode == SubmitMode::Deferred or SubmitEvents();
+}
+
+void IOURing::PrepareFileEvent(io_uring_sqe* submissionEvent, const UserData& data, bool fixedFile) noexcept
+{
+    submissionEvent->user_data = data;
+    if (fixedFile)
+    {
+        submissionEvent->flags |= IOSQE_FIXED_FILE;
+    }
+}
+
 io_uring_sqe* IOURing::GetSubmissionEvent()
 {
     io_uring_sqe* submissionEvent{ io_uring_get_sqe(&m_rawIOURing) };
+    // flushing would split an open chain, which only has the room it made for itself
+    if (submissionEvent == nullptr and not m_chainOpen and SubmitEvents())
+    {
+        LOG_TRACE("submission queue full, flushed");
+        submissionEvent = io_uring_get_sqe(&m_rawIOURing);
+    }
+
     LOG_IF(submissionEvent == nullptr, LOG_CRITICAL);
+    m_lastSubmissionEvent = submissionEvent;
     return submissionEvent;
 }
 
+__kernel_timespec* IOURing::TimeSpecFor(const io_uring_sqe* submissionEvent, const TimeNS& timeout) noexcept
+{
+    const auto index{ static_cast<size_t>(submissionEvent - m_rawIOURing.sq.sqes) };
+    __kernel_timespec& ts{ m_timeSpecs[index] };
+    ts = ChronoTimeToKernelTimeSpec(timeout);
+    return &ts;
+}
+
+int IOURing::SubmitAndWait(io_uring_cqe** rawCEvent, const TimeNS& timeout)
+{
+    NoteSubmitter();
+    m_nEnters.fetch_add(1, std::memory_order_relaxed);
+
+    __kernel_timespec ts{ ChronoTimeToKernelTimeSpec(timeout) };
+    return io_uring_submit_and_wait_timeout(&m_rawIOURing, rawCEvent, 1, &ts, nullptr);
+}
+
+bool IOURing::SubmitNeedsEnter() const noexcept
+{
+    if ((m_rawIOURing.flags & IORING_SETUP_SQPOLL) == 0)
+    {
+        return true;
+    }
+
+    // the kernel flags the poller going to sleep
+    return (__atomic_load_n(m_rawIOURing.sq.kflags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) != 0;
+}
+
 } // namespace Sage
@@ -1,16 +1,72 @@
 #pragma once
 
-#include <functional>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <liburing.h>
 #include <memory>
+#include <optional>
+#include <span>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <utility>
+#include <vector>
 
+#include "log/logger.hpp"
 #include "timers/time_utils.hpp"
 
 namespace Sage
 {
 
-using UniqueUringCEvent = std::unique_ptr<io_uring_cqe, std::function<void(io_uring_cqe*)>>;
+// Marks the completion seen once the caller is done with it
+struct URingCEventSeen
+{
+    io_uring* m_ring;
+
+    void operator()(io_uring_cqe* event) const noexcept
+    {
+        if (event != nullptr)
+        {
+            io_uring_cqe_seen(m_ring, event);
+        }
+    }
+};
+
+using UniqueUringCEvent = std::unique_ptr<io_uring_cqe, URingCEventSeen>;
+
+// Completions harvested in one go. Only valid until the ring is next waited on or peeked,
+// which marks them all seen
+using URingCEventBatch = std::span<io_uring_cqe* const>;
+
+// How a ring is set up. Whatever the running kernel lacks is dropped at setup, newest feature first
+// and with a warning, so every profile still ends up with a working ring
+
+struct URingSetup
+{
+    // a kernel thread polls the SQ, so submitting needs no syscall while it's awake
+    bool m_sqPoll{ false };
+    // how long the poller goes without work before it sleeps
+    TimeMS m_sqPollIdle{ 10ms };
+    std::optional<int> m_sqPollCpu{ std::nullopt };
+    // only one thread ever submits, and completion work is deferred until it waits.
+    // The ring is then only usable from the thread that enables it
+    bool m_singleIssuer{ false };
+    // completion work waits for the thread's next trip into the kernel instead of interrupting it
+    bool m_coopTaskrun{ false };
+    // 0 keeps the kernel's default of twice the SQ
+    unsigned m_cqSize{ 0 };
+
+    static URingSetup SqPoll(const TimeMS& idle = 10ms, std::optional<int> cpu = std::nullopt)
+    {
+        return URingSetup{ .m_sqPoll = true, .m_sqPollIdle = idle, .m_sqPollCpu = cpu };
+    }
+
+    static URingSetup SingleIssuer() { return URingSetup{ .m_singleIssuer = true }; }
+
+    static URingSetup CoopTaskrun() { return URingSetup{ .m_coopTaskrun = true }; }
+};
 
 class IOURing final
 {
@@ -18,31 +74,246 @@ public:
     // usually an id to reference against a map
     using UserData = decltype(io_uring_sqe{}.user_data);
 
-    explicit IOURing(uint queueSize);
+    enum class SubmitMode
+    {
+        // every queued op is submitted straight away
+        Immediate,
+        // ops only fill SQEs. The owner submits once per loop, or the SQ flushes itself when full
+        Deferred
+    };
+
+    explicit IOURing(uint queueSize, SubmitMode submitMode = SubmitMode::Immediate, const URingSetup& setup = {});
 
     ~IOURing();
 
+    // Single issuer rings start disabled, so the thread that will use them can claim them.
+    // Call from that thread before queueing anything. Does nothing for other rings
+    bool Enable();
+
+    // IORING_SETUP_* flags the ring ended up with, after any fallback
+    unsigned SetupFlags() const noexcept { return m_rawIOURing.flags; }
+
+    // Where other rings post messages to
+    int RingFd() const noexcept { return m_rawIOURing.ring_fd; }
+
+    // The thread that last submitted, whose kernel workers run this ring's blocking ops. 0 until then
+    pid_t Submitter() const noexcept { return m_submitter.load(std::memory_order_relaxed); }
+
+    // Caps the io-wq workers started for this ring. 0 leaves that kind as it is.
+    // Most code wants URingRegistry::SetMaxWorkers instead
+    bool SetMaxWorkers(unsigned bounded, unsigned unbounded);
+
+    // Calls into the kernel to submit or wait. Submits an SQ poller picked up by itself aren't counted
+    size_t Enters() const noexcept { return m_nEnters.load(std::memory_order_relaxed); }
+
+    // Waits also submit anything queued in deferred mode
+
     UniqueUringCEvent WaitForEvent(const TimeNS& timeout = 100ms);
 
-    bool QueueTimeoutEvent(const UserData& data, const TimeNS& timeout);
+    // Waits for at least one completion, then takes up to MAX_CEVENT_BATCH without copying
+    URingCEventBatch WaitForEvents(const TimeNS& timeout = 100ms);
+
+    // Takes whatever is ready without waiting. Empty once the completion queue is drained
+    URingCEventBatch PeekEvents();
+
+    // multishot timeouts keep firing every timeout until cancelled
+    bool QueueTimeoutEvent(const UserData& data, const TimeNS& timeout, bool multishot = true);
+
+    // one shot, fires at an absolute point on the monotonic clock
+    bool QueueDeadlineEvent(const UserData& data, const RealClock::time_point& deadline);
 
     bool CancelTimeoutEvent(const UserData& cancelData, const UserData& timeoutData);
 
     bool UpdateTimeoutEvent(const UserData& cancelData, const UserData& timeoutData, const TimeNS& timeout);
 
+    bool UpdateDeadlineEvent(
+        const UserData& updateData, const UserData& timeoutData, const RealClock::time_point& deadline
+    );
+
+    // File I/O. With fixedFile set, fd is a slot in the registered file table.
+    // Buffers, iovecs and paths must stay valid until the completion comes back
+
+    bool QueueRead(const UserData& data, int fd, std::span<std::byte> buffer, uint64_t offset, bool fixedFile = false);
+
+    bool QueueWrite(
+        const UserData& data, int fd, std::span<const std::byte> buffer, uint64_t offset, bool fixedFile = false
+    );
+
+    // buffer must lie within registered buffer bufferIndex
+
+    bool QueueReadFixed(
+        const UserData& data, int fd, std::span<std::byte> buffer, uint64_t offset, int bufferIndex,
+        bool fixedFile = false
+    );
+
+    bool QueueWriteFixed(
+        const UserData& data, int fd, std::span<const std::byte> buffer, uint64_t offset, int bufferIndex,
+        bool fixedFile = false
+    );
+
+    bool QueueReadv(
+        const UserData& data, int fd, std::span<const iovec> iovecs, uint64_t offset, bool fixedFile = false
+    );
+
+    bool QueueWritev(
+        const UserData& data, int fd, std::span<const iovec> iovecs, uint64_t offset, bool fixedFile = false
+    );
+
+    // dataOnly skips metadata that isn't needed to read the data back, like fdatasync
+    bool QueueFsync(const UserData& data, int fd, bool dataOnly = false, bool fixedFile = false);
+
+    // Completes with the new fd
+    bool QueueOpenAt(const UserData& data, int dirFd, const char* path, int flags, mode_t mode = 0);
+
+    // Registered resources. Registration is synchronous, so it's done once an op can use it
+
+    // A table of nSlots empty slots, filled in with UpdateFile
+    bool RegisterFiles(unsigned nSlots);
+
+    // fd of -1 empties the slot
+    bool UpdateFile(unsigned slot, int fd);
+
+    bool RegisterBuffers(std::span<const iovec> buffers);
+
+    // Sockets
+
+    // Completes once per accepted connection, with IORING_CQE_F_MORE set for as long as it keeps accepting
+    bool QueueMultishotAccept(const UserData& data, int listenFd);
+
+    // Completes once per message, each into a buffer picked from the provided buffer group.
+    // Stops, without IORING_CQE_F_MORE, on EOF, an error or when the group runs dry
+    bool QueueMultishotRecv(const UserData& data, int fd, uint16_t bufferGroup);
+
+    // Retries short sends itself, so it only completes once all of data is sent or it fails
+    bool QueueSend(const UserData& data, int fd, std::span<const std::byte> buffer);
+
+    // Like QueueSend without copying buffer into the kernel. Completes a second time with
+    // IORING_CQE_F_NOTIF once the kernel is done with buffer
+    bool QueueSendZeroCopy(const UserData& data, int fd, std::span<const std::byte> buffer);
+
+    // addr must stay valid until the completion comes back
+    bool QueueConnect(const UserData& data, int fd, const sockaddr* addr, socklen_t addrLen);
+
+    bool QueueClose(const UserData& data, int fd);
+
+    // One side of a splice must be a pipe. An offset of -1 uses and moves the fd's own position,
+    // and is the only choice for pipes
+    bool QueueSplice(
+        const UserData& data, int fdIn, int64_t offsetIn, int fdOut, int64_t offsetOut, unsigned len, unsigned flags = 0
+    );
+
+    // Copies up to len bytes from the head of one pipe into another, without consuming them
+    bool QueueTee(const UserData& data, int fdIn, int fdOut, unsigned len, unsigned flags = 0);
+
+    // Cancels any op, multishot ones included, by its user data
+    bool QueueCancel(const UserData& cancelData, const UserData& targetData);
+
+    // Cancels every op in flight
+    bool QueueCancelAll(const UserData& cancelData);
+
+    // Ops queued between BeginChain and EndChain run one after the other, each only once the one before
+    // it succeeded. A failure completes the rest of the chain with -ECANCELED. Room is made for nOps up
+    // front, so a chain is never split across submits
+    bool BeginChain(unsigned nOps);
+
+    bool EndChain();
+
+    // Only in a chain, right after the op it bounds. The kernel cancels that op with -ECANCELED if it
+    // hasn't completed within timeout. The timeout completes too, -ETIME if it fired and -ECANCELED if not
+    bool QueueLinkTimeout(const UserData& data, const TimeNS& timeout);
+
+    // Queues the op queueOp() queues with a deadline the kernel enforces, in one submit. True once the op
+    // itself is queued, as its completion will come whatever happens to the timeout, which failing only
+    // leaves the op without a deadline
+    template<typename QueueOp>
+    bool QueueWithTimeout(const UserData& timeoutData, const TimeNS& timeout, QueueOp&& queueOp)
+    {
+        if (not BeginChain(2))
+        {
+            return false;
+        }
+
+        const bool queued{ std::forward<QueueOp>(queueOp)() };
+        if (queued and not QueueLinkTimeout(timeoutData, timeout))
+        {
+            LOG_WARNING("failed to queue a {} timeout, the op runs without one", timeout);
+        }
+
+        if (not EndChain() and queued)
+        {
+            LOG_WARNING("failed to submit an op queued with a {} timeout, it goes with the next submit", timeout);
+        }
+
+        return queued;
+    }
+
+    // Posts a completion carrying targetData and res straight into the ring behind targetRingFd,
+    // waking anything waiting on it. Only a failure completes here, with data
+    bool QueueMsgRing(const UserData& data, int targetRingFd, const UserData& targetData, int res);
+
+    // Provided buffer rings. nEntries must be a power of two. nullptr on failure
+    io_uring_buf_ring* SetupBufferRing(unsigned nEntries, uint16_t bufferGroup);
+
+    void FreeBufferRing(io_uring_buf_ring* bufferRing, unsigned nEntries, uint16_t bufferGroup);
+
+    // Submits everything queued so far. Nothing to do in immediate mode
+    bool SubmitEvents();
+
 private:
     IOURing(const IOURing&) = delete;
     IOURing(IOURing&&) = delete;
     IOURing& operator=(const IOURing&) = delete;
     IOURing& operator=(IOURing&&) = delete;
 
+    // Flushes the SQ to make room when it's full
     io_uring_sqe* GetSubmissionEvent();
 
-    bool SubmitEvents();
+    // Sets the user data, and marks fd as a registered file slot if fixedFile
+    static void PrepareFileEvent(io_uring_sqe* submissionEvent, const UserData& data, bool fixedFile) noexcept;
+
+    // Only submits straight away in immediate mode
+    bool OnEventQueued();
+
+    // The kernel only reads timeouts at submission, so they must outlive a deferred SQE.
+    // Each SQE slot has its own, reused once the slot is
+    __kernel_timespec* TimeSpecFor(const io_uring_sqe* submissionEvent, const TimeNS& timeout) noexcept;
+
+    // Submits while waiting for at least one completion, in a single syscall
+    int SubmitAndWait(io_uring_cqe** rawCEvent, const TimeNS& timeout);
+
+    // Sets the ring up with as much of setup as the kernel supports. False if it couldn't at all
+    bool Init(const URingSetup& setup);
+
+    void NoteSubmitter() noexcept;
+
+    // False when an SQ poller is awake and will pick submissions up by itself
+    bool SubmitNeedsEnter() const noexcept;
+
+    // Hands the last batch's slots back to the kernel
+    void CompleteBatch() noexcept;
+
+    static constexpr size_t MAX_CEVENT_BATCH{ 256 };
 
     io_uring m_rawIOURing{};
 
     const uint m_queueSize;
+
+    const SubmitMode m_submitMode;
+
+    std::vector<__kernel_timespec> m_timeSpecs{};
+
+    std::array<io_uring_cqe*, MAX_CEVENT_BATCH> m_cEventBatch{};
+    uint m_cEventBatchSize{ 0 };
+
+    bool m_disabled{ false };
+
+    // set on every op queued while a chain is open, and taken off the last one when it's closed
+    bool m_chainOpen{ false };
+    io_uring_sqe* m_lastSubmissionEvent{ nullptr };
+
+    std::atomic<size_t> m_nEnters{ 0 };
+
+    std::atomic<pid_t> m_submitter{ 0 };
 };
 
 } // namespace Sage
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "log/logger.hpp"
+#include "uring/io_uring.hpp"
+#include "uring/uring_registry.hpp"
+
+namespace Sage
+{
+
+namespace
+{
+
+std::string ReadTaskName(const std::filesystem::path& taskDir)
+{
+    std::string name;
+    std::ifstream comm{ taskDir / "comm" };
+    std::getline(comm, name);
+    return name;
+}
+
+// The sq poll thread of a ring, from its fdinfo. 0 if it has none
+pid_t ReadSqThread(int ringFd)
+{
+    static constexpr std::string_view SQ_THREAD{ "SqThread:" };
+
+    std::ifstream fdInfo{ std::filesystem::path{ "/proc/self/fdinfo" } / std::to_string(ringFd) };
+    for (std::string line; std::getline(fdInfo, line);)
+    {
+        if (not line.starts_with(SQ_THREAD))
+        {
+            continue;
+        }
+
+        const std::string_view value{ std::string_view{ line }.substr(SQ_THREAD.size()) };
+        const size_t start{ std::min(value.find_first_not_of(" \t"), value.size()) };
+        pid_t tid{ 0 };
+        std::from_chars(value.data() + start, value.data() + value.size(), tid);
+        return std::max(tid, pid_t{ 0 });
+    }
+
+    return 0;
+}
+
+} // namespace
+
+void URingRegistry::SetMaxWorkers(unsigned bounded, unsigned unbounded)
+{
+    std::scoped_lock lk{ s_mtx };
+    s_maxBounded = bounded;
+    s_maxUnbounded = unbounded;
+
+    for (IOURing* ring : s_rings)
+    {
+        ring->SetMaxWorkers(bounded, unbounded);
+    }
+}
+
+std::vector<URingRegistry::RingWorkers> URingRegistry::Workers()
+{
+    // workers are named after the thread they work for, iou-wrk-<tid>
+    static constexpr std::string_view WORKER_PREFIX{ "iou-wrk-" };
+
+    std::unordered_map<pid_t, size_t> nWorkers;
+    std::error_code ec;
+    for (const auto& task : std::filesystem::directory_iterator{ "/proc/self/task", ec })
+    {
+        const std::string name{ ReadTaskName(task.path()) };
+        if (not name.starts_with(WORKER_PREFIX))
+        {
+            continue;
+        }
+
+        pid_t owner{ 0 };
+        const std::string_view ownerTid{ std::string_view{ name }.substr(WORKER_PREFIX.size()) };
+        if (std::from_chars(ownerTid.data(), ownerTid.data() + ownerTid.size(), owner).ec == std::errc{})
+        {
+            nWorkers[owner]++;
+        }
+    }
+
+    std::scoped_lock lk{ s_mtx };
+    std::vector<RingWorkers> res;
+    std::unordered_map<pid_t, size_t> nRingsOnPool;
+    for (const IOURing* ring : s_rings)
+    {
+        // a sq poll thread submits for its ring, so the ring's workers are its own
+        const pid_t sqThread{ (ring->SetupFlags() & IORING_SETUP_SQPOLL) != 0 ? ReadSqThread(ring->RingFd()) : 0 };
+        const pid_t owner{ sqThread != 0 ? sqThread : ring->Submitter() };
+        res.emplace_back(RingWorkers{
+            .m_ringFd = ring->RingFd(),
+            .m_owner = owner,
+            .m_ownerName = owner == 0
+                               ? std::string{}
+                               : ReadTaskName(std::filesystem::path{ "/proc/self/task" } / std::to_string(owner)),
+            .m_setupFlags = ring->SetupFlags(),
+            .m_workers = owner == 0 ? 0 : nWorkers[owner],
+            .m_ringsOnPool = 1 });
+        if (owner != 0)
+        {
+            nRingsOnPool[owner]++;
+        }
+    }
+
+    for (auto& ring : res)
+    {
+        ring.m_ringsOnPool = ring.m_owner == 0 ? 1 : nRingsOnPool[ring.m_owner];
+    }
+
+    return res;
+}
+
+void URingRegistry::Register(IOURing& ring)
+{
+    std::scoped_lock lk{ s_mtx };
+    s_rings.emplace_back(&ring);
+
+    if (s_maxBounded > 0 or s_maxUnbounded > 0)
+    {
+        ring.SetMaxWorkers(s_maxBounded, s_maxUnbounded);
+    }
+}
+
+void URingRegistry::Unregister(IOURing& ring)
+{
+    std::scoped_lock lk{ s_mtx };
+    std::erase(s_rings, &ring);
+}
+
+} // namespace Sage
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace Sage
+{
+
+// forward decls
+
+class IOURing;
+
+// Every live IOURing in the process. Caps the io-wq workers rings may start, and reports how many
+// each has started
+
+class URingRegistry
+{
+public:
+    struct RingWorkers
+    {
+        int m_ringFd;
+        // the thread the kernel runs the ring's workers for. Its sq poll thread if it has one, otherwise
+        // the thread submitting to it. 0 until a ring without one has been submitted to
+        pid_t m_owner;
+        std::string m_ownerName;
+        unsigned m_setupFlags;
+        size_t m_workers;
+        // rings served by the same workers, this one included
+        size_t m_ringsOnPool;
+    };
+
+    // Caps the io-wq workers of rings created later, and of existing rings whose submitter has yet to
+    // start using them. The kernel applies the cap to the calling thread's workers, so a ring already
+    // in use keeps its pool, and enabled single issuer rings refuse it. Set it before starting threads.
+    // Bounded workers run file io, unbounded ones io that may wait forever, like sockets. 0 leaves
+    // that kind as it is
+    static void SetMaxWorkers(unsigned bounded, unsigned unbounded);
+
+    // One entry per live ring, with the iou-wrk threads its owner has in /proc/self/task.
+    // Rings with the same owner share those workers, so the count is the pool's rather than the ring's alone
+    static std::vector<RingWorkers> Workers();
+
+private:
+    friend class IOURing;
+
+    static void Register(IOURing& ring);
+
+    static void Unregister(IOURing& ring);
+
+private:
+    static inline std::mutex s_mtx{};
+    static inline std::vector<IOURing*> s_rings{};
+    static inline unsigned s_maxBounded{ 0 };
+    static inline unsigned s_maxUnbounded{ 0 };
+};
+
+} // namespace Sage